@@ -0,0 +1,215 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/*
+ * File:   BufferPool.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 14:20
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QtGlobal>
+
+/* Index marking the end of a buffer pool's free list */
+#define BUFFER_POOL_FREE_LIST_END -1
+
+/**
+ * Allocation statistics for a buffer pool.
+ * heapAllocations counts buffers that had to come from the heap because the arena was exhausted,
+ * it stays at zero while the pool is large enough.
+ */
+typedef struct {
+	int size;
+	int inUse;
+	int peakInUse;
+	int allocations;
+	int heapAllocations;
+} BufferPoolStats;
+
+/**
+ * Fixed arena of reference counted buffers of type T.
+ * Buffers are handed around as Ref handles, copying a Ref only copies a pointer.  The buffer
+ * goes back to the arena when the last Ref to it is released, from any thread.  The free list
+ * is a lock free stack so neither allocating nor releasing ever waits on another thread.
+ * Only Owner can modify a buffer, everyone else gets a read-only view.
+ */
+template <typename T, int Size, typename Owner>
+class BufferPool {
+	struct Entry {
+		T item;
+		QAtomicInt refCount;
+		QAtomicInt next;		/* Index of the entry below it on the free list */
+		bool fromHeap;
+	};
+	
+public:
+	/**
+	 * Handle to a pooled buffer.
+	 */
+	class Ref {
+	public:
+		Ref() : entry(NULL) {
+		}
+		
+		Ref(const Ref &other) : entry(other.entry) {
+			if(entry) {
+				entry->refCount.ref();
+			}
+		}
+		
+		~Ref() {
+			release();
+		}
+		
+		Ref &operator=(const Ref &other) {
+			if(other.entry) {
+				other.entry->refCount.ref();
+			}
+			release();
+			entry = other.entry;
+			return *this;
+		}
+		
+		bool isNull() const {
+			return entry == NULL;
+		}
+		
+		const T *operator->() const {
+			return &entry->item;
+		}
+		
+		const T &operator*() const {
+			return entry->item;
+		}
+		
+	private:
+		friend class BufferPool;
+		friend Owner;
+		
+		/**
+		 * @return The buffer for modifying, nothing else may be using it
+		 */
+		T *writable() {
+			return &entry->item;
+		}
+		
+		explicit Ref(Entry *entry) : entry(entry) {
+		}
+		
+		void release() {
+			if(entry && !entry->refCount.deref()) {
+				BufferPool::free(entry);
+			}
+			entry = NULL;
+		}
+		
+		Entry *entry;
+	};
+	
+	/**
+	 * Take a buffer from the arena, falling back to the heap if it is exhausted.  Never blocks,
+	 * so a real time thread can't be held up behind another thread releasing a buffer.
+	 * The contents are left as they were when the buffer was last released.
+	 * @return Handle to the buffer, the only reference to it
+	 */
+	static Ref allocate() {
+		allocations.fetchAndAddRelaxed(1);
+		Entry *entry = pop();
+		if(entry == NULL) {
+			/* Entries are handed out in order the first time round, so the arena needs no setting up */
+			int index = unused.loadAcquire() < Size ? unused.fetchAndAddRelaxed(1) : Size;
+			if(index < Size) {
+				entry = &arena[index];
+			} else {
+				heapAllocations.fetchAndAddRelaxed(1);
+				entry = new Entry;
+				entry->fromHeap = true;
+			}
+		}
+		int nowInUse = inUse.fetchAndAddRelaxed(1) + 1;
+		int peak = peakInUse.loadAcquire();
+		while(nowInUse > peak && !peakInUse.testAndSetRelaxed(peak, nowInUse, peak)) {
+		}
+		entry->refCount.storeRelease(1);
+		return Ref(entry);
+	}
+	
+	static BufferPoolStats getStats() {
+		BufferPoolStats stats = {Size, inUse.loadAcquire(), peakInUse.loadAcquire(), allocations.loadAcquire(), heapAllocations.loadAcquire()};
+		return stats;
+	}
+	
+private:
+	/* Free list head, the index of the top entry in the low 32 bits and a count of changes to the
+	   head in the high 32 bits.  The count stops an entry taken and put back by another thread
+	   in the middle of a pop being mistaken for an unchanged list. */
+	static quint64 makeHead(quint64 oldHead, int index) {
+		return (((oldHead >> 32) + 1) << 32) | (quint32)index;
+	}
+	
+	static Entry *pop() {
+		quint64 head = freeHead.loadAcquire();
+		for(;;) {
+			int index = (int)(quint32)head;
+			if(index == BUFFER_POOL_FREE_LIST_END) {
+				return NULL;
+			}
+			if(freeHead.testAndSetOrdered(head, makeHead(head, arena[index].next.loadAcquire()), head)) {
+				return &arena[index];
+			}
+		}
+	}
+	
+	static void free(Entry *entry) {
+		inUse.fetchAndAddRelaxed(-1);
+		if(entry->fromHeap) {
+			delete entry;
+			return;
+		}
+		int index = entry - arena;
+		quint64 head = freeHead.loadAcquire();
+		do {
+			entry->next.storeRelease((int)(quint32)head);
+		} while(!freeHead.testAndSetOrdered(head, makeHead(head, index), head));
+	}
+	
+	static Entry arena[Size];
+	static QAtomicInteger<quint64> freeHead;
+	static QAtomicInt unused;
+	static QAtomicInt inUse;
+	static QAtomicInt peakInUse;
+	static QAtomicInt allocations;
+	static QAtomicInt heapAllocations;
+};
+
+template <typename T, int Size, typename Owner> typename BufferPool<T, Size, Owner>::Entry BufferPool<T, Size, Owner>::arena[Size];
+template <typename T, int Size, typename Owner> QAtomicInteger<quint64> BufferPool<T, Size, Owner>::freeHead((quint32)BUFFER_POOL_FREE_LIST_END);
+template <typename T, int Size, typename Owner> QAtomicInt BufferPool<T, Size, Owner>::unused(0);
+template <typename T, int Size, typename Owner> QAtomicInt BufferPool<T, Size, Owner>::inUse(0);
+template <typename T, int Size, typename Owner> QAtomicInt BufferPool<T, Size, Owner>::peakInUse(0);
+template <typename T, int Size, typename Owner> QAtomicInt BufferPool<T, Size, Owner>::allocations(0);
+template <typename T, int Size, typename Owner> QAtomicInt BufferPool<T, Size, Owner>::heapAllocations(0);
+
+#endif /* BUFFERPOOL_H */
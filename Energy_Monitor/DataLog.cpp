@@ -161,19 +161,41 @@ void DataLog::slotMeasurementsReady(DecodedMeasurements values) {
                         << "Line Frequency,"
                         << "Power Factor,"
                         << "Apparent Power,"
-                        << "Reactive Power"
+                        << "Reactive Power,"
+                        << "Sequence,"
+                        << "System Status,"
+                        << "Device,"
+                        << "Import Active Energy,"
+                        << "Export Active Energy,"
+                        << "Import Reactive Energy,"
+                        << "Export Reactive Energy,"
+                        << "Tracked 1,"
+                        << "Minimum 1,"
+                        << "Maximum 1,"
+                        << "Tracked 2,"
+                        << "Minimum 2,"
+                        << "Maximum 2"
                         << "\n";
                 }
+                /* Time the measurement was read, the same time network clients are sent */
                 QString format = QString("yyyy-MM-dd hh:mm:ss.zzz");
-                QString currentTimeString = QDateTime::currentDateTime().toString(format);
-                out << currentTimeString << ","
-                    << values.powerActive << ","
-                    << values.voltageRms << ","
-                    << values.currentRms << ","
-                    << values.frequency << ","
-                    << values.powerFactor << ","
-                    << values.powerApparent << ","
-                    << values.powerReactive
+                QString timeString = QDateTime::fromMSecsSinceEpoch(values.timeStamp).toString(format);
+                /* The energy columns are left empty until the counters have been read */
+                QString energyString(",,,");
+                if(values.deviceId < energyData.size() && !energyData.at(values.deviceId).isEmpty()) {
+                    energyString = energyData.at(values.deviceId);
+                }
+                QString extremesString(",,,,,");
+                if(values.deviceId < extremesData.size() && !extremesData.at(values.deviceId).isEmpty()) {
+                    extremesString = extremesData.at(values.deviceId);
+                }
+                out << timeString << ","
+                    << MCP39F511Interface::formatMeasurements(values) << ","
+                    << values.sequence << ","
+                    << QString("0x%1").arg(values.systemStatus, 4, 16, QChar('0')) << ","
+                    << values.deviceId << ","
+                    << energyString << ","
+                    << extremesString
                     << "\n";
 
                 // optional, as QFile destructor will already do it:
@@ -189,6 +211,73 @@ void DataLog::slotMeasurementsReady(DecodedMeasurements values) {
 	}
 }
 
+/**
+ * The energy counters are read far less often than measurements are logged, the latest
+ * totals are added to each measurement from the same MCP39F511.
+ */
+void DataLog::slotEnergyTotalsReady(EnergyTotals energy) {
+    if(energyData.size() <= energy.deviceId) {
+        energyData.resize(energy.deviceId + 1);
+    }
+    energyData[energy.deviceId] = MCP39F511Interface::formatEnergyTotals(energy);
+}
+
+/**
+ * The extremes since the last read are added to each measurement from the same MCP39F511
+ * until the next read
+ */
+void DataLog::slotExtremesReady(MeasurementExtremes extremes) {
+    if(extremesData.size() <= extremes.deviceId) {
+        extremesData.resize(extremes.deviceId + 1);
+    }
+    extremesData[extremes.deviceId] = MCP39F511MinMaxRecorder::formatExtremes(extremes);
+}
+
+/**
+ * Each burst is written to a file of its own in one go, the burst is held in RAM until now
+ * so the capture never waits on the USB storage device.
+ */
+void DataLog::slotBurstReady(const MeasurementBurst &burst) {
+    if(loggingActive == false) {
+        return;
+    }
+    if(getStorageAvailable() <= USB_STORAGE_MINIMUM_SPACE) {
+        printMessage(QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Not enough storage space to log the burst."));
+        return;
+    }
+    QString filePath(USB_STORAGE_DEVICE_MOUNT_POINT);
+    filePath += "/" + burst.start.toString("dd-MM-yyyy hh-mm-ss");
+    if(burst.deviceId > 0) {
+        filePath += QString(" - device %1").arg(burst.deviceId);
+    }
+    filePath += " - Energy Monitor burst.csv";
+    QFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) {
+        printMessage(QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Unable to open burst file %1 for writing.").arg(filePath));
+        return;
+    }
+    QTextStream out(&file);
+    out << "Time (ms),"
+        << "Active Power,"
+        << "RMS Voltage,"
+        << "RMS Current,"
+        << "Line Frequency,"
+        << "Power Factor,"
+        << "Apparent Power,"
+        << "Reactive Power,"
+        << "System Status"
+        << "\n";
+    for(int i = 0; i < burst.samples.size(); i++) {
+        const BurstSample &sample = burst.samples.at(i);
+        out << QString::number(sample.time / (double)1000, 'f', 3) << ","
+            << MCP39F511Interface::formatMeasurements(sample.values) << ","
+            << QString("0x%1").arg(sample.systemStatus, 4, 16, QChar('0'))
+            << "\n";
+    }
+    file.close();
+    printMessage(QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Burst of %1 samples written to %2").arg(burst.samples.size()).arg(filePath));
+}
+
 /**
  * Overridden QObject timerEvent method for servicing the USB storage device mount / unmount process.
  * @param QTimerEvent data.
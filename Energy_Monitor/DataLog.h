@@ -30,13 +30,18 @@
 /* This is the device that will be mounted by default to store the logs */
 #define DEFAULT_MOUNT_DEVICE "/dev/sda1"
 #define USB_STORAGE_DEVICE_MOUNT_POINT "/tmp/usblog"
+/* Minimum time in milliseconds between logged measurements, logs up to 10 per second */
+#define DATA_LOG_INTERVAL 100
 
 
+#include "MCP39F511BurstCapture.h"
 #include "MCP39F511Interface.h"
+#include "MCP39F511MinMaxRecorder.h"
 
 #include <libudev.h>
 
 #include <QObject>
+#include <QVector>
 
 class DataLog : public QObject {
     Q_OBJECT
@@ -56,6 +61,9 @@ signals:
 
 public slots:
     void slotMeasurementsReady(DecodedMeasurements);
+    void slotBurstReady(const MeasurementBurst &burst);
+    void slotEnergyTotalsReady(EnergyTotals energy);
+    void slotExtremesReady(MeasurementExtremes extremes);
     void startLogging();
     void stopLogging();
         
@@ -69,6 +77,10 @@ private:
 	bool loggingActive;
     bool newFile;
     QString currentFilePath;
+    /* Latest energy totals formatted ready to log with each measurement, indexed by MCP39F511 device ID */
+    QVector<QString> energyData;
+    /* Latest hardware tracked extremes formatted ready to log, indexed by MCP39F511 device ID */
+    QVector<QString> extremesData;
 	udev_monitor *udevMonitor;
 	int udevMonitorFileDescriptor;
 
@@ -34,6 +34,7 @@
 #include <QList>
 #include <QNetworkInterface>
 #include <QString>
+#include <QThread>
 
 #include "EnergyMonitor.h"
 #include "DataLogServer.h"
@@ -41,6 +42,11 @@
 
 DataLogServer::DataLogServer(QObject *parent) {
     setParent(parent);
+    /* Needed to queue them to the clients' threads */
+    qRegisterMetaType<DecodedMeasurements>("DecodedMeasurements");
+    qRegisterMetaType<EnergyTotals>("EnergyTotals");
+    qRegisterMetaType<MeasurementExtremes>("MeasurementExtremes");
+    qRegisterMetaType<MeasurementBurst>("MeasurementBurst");
 }
 
 DataLogServer::~DataLogServer() {
@@ -70,8 +76,27 @@ QList<QString> DataLogServer::getLocalIPAddress(QAbstractSocket::NetworkLayerPro
 
 void DataLogServer::incomingConnection(qintptr socketDescriptor) {
     EnergyMonitor *em = (EnergyMonitor*)parent();
-    DataLogServerThread *thread = new DataLogServerThread(socketDescriptor, this);
-    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
-    connect(em->powerMeter, SIGNAL(measurementsReady(DecodedMeasurements)), thread, SLOT(slotMeasurementsReady(DecodedMeasurements)));
-    thread->start();
+    /* The client lives on a thread of its own, everything from the power meters is queued to it
+       and commands are queued back to the power meters' */
+    QThread *clientThread = new QThread(this);
+    DataLogServerThread *thread = new DataLogServerThread(socketDescriptor);
+    thread->moveToThread(clientThread);
+    connect(clientThread, SIGNAL(started()), thread, SLOT(run()));
+    connect(thread, SIGNAL(finished()), clientThread, SLOT(quit()));
+    connect(clientThread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+    connect(clientThread, SIGNAL(finished()), clientThread, SLOT(deleteLater()));
+    for(int i = 0; i < em->powerMeters.size(); i++) {
+        connect(em->powerMeters.at(i), SIGNAL(measurementsReady(DecodedMeasurements)), thread, SLOT(slotMeasurementsReady(DecodedMeasurements)), Qt::QueuedConnection);
+        connect(thread, SIGNAL(measurementModeRequested(int)), em->powerMeters.at(i), SLOT(setMeasurementMode(int)), Qt::QueuedConnection);
+        connect(thread, SIGNAL(captureSaveRequested()), em->powerMeters.at(i), SLOT(saveCapture()), Qt::QueuedConnection);
+        connect(em->powerMeters.at(i), SIGNAL(energyTotalsReady(EnergyTotals)), thread, SLOT(slotEnergyTotalsReady(EnergyTotals)), Qt::QueuedConnection);
+        connect(em->minMaxRecorders.at(i), SIGNAL(extremesReady(MeasurementExtremes)), thread, SLOT(slotExtremesReady(MeasurementExtremes)), Qt::QueuedConnection);
+        /* Bursts and EEPROM dumps are asked for by device ID, each only acts on its own */
+        connect(em->burstCaptures.at(i), SIGNAL(burstReady(MeasurementBurst)), thread, SLOT(slotBurstReady(MeasurementBurst)), Qt::QueuedConnection);
+        connect(thread, SIGNAL(burstRequested(int)), em->burstCaptures.at(i), SLOT(triggerDevice(int)), Qt::QueuedConnection);
+        connect(em->eepromJobs.at(i), SIGNAL(dumpReady(QByteArray, int)), thread, SLOT(slotEepromDumpReady(QByteArray, int)), Qt::QueuedConnection);
+        connect(thread, SIGNAL(eepromDumpRequested(int)), em->eepromJobs.at(i), SLOT(dumpDevice(int)), Qt::QueuedConnection);
+    }
+    thread->setDeviceCount(em->powerMeters.size());
+    clientThread->start();
 }
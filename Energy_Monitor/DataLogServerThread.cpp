@@ -41,23 +41,53 @@
  * This option takes a parameter of up to xxxxx in milliseconds
  */
 #define COMMAND_SET_UPDATE_INTERVAL "SET UPD"
+/* Switch the MCP39F511 to fast measurement mode, sub-second response at the cost of more noise.
+ * The mode applies to all clients until the next power cycle, it isn't saved to flash.
+ */
+#define COMMAND_SET_FAST_MODE "SET FST"
+/* Switch the MCP39F511 back to precision measurement mode, each measurement averaged over 2.56 seconds */
+#define COMMAND_CLR_FAST_MODE "CLR FST"
+/* Capture a burst of measurements at the highest rate the MCP39F511 allows, sent to all clients
+ * with send immediate set once complete.  Followed by a space and the device ID to capture from
+ * another MCP39F511 than the first.
+ */
+#define COMMAND_SET_BURST "SET BST"
+/* Send the last burst captured */
+#define COMMAND_GET_BURST "GET BST"
+/* Send the import and export energy totals of each MCP39F511 in kWh and kvarh */
+#define COMMAND_GET_ENERGY "GET NRG"
+/* Read the whole MCP39F511 EEPROM in the background and send it in hex once read, optionally
+ * followed by a space and the device ID of the MCP39F511 */
+#define COMMAND_GET_EEPROM "GET EEP"
+/* Save the serial traffic capture held in RAM to the capture file now, when capturing with -C */
+#define COMMAND_SAVE_CAPTURE "SET CAP"
+/* Send the minimum and maximum of the quantities each MCP39F511 tracks, over its last read interval */
+#define COMMAND_GET_EXTREMES "GET MMX"
 
 #define COMMAND_PROMPT "\r\n# "
 
 DataLogServerThread::DataLogServerThread(qintptr ID, QObject *parent)
-    : QThread(parent) {
+    : QObject(parent) {
     this->socketDescriptor = ID;
     sendImmediate = false;
+    eepromDumpPending = false;
+    eepromDumpDevice = 0;
+    deviceCount = 1;
     updateIntervalMillis = 1000;
 }
 
 DataLogServerThread::~DataLogServerThread() {
 }
 
+void DataLogServerThread::setDeviceCount(int count) {
+    deviceCount = count;
+}
+
 void DataLogServerThread::run() {
     socket = new QTcpSocket;
     if (!socket->setSocketDescriptor(this->socketDescriptor)) {
         emit error(socket->error());
+        emit finished();
         return;
     }
     
@@ -71,13 +101,30 @@ void DataLogServerThread::run() {
     // We'll have multiple clients, we want to know which is which
     qDebug() << "Client " << socketDescriptor << " connected";
     
-    // make this thread a loop,
-    // thread will stay alive so that signal/slot functions properly
-    // and does not drop out when the thread completes
+    // the thread's own event loop keeps running until the client disconnects
     QString ident;
     ident = QString(SOFTWARE_NAME) + QString(" ") + QString(SOFTWARE_VERSION) + QString("\r\n") + "# ";
     socket->write(ident.toLocal8Bit());
-    exec();
+}
+
+/* Reads the device ID that may follow a command after a space, the first MCP39F511 if there isn't one
+ * @return The device ID, or -1 if it isn't one of the MCP39F511 connected
+ */
+int DataLogServerThread::readDeviceId(QByteArray bytes, int &position) {
+    int deviceId = 0;
+    if(bytes.length() - position > 2 && bytes.at(position) == ' ') {
+        // Increment for the space
+        position++;
+        // Get all characters after the command to the end of the string as the device ID
+        QString device = QString(bytes).mid(position, bytes.length() - position - 2);
+        position += device.length();
+        bool valid;
+        deviceId = device.toInt(&valid);
+        if(!valid) {
+            return -1;
+        }
+    }
+    return (deviceId >= 0 && deviceId < deviceCount) ? deviceId : -1;
 }
 
 /* Processes all Telnet data sent from the client.
@@ -152,7 +199,10 @@ void DataLogServerThread::processBytes(QByteArray bytes) {
                      debug << COMMAND_GET_ALL << " received!\r\n";
                      position += COMMAND_LENGTH;
                      // Send the data to the client
-                     socket->write("\r\n" + responseData.toLocal8Bit());
+                     socket->write("\r\n");
+                     for(int i = 0; i < responseData.size(); i++) {
+                         socket->write(responseData.at(i).toLocal8Bit());
+                     }
                 } else
                 // Check if set update interval command is received
                 if(command == COMMAND_SET_UPDATE_INTERVAL) {
@@ -168,6 +218,9 @@ void DataLogServerThread::processBytes(QByteArray bytes) {
                         int millis = updateInterval.toInt();
                         if(millis >= 100 && millis <= 10000) {
                             updateIntervalMillis = millis;
+                            for(int i = 0; i < decimators.size(); i++) {
+                                decimators.at(i)->setInterval(updateIntervalMillis);
+                            }
                             socket->write("Update interval changed to ");
                             socket->write(QString::number(updateIntervalMillis).toLocal8Bit());
                         } else {
@@ -187,6 +240,81 @@ void DataLogServerThread::processBytes(QByteArray bytes) {
                      debug << COMMAND_CLR_SEND_IMMEDIATE << " received!\r\n";
                      position += COMMAND_LENGTH;
                      sendImmediate = false;
+                } else
+                // Check if set fast mode command is received
+                if(command == COMMAND_SET_FAST_MODE) {
+                     debug << COMMAND_SET_FAST_MODE << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     emit measurementModeRequested(MEASUREMENT_MODE_FAST);
+                     socket->write("Fast measurement mode selected");
+                } else
+                // Check if clear fast mode command is received
+                if(command == COMMAND_CLR_FAST_MODE) {
+                     debug << COMMAND_CLR_FAST_MODE << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     emit measurementModeRequested(MEASUREMENT_MODE_PRECISION);
+                     socket->write("Precision measurement mode selected");
+                } else
+                // Check if burst capture command is received
+                if(command == COMMAND_SET_BURST) {
+                     debug << COMMAND_SET_BURST << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     int deviceId = readDeviceId(bytes, position);
+                     if(deviceId < 0) {
+                         socket->write("Unknown MCP39F511 device");
+                     } else {
+                         emit burstRequested(deviceId);
+                         socket->write("Burst capture requested");
+                     }
+                } else
+                // Check if get burst command is received
+                if(command == COMMAND_GET_BURST) {
+                     debug << COMMAND_GET_BURST << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     if(burstData.isEmpty()) {
+                         socket->write("No burst has been captured");
+                     } else {
+                         socket->write("\r\n" + burstData.toLocal8Bit());
+                     }
+                } else
+                // Check if get energy command is received
+                if(command == COMMAND_GET_ENERGY) {
+                     debug << COMMAND_GET_ENERGY << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     socket->write("\r\n");
+                     for(int i = 0; i < energyData.size(); i++) {
+                         socket->write(energyData.at(i).toLocal8Bit());
+                     }
+                } else
+                // Check if get EEPROM command is received
+                if(command == COMMAND_GET_EEPROM) {
+                     debug << COMMAND_GET_EEPROM << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     int deviceId = readDeviceId(bytes, position);
+                     if(deviceId < 0) {
+                         socket->write("Unknown MCP39F511 device");
+                     } else {
+                         eepromDumpPending = true;
+                         eepromDumpDevice = deviceId;
+                         emit eepromDumpRequested(deviceId);
+                         socket->write("EEPROM dump requested");
+                     }
+                } else
+                // Check if save capture command is received
+                if(command == COMMAND_SAVE_CAPTURE) {
+                     debug << COMMAND_SAVE_CAPTURE << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     emit captureSaveRequested();
+                     socket->write("Capture save requested");
+                } else
+                // Check if get extremes command is received
+                if(command == COMMAND_GET_EXTREMES) {
+                     debug << COMMAND_GET_EXTREMES << " received!\r\n";
+                     position += COMMAND_LENGTH;
+                     socket->write("\r\n");
+                     for(int i = 0; i < extremesData.size(); i++) {
+                         socket->write(extremesData.at(i).toLocal8Bit());
+                     }
                 } else {
                     position++;
                 }
@@ -222,30 +350,118 @@ void DataLogServerThread::readyRead() {
 void DataLogServerThread::disconnected() {
     qDebug() << "Client " << socketDescriptor << " Disconnected";
     socket->deleteLater();
-    exit(0);
+    emit finished();
 }
 
 /* Slot is called every time some new measurements are ready
- * This method formats the data ready to be sent over Telnet
+ * They are averaged over the client's update interval, separately for each MCP39F511
  */
 void DataLogServerThread::slotMeasurementsReady(DecodedMeasurements values) {
+    /* Each MCP39F511 gets a decimator of its own the first time it is heard from */
+    while(decimators.size() <= values.deviceId) {
+        MeasurementDecimator *decimator = new MeasurementDecimator(updateIntervalMillis, DECIMATE_AVERAGE, this);
+        connect(decimator, SIGNAL(measurementsReady(DecodedMeasurements)), this, SLOT(slotSendMeasurements(DecodedMeasurements)));
+        decimators.append(decimator);
+    }
+    decimators.at(values.deviceId)->slotMeasurementsReady(values);
+}
+
+/* Slot is called once per update interval
+ * This method formats the data ready to be sent over Telnet
+ */
+void DataLogServerThread::slotSendMeasurements(DecodedMeasurements values) {
     QString format = QString("yyyy-MM-dd hh:mm:ss.zzz");
-    //qint64 currentTimeInt = QDateTime::currentMSecsSinceEpoch();
-    //QString currentTimeString = QString::number(currentTimeInt);
-    QString currentTimeString = QDateTime::currentDateTime().toString(format);
-    responseData = 
-            currentTimeString + ","
-            + QString::number(values.powerActive) + ","
-            + QString::number(values.voltageRms) + ","
-            + QString::number(values.currentRms) + ","
-            + QString::number(values.frequency) + ","
-            + QString::number(values.powerFactor) + ","
-            + QString::number(values.powerApparent) + ","
-            + QString::number(values.powerReactive)
+    /* Time the measurement was read, the same time it is logged with */
+    QString timeString = QDateTime::fromMSecsSinceEpoch(values.timeStamp).toString(format);
+    QString response = 
+            timeString + ","
+            + MCP39F511Interface::formatMeasurements(values) + ","
+            + QString::number(values.sequence) + ","
+            + QString("0x%1").arg(values.systemStatus, 4, 16, QChar('0')) + ","
+            + QString::number(values.deviceId)
             + "\r\n";
+    if(responseData.size() <= values.deviceId) {
+        responseData.resize(values.deviceId + 1);
+    }
+    responseData[values.deviceId] = response;
     
     /* If sendImmediate has been activated, send the data straight out to the client */
     if(sendImmediate) {
-        socket->write(responseData.toLocal8Bit());
+        socket->write(response.toLocal8Bit());
+    }
+}
+/* Slot is called once a burst has been captured
+ * The whole burst is formatted as one block, one line per sample with the time in milliseconds
+ * from the start of the burst and the system status.
+ */
+void DataLogServerThread::slotBurstReady(const MeasurementBurst &burst) {
+    QString format = QString("yyyy-MM-dd hh:mm:ss.zzz");
+    burstData = "BURST," + burst.start.toString(format) + ","
+            + QString::number(burst.samples.size()) + ","
+            + QString::number(burst.accumulationPeriod) + ","
+            + QString::number(burst.deviceId) + "\r\n";
+    for(int i = 0; i < burst.samples.size(); i++) {
+        const BurstSample &sample = burst.samples.at(i);
+        burstData +=
+                QString::number(sample.time / (double)1000, 'f', 3) + ","
+                + MCP39F511Interface::formatMeasurements(sample.values) + ","
+                + QString("0x%1").arg(sample.systemStatus, 4, 16, QChar('0'))
+                + "\r\n";
+    }
+    burstData += "END\r\n";
+    
+    if(sendImmediate) {
+        socket->write(burstData.toLocal8Bit());
+    }
+}
+
+/* Slot is called each time the energy counters have been read
+ * The totals are only sent when asked for, so clients reading measurements aren't sent other lines
+ */
+void DataLogServerThread::slotEnergyTotalsReady(EnergyTotals energy) {
+    QString format = QString("yyyy-MM-dd hh:mm:ss.zzz");
+    if(energyData.size() <= energy.deviceId) {
+        energyData.resize(energy.deviceId + 1);
     }
-}
\ No newline at end of file
+    energyData[energy.deviceId] = "ENERGY,"
+            + QDateTime::fromMSecsSinceEpoch(energy.timeStamp).toString(format) + ","
+            + MCP39F511Interface::formatEnergyTotals(energy) + ","
+            + QString::number(energy.deviceId)
+            + "\r\n";
+}
+
+/* Slot is called each time the min / max records have been read, only sent when asked for
+ */
+void DataLogServerThread::slotExtremesReady(MeasurementExtremes extremes) {
+    QString format = QString("yyyy-MM-dd hh:mm:ss.zzz");
+    if(extremesData.size() <= extremes.deviceId) {
+        extremesData.resize(extremes.deviceId + 1);
+    }
+    extremesData[extremes.deviceId] = "EXTREMES,"
+            + QDateTime::fromMSecsSinceEpoch(extremes.timeStamp).toString(format) + ","
+            + MCP39F511MinMaxRecorder::formatExtremes(extremes) + ","
+            + QString::number(extremes.deviceId)
+            + "\r\n";
+}
+
+/* Slot is called when an EEPROM dump asked for by any client completes
+ * Sent as one line per page, the page number then its bytes in hex
+ */
+void DataLogServerThread::slotEepromDumpReady(QByteArray image, int deviceId) {
+    if(!eepromDumpPending || deviceId != eepromDumpDevice) {
+        return;
+    }
+    eepromDumpPending = false;
+    if(image.isEmpty()) {
+        socket->write("\r\nEEPROM dump failed\r\n");
+        return;
+    }
+    QString dump = "\r\nEEPROM," + QString::number(MCP_EEPROM_PAGE_COUNT) + "," + QString::number(MCP_EEPROM_PAGE_SIZE) + "," + QString::number(deviceId) + "\r\n";
+    for(int page = 0; page < MCP_EEPROM_PAGE_COUNT; page++) {
+        dump += QString("%1,").arg(page, 2, 10, QChar('0'))
+                + QString(image.mid(page * MCP_EEPROM_PAGE_SIZE, MCP_EEPROM_PAGE_SIZE).toHex().toUpper())
+                + "\r\n";
+    }
+    dump += "END\r\n";
+    socket->write(dump.toLocal8Bit());
+}
@@ -28,36 +28,95 @@
 #ifndef DATALOGSERVERTHREAD_H
 #define DATALOGSERVERTHREAD_H
 
+#include "MCP39F511BurstCapture.h"
 #include "MCP39F511Interface.h"
+#include "MCP39F511MinMaxRecorder.h"
+#include "MeasurementDecimator.h"
 
-#include <QThread>
+#include <QObject>
 #include <QTcpSocket>
 #include <QDebug>
 #include <QByteArray>
+#include <QVector>
 
 
-class DataLogServerThread : public QThread {
+/**
+ * Serves one Telnet client.  Moved to a thread of its own before it is started, so the commands,
+ * the measurements passed on and everything kept for the client are all handled on that thread.
+ */
+class DataLogServerThread : public QObject {
     Q_OBJECT
 public:
     explicit DataLogServerThread(qintptr ID, QObject *parent = 0);
     virtual ~DataLogServerThread();
-    void run();
+    /**
+     * @param count MCP39F511 connected, a command may pick any device ID below this
+     */
+    void setDeviceCount(int count);
     
 signals:
     void error(QTcpSocket::SocketError socketError);
+    /**
+     * Emitted once the client has gone, the thread can be stopped
+     */
+    void finished();
+    /**
+     * Emitted when the client asks for a different measurement mode
+     * @param mode measurement_mode requested
+     */
+    void measurementModeRequested(int mode);
+    /**
+     * Emitted when the client asks for a burst to be captured
+     * @param deviceId MCP39F511 to capture from
+     */
+    void burstRequested(int deviceId);
+    /**
+     * Emitted when the client asks for a dump of an MCP39F511 EEPROM
+     * @param deviceId MCP39F511 to dump
+     */
+    void eepromDumpRequested(int deviceId);
+    /**
+     * Emitted when the client asks for the serial traffic capture to be saved
+     */
+    void captureSaveRequested();
 
 public slots:
+    /**
+     * Connected to the started signal of the thread it has been moved to
+     */
+    void run();
     void readyRead();
     void disconnected();
     void slotMeasurementsReady(DecodedMeasurements);
+    void slotBurstReady(const MeasurementBurst &burst);
+    void slotEnergyTotalsReady(EnergyTotals energy);
+    void slotExtremesReady(MeasurementExtremes extremes);
+    void slotEepromDumpReady(QByteArray image, int deviceId);
+
+private slots:
+    void slotSendMeasurements(DecodedMeasurements);
 
 private:
     QTcpSocket *socket;
     int socketDescriptor;
     void processBytes(QByteArray bytes);
-    QString responseData;
+    int readDeviceId(QByteArray bytes, int &position);
+    /* Latest measurements formatted ready to send, indexed by MCP39F511 device ID */
+    QVector<QString> responseData;
+    /* Latest energy totals formatted ready to send, indexed by MCP39F511 device ID */
+    QVector<QString> energyData;
+    /* Latest hardware tracked extremes formatted ready to send, indexed by MCP39F511 device ID */
+    QVector<QString> extremesData;
+    /* The last burst captured, formatted ready to send */
+    QString burstData;
     bool sendImmediate;
+    /* The client asked for an EEPROM dump that hasn't been sent yet */
+    bool eepromDumpPending;
+    int eepromDumpDevice;
+    int deviceCount;
     int updateIntervalMillis;
+    /* Measurements from each MCP39F511 are passed on to the client at its update interval */
+    QVector<MeasurementDecimator *> decimators;
 };
 
 #endif /* DATALOGSERVERTHREAD_H */
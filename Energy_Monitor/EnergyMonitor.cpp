@@ -34,16 +34,19 @@
 #include <QPalette>
 #include <QString>
 #include <QDebug>
+#include <QFile>
 #include <QTimer>
 
 EnergyMonitor::EnergyMonitor(QWidget *parent) {
     setParent(parent);
+    startupTimer.start();
+    firstSampleDisplayed = false;
     /* Pass the command line parameters */
     QCommandLineParser commandLineParser;
     commandLineParser.setApplicationDescription(QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, SOFTWARE_NAME));
     commandLineParser.addHelpOption();
     commandLineParser.addVersionOption();
-    QCommandLineOption initiateCalibrationOption("c", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Initiate calibration procedure using a calibrated reference Tektronix PA1000 at <IP address>."), QCoreApplication::translate("c", "IP address"));
+    QCommandLineOption initiateCalibrationOption("c", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Initiate calibration procedure using a calibrated reference Tektronix PA1000 at <IP address>, on MCP39F511 <device> if given, otherwise the first."), QCoreApplication::translate("c", "IP address[,device]"));
     commandLineParser.addOption(initiateCalibrationOption);
     
 /*    QCommandLineOption initiateReactiveCalibrationOption("z", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Initiate calibration procedure including reactive calibration using a calibrated reference Tektronix PA1000 at <IP address>."), QCoreApplication::translate("c", "IP address"));
@@ -52,21 +55,193 @@ EnergyMonitor::EnergyMonitor(QWidget *parent) {
     QCommandLineOption factoryResetMcp39F511("r", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Reset MCP39F511 to factory settings."));
     commandLineParser.addOption(factoryResetMcp39F511);
     
+    QCommandLineOption interByteGapOption("g", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Gap in milliseconds between bytes sent to the MCP39F511 (default 2, 0 sends each frame in one write)."), QCoreApplication::translate("g", "milliseconds"));
+    commandLineParser.addOption(interByteGapOption);
+    
+    QCommandLineOption pipelineOption("P", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Pipeline register reads and writes to the MCP39F511."));
+    commandLineParser.addOption(pipelineOption);
+    
+    QCommandLineOption simulatorOption("s", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Connect to an MCP39F511 simulator on <device> instead of the serial port."), QCoreApplication::translate("s", "device"));
+    commandLineParser.addOption(simulatorOption);
+    
+    QCommandLineOption faultBenchmarkOption("b", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Benchmark recovery from injected serial link faults then exit."));
+    commandLineParser.addOption(faultBenchmarkOption);
+    
+    QCommandLineOption captureOption("C", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Capture the serial traffic to and from the MCP39F511 and save it to <file> on exit."), QCoreApplication::translate("C", "file"));
+    commandLineParser.addOption(captureOption);
+    
+    QCommandLineOption replayOption("R", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Benchmark measurement decoding by replaying a serial traffic capture from <file> then exit."), QCoreApplication::translate("R", "file"));
+    commandLineParser.addOption(replayOption);
+    
+    QCommandLineOption acquisitionRateOption("a", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Acquire up to <rate> measurements per second by shortening the MCP39F511 accumulation interval."), QCoreApplication::translate("a", "rate"));
+    commandLineParser.addOption(acquisitionRateOption);
+    
+    QCommandLineOption measurementModeOption("m", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Switch to <mode> measurement, fast for sub-second response or precision for 2.56 s averaging.  Kept over a power cycle."), QCoreApplication::translate("m", "mode"));
+    commandLineParser.addOption(measurementModeOption);
+    
+    QCommandLineOption burstThresholdOption("i", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Capture a burst of measurements at the highest rate when the current rises above <amps>."), QCoreApplication::translate("i", "amps"));
+    commandLineParser.addOption(burstThresholdOption);
+    
+    QCommandLineOption burstEventOption("E", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Capture a burst of measurements at the highest rate when the MCP39F511 flags an over current, over power, sag or surge event."));
+    commandLineParser.addOption(burstEventOption);
+    
+    QCommandLineOption filterBenchmarkOption("f", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Benchmark the measurement filters then exit."));
+    commandLineParser.addOption(filterBenchmarkOption);
+    
+    QCommandLineOption deviceOption("d", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Add another MCP39F511 on serial <device>, with its reset line on wiringPi pin <gpio> if given.  May be repeated."), QCoreApplication::translate("d", "device[:gpio]"));
+    commandLineParser.addOption(deviceOption);
+    
+    QCommandLineOption displayDeviceOption("l", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Show MCP39F511 <device> on the LCD instead of the first."), QCoreApplication::translate("l", "device"));
+    commandLineParser.addOption(displayDeviceOption);
+    
+    QCommandLineOption scalingBenchmarkOption("B", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Benchmark reading all MCP39F511 at once then exit."));
+    commandLineParser.addOption(scalingBenchmarkOption);
+    
+    QCommandLineOption eepromDumpOption("D", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Dump the MCP39F511 EEPROM to <file> then exit."), QCoreApplication::translate("D", "file"));
+    commandLineParser.addOption(eepromDumpOption);
+    
+    QCommandLineOption eepromRestoreOption("W", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Write the MCP39F511 EEPROM from a dump in <file>, verify it then exit."), QCoreApplication::translate("W", "file"));
+    commandLineParser.addOption(eepromRestoreOption);
+    
+    QCommandLineOption extremesOption("x", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Have the MCP39F511 track the minimum and maximum of up to two quantities, from voltage, frequency, current, power, reactive and apparent.  Current and power by default."), QCoreApplication::translate("x", "quantity[,quantity]"));
+    commandLineParser.addOption(extremesOption);
+    
     QCommandLineOption softwareUpdateComplete("u", QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Used after self updater installed new software so correct message is displayed on screen."));
     commandLineParser.addOption(softwareUpdateComplete);
 
     commandLineParser.process(*QApplication::instance());
     
     
-	/* Create and initialise the power meter */
+	/* Create and initialise the power meter.  Initialisation returns while the MCP39F511 is still
+	   held in reset so the rest of start up overlaps with it. */
 	powerMeter = new MCP39F511Interface(this);
+    powerMeters.append(powerMeter);
+    devicesInitialised = 0;
     connect(powerMeter, SIGNAL(initialisationComplete()), this, SLOT(initialisationComplete()));
-    connect(powerMeter, SIGNAL(measurementsReady(DecodedMeasurements)), this, SLOT(processMeasurements(DecodedMeasurements)));
+    connect(powerMeter, SIGNAL(initialisationComplete()), this, SLOT(slotDeviceInitialised()));
+    /* Spikes are only taken out of what is displayed, the log keeps what was measured.
+       The display refreshes at its own rate however fast measurements are acquired. */
+    displayFilter = new MeasurementFilter(this);
+    FilterConfig spikeFilter = {FILTER_MEDIAN, DISPLAY_MEDIAN_WINDOW, 1, 0, 0};
+    displayFilter->setFilter(MEASUREMENT_CURRENT_RMS, spikeFilter);
+    displayFilter->setFilter(MEASUREMENT_POWER_ACTIVE, spikeFilter);
+    displayFilter->setFilter(MEASUREMENT_POWER_REACTIVE, spikeFilter);
+    displayFilter->setFilter(MEASUREMENT_POWER_APPARENT, spikeFilter);
+    displayDecimator = new MeasurementDecimator(DISPLAY_UPDATE_INTERVAL, DECIMATE_AVERAGE, this);
+    connect(displayFilter, SIGNAL(measurementsReady(DecodedMeasurements)), displayDecimator, SLOT(slotMeasurementsReady(DecodedMeasurements)));
+    connect(displayDecimator, SIGNAL(measurementsReady(DecodedMeasurements)), this, SLOT(processMeasurements(DecodedMeasurements)));
+    if(commandLineParser.isSet(interByteGapOption)) {
+        powerMeter->setInterByteGap(commandLineParser.value(interByteGapOption).toInt());
+    }
+    powerMeter->setPipelined(commandLineParser.isSet(pipelineOption));
+    if(commandLineParser.isSet(simulatorOption)) {
+        powerMeter->setSerialDevice(commandLineParser.value(simulatorOption), GPIO_NONE);
+    }
+    if(commandLineParser.isSet(filterBenchmarkOption)) {
+        MeasurementFilter::benchmark(FILTER_BENCHMARK_SAMPLES);
+        QTimer::singleShot(0, QApplication::instance(), SLOT(quit()));
+    }
+    optionFaultBenchmark = commandLineParser.isSet(faultBenchmarkOption);
+    powerMeter->setFaultInjection(optionFaultBenchmark);
+    faultBenchmark = NULL;
+    if(commandLineParser.isSet(captureOption)) {
+        powerMeter->setCaptureFile(commandLineParser.value(captureOption));
+    }
+    optionReplayBenchmark = commandLineParser.isSet(replayOption);
+    if(optionReplayBenchmark) {
+        powerMeter->setReplayFile(commandLineParser.value(replayOption));
+    }
+    replayBenchmark = NULL;
+    acquisitionRate = 0;
+    optionMeasurementMode = -1;
+    if(commandLineParser.isSet(measurementModeOption)) {
+        QString mode = commandLineParser.value(measurementModeOption);
+        if(mode == "fast") {
+            optionMeasurementMode = MEASUREMENT_MODE_FAST;
+        } else if(mode == "precision") {
+            optionMeasurementMode = MEASUREMENT_MODE_PRECISION;
+        } else {
+            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Unknown measurement mode, use fast or precision.");
+        }
+    }
+    if(commandLineParser.isSet(acquisitionRateOption)) {
+        acquisitionRate = commandLineParser.value(acquisitionRateOption).toDouble();
+    }
+    burstCurrentThreshold = 0;
+    if(commandLineParser.isSet(burstThresholdOption)) {
+        burstCurrentThreshold = commandLineParser.value(burstThresholdOption).toDouble();
+    }
+    optionBurstEvents = commandLineParser.isSet(burstEventOption);
+    eepromDumpFile = commandLineParser.value(eepromDumpOption);
+    eepromRestoreFile = commandLineParser.value(eepromRestoreOption);
 	powerMeter->initialise();
     
-    /* Create and initialise the data logger */
+    /* Any further MCP39F511 each have their own serial port, comms thread, register cache,
+       filters and calibration, and are acquired independently of each other */
+    optionScalingBenchmark = commandLineParser.isSet(scalingBenchmarkOption);
+    scalingBenchmark = NULL;
+    QStringList extraDevices = commandLineParser.values(deviceOption);
+    for(int i = 0; i < extraDevices.size(); i++) {
+        QStringList deviceParameters = extraDevices.at(i).split(':');
+        MCP39F511Interface *meter = new MCP39F511Interface(this);
+        meter->setDeviceId(i + 1);
+        meter->setSerialDevice(deviceParameters.at(0), deviceParameters.size() > 1 ? deviceParameters.at(1).toInt() : GPIO_NONE);
+        if(commandLineParser.isSet(interByteGapOption)) {
+            meter->setInterByteGap(commandLineParser.value(interByteGapOption).toInt());
+        }
+        meter->setPipelined(commandLineParser.isSet(pipelineOption));
+        connect(meter, SIGNAL(initialisationComplete()), this, SLOT(slotDeviceInitialised()));
+        powerMeters.append(meter);
+        meter->initialise();
+    }
+    
+    /* The LCD shows one MCP39F511, the first unless another is picked */
+    int displayDevice = commandLineParser.value(displayDeviceOption).toInt();
+    if(displayDevice < 0 || displayDevice >= powerMeters.size()) {
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Unknown MCP39F511 to display, showing the first:") << displayDevice;
+        displayDevice = 0;
+    }
+    connect(powerMeters.at(displayDevice), SIGNAL(measurementsReady(DecodedMeasurements)), displayFilter, SLOT(slotMeasurementsReady(DecodedMeasurements)));
+    connect(powerMeters.at(displayDevice), SIGNAL(energyTotalsReady(EnergyTotals)), this, SLOT(processEnergyTotals(EnergyTotals)));
+    
+    /* Energy totals are kept over restarts in each MCP39F511's own EEPROM */
+    for(int i = 0; i < powerMeters.size(); i++) {
+        energyCheckpoints.append(new MCP39F511EnergyCheckpoint(powerMeters.at(i), this));
+    }
+    
+    /* Each MCP39F511 captures its own inrush and other transients, triggered once its acquisition
+       has started, and has its own EEPROM dumped and restored */
+    for(int i = 0; i < powerMeters.size(); i++) {
+        burstCaptures.append(new MCP39F511BurstCapture(powerMeters.at(i), this));
+        eepromJobs.append(new MCP39F511EepromJob(powerMeters.at(i), this));
+        /* Checkpoints wait for a dump or restore so it sees, and leaves, the EEPROM as it was */
+        connect(eepromJobs.at(i), SIGNAL(started()), energyCheckpoints.at(i), SLOT(pause()));
+        connect(eepromJobs.at(i), SIGNAL(finished(bool)), energyCheckpoints.at(i), SLOT(resume()));
+    }
+    
+    /* Peaks between measurement reads are caught by the MCP39F511 itself, read once acquisition has started */
+    QStringList trackedQuantities = commandLineParser.value(extremesOption).split(',', QString::SkipEmptyParts);
+    for(int i = 0; i < powerMeters.size(); i++) {
+        MCP39F511MinMaxRecorder *recorder = new MCP39F511MinMaxRecorder(powerMeters.at(i), this);
+        for(int record = 0; record < trackedQuantities.size() && record < MCP_MINMAX_RECORDS; record++) {
+            if(!recorder->setTrackedQuantity(record, MCP39F511MinMaxRecorder::channelFromName(trackedQuantities.at(record)))) {
+                qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Unknown quantity to track, use voltage, frequency, current, power, reactive or apparent:") << trackedQuantities.at(record);
+            }
+        }
+        minMaxRecorders.append(recorder);
+    }
+    
+    /* Create and initialise the data logger, measurements from each MCP39F511 are averaged separately */
     dataLogger = new DataLog(this);
-    connect(powerMeter, SIGNAL(measurementsReady(DecodedMeasurements)), dataLogger, SLOT(slotMeasurementsReady(DecodedMeasurements)));
+    for(int i = 0; i < powerMeters.size(); i++) {
+        MeasurementDecimator *logDecimator = new MeasurementDecimator(DATA_LOG_INTERVAL, DECIMATE_AVERAGE, this);
+        connect(powerMeters.at(i), SIGNAL(measurementsReady(DecodedMeasurements)), logDecimator, SLOT(slotMeasurementsReady(DecodedMeasurements)));
+        connect(logDecimator, SIGNAL(measurementsReady(DecodedMeasurements)), dataLogger, SLOT(slotMeasurementsReady(DecodedMeasurements)));
+        logDecimators.append(logDecimator);
+        connect(powerMeters.at(i), SIGNAL(energyTotalsReady(EnergyTotals)), dataLogger, SLOT(slotEnergyTotalsReady(EnergyTotals)));
+        connect(minMaxRecorders.at(i), SIGNAL(extremesReady(MeasurementExtremes)), dataLogger, SLOT(slotExtremesReady(MeasurementExtremes)));
+        connect(burstCaptures.at(i), SIGNAL(burstReady(MeasurementBurst)), dataLogger, SLOT(slotBurstReady(MeasurementBurst)));
+    }
     connect(dataLogger, SIGNAL(sigLoggingStarted()), this, SLOT(loggingStarted()));
     connect(dataLogger, SIGNAL(sigLoggingStopped()), this, SLOT(loggingStopped()));
     
@@ -99,9 +274,19 @@ EnergyMonitor::EnergyMonitor(QWidget *parent) {
     /* Start the calibration routine if the command line switch is set */
     optionCalibrate = false;
     optionReactiveCalibrate = false;
+    calibrationDevice = 0;
+    calibrationMeter = NULL;
 	if(commandLineParser.isSet(initiateCalibrationOption)) {
-        pa1000IpAddress = commandLineParser.value(initiateCalibrationOption);
-        optionCalibrate = true;
+        QStringList calibrationParameters = commandLineParser.value(initiateCalibrationOption).split(',');
+        pa1000IpAddress = calibrationParameters.at(0);
+        if(calibrationParameters.size() > 1) {
+            calibrationDevice = calibrationParameters.at(1).toInt();
+        }
+        if(calibrationDevice >= 0 && calibrationDevice < powerMeters.size()) {
+            optionCalibrate = true;
+        } else {
+            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Unknown MCP39F511 to calibrate:") << calibrationDevice;
+        }
     } /* else
 	if(commandLineParser.isSet(initiateReactiveCalibrationOption)) {
         pa1000IpAddress = commandLineParser.value(initiateReactiveCalibrationOption);
@@ -139,21 +324,46 @@ EnergyMonitor::~EnergyMonitor() {
 void EnergyMonitor::initialisationComplete() {
     qDebug("MCP39F511 system version: 0x%x", powerMeter->mcpOutputReg.system_version);
     qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "MCP39F511 initialisation complete.");
-    if(optionFactoryReset) {
+    if(optionFaultBenchmark) {
+        optionFaultBenchmark = false;
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Starting serial link fault benchmark...");
+        faultBenchmark = new MCP39F511FaultBenchmark(powerMeter, this);
+        connect(faultBenchmark, SIGNAL(finished()), QApplication::instance(), SLOT(quit()));
+        faultBenchmark->start();
+    } else if(optionReplayBenchmark) {
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Starting serial capture replay benchmark...");
+        replayBenchmark = new MCP39F511ReplayBenchmark(powerMeter, this);
+        connect(replayBenchmark, SIGNAL(finished()), QApplication::instance(), SLOT(quit()));
+        replayBenchmark->start();
+    } else if(optionScalingBenchmark) {
+        /* Started by slotDeviceInitialised() once every MCP39F511 is ready */
+    } else if(!eepromDumpFile.isEmpty()) {
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Dumping MCP39F511 EEPROM to") << eepromDumpFile;
+        connect(eepromJobs.at(0), SIGNAL(progress(int, int)), this, SLOT(slotEepromJobProgress(int, int)));
+        connect(eepromJobs.at(0), SIGNAL(dumpReady(QByteArray, int)), this, SLOT(slotEepromDumpReady(QByteArray)));
+        eepromJobs.at(0)->dump();
+    } else if(!eepromRestoreFile.isEmpty()) {
+        QFile file(eepromRestoreFile);
+        if(file.open(QIODevice::ReadOnly)) {
+            eepromImage = file.readAll();
+            file.close();
+        }
+        if(eepromImage.size() != MCP_EEPROM_SIZE) {
+            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "EEPROM dump must be %1 bytes:").arg(MCP_EEPROM_SIZE) << eepromRestoreFile;
+            QApplication::exit(1);
+            return;
+        }
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Writing MCP39F511 EEPROM from") << eepromRestoreFile;
+        connect(eepromJobs.at(0), SIGNAL(progress(int, int)), this, SLOT(slotEepromJobProgress(int, int)));
+        connect(eepromJobs.at(0), SIGNAL(finished(bool)), this, SLOT(slotEepromRestoreFinished(bool)));
+        eepromJobs.at(0)->startWrite((const u_int8_t *)eepromImage.constData());
+    } else if(optionFactoryReset) {
         optionFactoryReset = false;
         qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Applying factory reset of MCP39F511...");
         connect(powerMeter, SIGNAL(factoryResetComplete(int)), this, SLOT(slotFactoryResetComplete(int)));
         powerMeter->factoryResetMcp39F511();
     } else {
-        if(optionCalibrate) {
-            optionCalibrate = false;
-            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Starting MCP39F511 calibration routine (no reactive power calibration)...");
-            startCalibration(pa1000IpAddress, false);
-        } else if(optionReactiveCalibrate) {
-            optionReactiveCalibrate = false;
-            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Starting MCP39F511 calibration routine (with reactive power calibration)...");
-            startCalibration(pa1000IpAddress, true);
-        }
+        startDevice(powerMeter);
     }
 }
 
@@ -193,14 +403,75 @@ void EnergyMonitor::displayIPAddress() {
     QTimer::singleShot(IP_ADDRESS_CHECK_INTERVAL, this, SLOT(displayIPAddress()));
 }
 
+/**
+ * Called as each MCP39F511 completes initialisation, the first is also handled by initialisationComplete().
+ */
+void EnergyMonitor::slotDeviceInitialised() {
+    MCP39F511Interface *meter = (MCP39F511Interface *)sender();
+    devicesInitialised++;
+    if(optionScalingBenchmark) {
+        if(devicesInitialised == powerMeters.size()) {
+            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Starting multiple MCP39F511 scaling benchmark...");
+            scalingBenchmark = new MCP39F511ScalingBenchmark(powerMeters, this);
+            connect(scalingBenchmark, SIGNAL(finished()), QApplication::instance(), SLOT(quit()));
+            scalingBenchmark->start();
+        }
+        return;
+    }
+    if(meter == powerMeter) {
+        return;
+    }
+    qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "MCP39F511 %1 initialisation complete.").arg(meter->getDeviceId());
+    /* The others are measured the same way as the first */
+    startDevice(meter);
+}
+
+/**
+ * Starts acquisition, min / max recording and burst triggers on an MCP39F511.
+ * The MCP39F511 being calibrated is left alone until calibration is complete, anything else
+ * changing its accumulation interval or writing its registers would spoil the calibration.
+ */
+void EnergyMonitor::startDevice(MCP39F511Interface *meter) {
+    int deviceId = meter->getDeviceId();
+    if((optionCalibrate || optionReactiveCalibrate) && calibrationDevice == deviceId) {
+        bool reactiveCal = optionReactiveCalibrate;
+        optionCalibrate = false;
+        optionReactiveCalibrate = false;
+        calibrationMeter = meter;
+        if(reactiveCal) {
+            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Starting MCP39F511 %1 calibration routine (with reactive power calibration)...").arg(deviceId);
+        } else {
+            qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Starting MCP39F511 %1 calibration routine (no reactive power calibration)...").arg(deviceId);
+        }
+        startCalibration(meter, pa1000IpAddress, reactiveCal);
+        return;
+    }
+    /* Read each new measurement as soon as the MCP39F511 has accumulated it */
+    if(optionMeasurementMode >= 0) {
+        meter->setMeasurementMode(optionMeasurementMode, true);
+    }
+    if(acquisitionRate > 0) {
+        meter->setAcquisitionRate(acquisitionRate);
+    }
+    meter->startAcquisition();
+    minMaxRecorders.at(deviceId)->start();
+    burstCaptures.at(deviceId)->setCurrentThreshold(burstCurrentThreshold);
+    if(optionBurstEvents) {
+        burstCaptures.at(deviceId)->setEventMask(MCP_BURST_EVENT_MASK);
+    }
+}
+
 /**
  * Gets called when ctl-c is pressed on console
  */
 void EnergyMonitor::aboutToQuit() {
     /* Shutdown the power meter */
     shuttingDown = true;
-	powerMeter->close();
-	powerMeter->deleteLater();
+    for(int i = 0; i < powerMeters.size(); i++) {
+        minMaxRecorders.at(i)->stop();
+        powerMeters.at(i)->close();
+        powerMeters.at(i)->deleteLater();
+    }
     
     dataLogger->stopLogging();
     dataLogger->deleteLater();
@@ -327,16 +598,28 @@ void EnergyMonitor::processMeasurements(DecodedMeasurements energyValues){
         labelContents[POWER_REACTIVE].setFont(font);*/
         labelContents[POWER_APPARENT].setText("Apparent Pwr\r\n" + QString::number(energyValues.powerApparent, 'f', 2) + " W");
         labelContents[POWER_APPARENT].setFont(font);
-
-        /*if(!optionCalibrate) {*/
-            /* Instigate the next set of after a delay */
-            QTimer::singleShot(DISPLAY_UPDATE_INTERVAL, this, SLOT(startMeasurements()));
-        /*}*/
+        
+        if(!firstSampleDisplayed) {
+            firstSampleDisplayed = true;
+            qDebug("First sample displayed %lld ms after start up.", startupTimer.elapsed());
+        }
     }
 };
 
-void EnergyMonitor::startMeasurements() {
-    powerMeter->getOutputRegisters();
+/* Reactive energy isn't displayed for the same reason as reactive power */
+void EnergyMonitor::processEnergyTotals(EnergyTotals energy) {
+    if(!shuttingDown) {
+        QFont font;
+        if(energy.exportActive > 0) {
+            font.setPointSize(10);
+            labelContents[ENERGY].setText("Import " + QString::number(energy.importActive, 'f', 3) + " kWh\r\n"
+                                          + "Export " + QString::number(energy.exportActive, 'f', 3) + " kWh");
+        } else {
+            font.setPointSize(12);
+            labelContents[ENERGY].setText("Energy\r\n" + QString::number(energy.importActive, 'f', 3) + " kWh");
+        }
+        labelContents[ENERGY].setFont(font);
+    }
 }
 
 void EnergyMonitor::buttonPressed(ButtonState *button) {
@@ -398,8 +681,8 @@ void EnergyMonitor::buttonPressed(ButtonState *button) {
 	}
 }
 
-void EnergyMonitor::startCalibration(QString pa1000IpAddress, bool reactiveCal) {
-	powerCalibration = new MCP39F511Calibration(this, powerMeter);
+void EnergyMonitor::startCalibration(MCP39F511Interface *meter, QString pa1000IpAddress, bool reactiveCal) {
+	powerCalibration = new MCP39F511Calibration(this, meter);
 	connect(powerCalibration, SIGNAL(calibrationComplete(bool)), this, SLOT(slotCalibrationComplete(bool)));
 	powerCalibration->startCalibration(pa1000IpAddress, reactiveCal);
 }
@@ -412,8 +695,11 @@ void EnergyMonitor::cancelCalibration() {
 
 void EnergyMonitor::slotCalibrationComplete(bool success) {
     optionCalibrate = false;
-    /* Instigate the next set of after a delay */
-    QTimer::singleShot(DISPLAY_UPDATE_INTERVAL, this, SLOT(startMeasurements()));
+    /* Measuring was held off while it was calibrated */
+    if(calibrationMeter != NULL) {
+        startDevice(calibrationMeter);
+        calibrationMeter = NULL;
+    }
 }
 
 /**
@@ -424,6 +710,35 @@ void EnergyMonitor::slotFactoryResetComplete(int transactionId) {
     disconnect(powerMeter, SIGNAL(factoryResetComplete(int)), this, SLOT(slotFactoryResetComplete(int)));
 }
 
+void EnergyMonitor::slotEepromJobProgress(int pagesDone, int pagesTotal) {
+    qDebug("EEPROM %d of %d pages", pagesDone, pagesTotal);
+}
+
+void EnergyMonitor::slotEepromDumpReady(QByteArray image) {
+    QFile file(eepromDumpFile);
+    if(image.isEmpty()) {
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "MCP39F511 EEPROM could not be read.");
+        QApplication::exit(1);
+    } else if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(image) != image.size()) {
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "Unable to write the EEPROM dump to") << eepromDumpFile;
+        QApplication::exit(1);
+    } else {
+        file.close();
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "MCP39F511 EEPROM dumped to") << eepromDumpFile;
+        QApplication::exit(0);
+    }
+}
+
+void EnergyMonitor::slotEepromRestoreFinished(bool success) {
+    if(success) {
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "MCP39F511 EEPROM written and verified.");
+        QApplication::exit(0);
+    } else {
+        qDebug() << QCoreApplication::translate(TRANSLATE_CONTEXT_MAIN, "MCP39F511 EEPROM could not be written, it may hold part of the dump.");
+        QApplication::exit(1);
+    }
+}
+
 void EnergyMonitor::slotSoftwareAvailableUSB(QFileInfoList fileList) {
     updaterFileList = fileList;
     QStringList list;
@@ -27,13 +27,18 @@
 #ifndef ENERGYMONITOR_H
 #define ENERGYMONITOR_H
 
-/* Display and log update interval in milliseconds.  The minimum this can be is 200 ms */
+/* Display update interval in milliseconds, the measurements acquired in between are averaged */
 #define DISPLAY_UPDATE_INTERVAL 1000
+/* Measurements the median is taken over before display, rejects single measurement spikes at fast acquisition rates */
+#define DISPLAY_MEDIAN_WINDOW 3
+/* Samples filtered with each filter type by the filter benchmark */
+#define FILTER_BENCHMARK_SAMPLES 1000000
 #define DISPLAY_INITIALISING 2000
 
 /* Check interval to update the IP address screen */
 #define IP_ADDRESS_CHECK_INTERVAL 1000
 
+#include <QElapsedTimer>
 #include <QFont>
 #include <QGridLayout>
 #include <QLabel>
@@ -44,8 +49,17 @@
 #include <QWidget>
 
 #include "MCP39F511Interface.h"
+#include "MCP39F511BurstCapture.h"
 #include "InputControl.h"
 #include "MCP39F511Calibration.h"
+#include "MCP39F511EepromJob.h"
+#include "MCP39F511EnergyCheckpoint.h"
+#include "MCP39F511FaultBenchmark.h"
+#include "MCP39F511MinMaxRecorder.h"
+#include "MCP39F511ReplayBenchmark.h"
+#include "MCP39F511ScalingBenchmark.h"
+#include "MeasurementDecimator.h"
+#include "MeasurementFilter.h"
 #include "DataLog.h"
 #include "DataLogServer.h"
 #include "SoftwareUpdater.h"
@@ -58,6 +72,7 @@ typedef enum {
 	POWER_FACTOR,
 //	POWER_REACTIVE, /* Removed as we have no way to calibrate reactive power */
 	POWER_APPARENT,
+	ENERGY,
     IP_ADDRESSES,
     SW_VERSION,
 	MAX_SCREENS	
@@ -70,12 +85,22 @@ class EnergyMonitor : public QWidget {
 	public:
 		EnergyMonitor(QWidget *parent);
 		~EnergyMonitor();
+                /* The first MCP39F511, used by the benchmarks, factory reset and EEPROM dump options */
                 MCP39F511Interface *powerMeter;
+                /* Every MCP39F511 including the first, in device ID order */
+                QList<MCP39F511Interface *> powerMeters;
+                /* Burst capture of each MCP39F511, in device ID order */
+                QList<MCP39F511BurstCapture *> burstCaptures;
+                /* Dumps and restores each MCP39F511's EEPROM, in device ID order */
+                QList<MCP39F511EepromJob *> eepromJobs;
+                /* Hardware tracked extremes of each MCP39F511, in device ID order */
+                QList<MCP39F511MinMaxRecorder *> minMaxRecorders;
 	
 	private:
 		void initUI();
-		void startCalibration(QString pa1000IpAddress, bool reactiveCal);
+		void startCalibration(MCP39F511Interface *meter, QString pa1000IpAddress, bool reactiveCal);
 		void cancelCalibration();
+		void startDevice(MCP39F511Interface *meter);
         void selectStart();
         void selectStop();
 		
@@ -97,8 +122,34 @@ class EnergyMonitor : public QWidget {
         bool optionCalibrate;
         bool optionReactiveCalibrate;
         QString pa1000IpAddress;
+        /* Device ID of the MCP39F511 to calibrate */
+        int calibrationDevice;
+        /* The MCP39F511 being calibrated, started once calibration is complete */
+        MCP39F511Interface *calibrationMeter;
         bool optionFactoryReset;
+        bool optionFaultBenchmark;
+        MCP39F511FaultBenchmark *faultBenchmark;
+        bool optionReplayBenchmark;
+        MCP39F511ReplayBenchmark *replayBenchmark;
+        double acquisitionRate;
+        int optionMeasurementMode;
+        double burstCurrentThreshold;
+        bool optionBurstEvents;
+        MeasurementFilter *displayFilter;
+        MeasurementDecimator *displayDecimator;
+        QList<MeasurementDecimator *> logDecimators;
+        QList<MCP39F511EnergyCheckpoint *> energyCheckpoints;
+        bool optionScalingBenchmark;
+        MCP39F511ScalingBenchmark *scalingBenchmark;
+        int devicesInitialised;
+        QString eepromDumpFile;
+        QString eepromRestoreFile;
+        QByteArray eepromImage;
         bool shuttingDown;
+        
+        /* Time from start up to the first sample being displayed */
+        QElapsedTimer startupTimer;
+        bool firstSampleDisplayed;
 		
         /* Software updater */
         SoftwareUpdater *softwareUpdater;
@@ -113,6 +164,7 @@ class EnergyMonitor : public QWidget {
         
 	private slots:
 		void processMeasurements(DecodedMeasurements);
+		void processEnergyTotals(EnergyTotals);
 		void buttonPressed(ButtonState *button);
 		void slotCalibrationComplete(bool);
         void slotFactoryResetComplete(int transactionId);
@@ -120,8 +172,11 @@ class EnergyMonitor : public QWidget {
         void displayIPAddress();
         void loggingStarted();
         void loggingStopped();
-        void startMeasurements();
         void initialisationComplete();
+        void slotDeviceInitialised();
+        void slotEepromDumpReady(QByteArray image);
+        void slotEepromRestoreFinished(bool success);
+        void slotEepromJobProgress(int pagesDone, int pagesTotal);
         void slotSoftwareAvailableUSB(QFileInfoList fileList);
         void slotSoftwareAvailableNetwork(QList<QUrl> urlList);
         void slotUpdaterProgress(QString status);
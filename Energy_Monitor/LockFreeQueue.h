@@ -0,0 +1,94 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * File:   LockFreeQueue.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 10:05
+ */
+
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <QAtomicInt>
+
+/**
+ * Fixed size ring buffer for passing items between exactly one producer thread
+ * and exactly one consumer thread without locking.
+ * One slot is always left empty so a full queue can be told apart from an empty one.
+ */
+template <typename T, int Size>
+class LockFreeQueue {
+public:
+	LockFreeQueue() : head(0), tail(0) {
+	}
+
+	/**
+	 * Add an item to the tail of the queue.  Producer thread only.
+	 * @param item Item to copy into the queue
+	 * @return false if the queue is full
+	 */
+	bool push(const T &item) {
+		int currentTail = tail.loadAcquire();
+		int nextTail = (currentTail + 1) % Size;
+		if(nextTail == head.loadAcquire()) {
+			return false;
+		}
+		buffer[currentTail] = item;
+		tail.storeRelease(nextTail);
+		return true;
+	}
+
+	/**
+	 * Remove an item from the head of the queue.  Consumer thread only.
+	 * @param item Where to copy the item to
+	 * @return false if the queue is empty
+	 */
+	bool pop(T *item) {
+		int currentHead = head.loadAcquire();
+		if(currentHead == tail.loadAcquire()) {
+			return false;
+		}
+		*item = buffer[currentHead];
+		/* Don't leave the slot holding on to anything the item refers to */
+		buffer[currentHead] = T();
+		head.storeRelease((currentHead + 1) % Size);
+		return true;
+	}
+
+	/**
+	 * Number of items that can be pushed before the queue is full.  Producer thread only,
+	 * the consumer can only ever make more space.
+	 */
+	int freeSpace() const {
+		return (head.loadAcquire() - tail.loadAcquire() - 1 + Size) % Size;
+	}
+
+	bool isEmpty() const {
+		return head.loadAcquire() == tail.loadAcquire();
+	}
+
+private:
+	T buffer[Size];
+	QAtomicInt head;
+	QAtomicInt tail;
+};
+
+#endif /* LOCKFREEQUEUE_H */
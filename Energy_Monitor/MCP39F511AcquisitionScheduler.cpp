@@ -0,0 +1,189 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511AcquisitionScheduler.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 18:20
+ */
+
+#include <string.h>
+
+#include <QDebug>
+
+#include "MCP39F511AcquisitionScheduler.h"
+
+MCP39F511AcquisitionScheduler::MCP39F511AcquisitionScheduler(QObject *parent) : QObject(parent) {
+	running = false;
+	period = accumulationPeriod(0, 0);
+	locked = false;
+	updateTime = 0;
+	lastSampleTime = 0;
+	lastStaleTime = -1;
+	lastMeasurementsLength = 0;
+	reads = 0;
+	samples = 0;
+	staleReads = 0;
+	
+	readTimer = new QTimer(this);
+	readTimer->setSingleShot(true);
+	readTimer->setTimerType(Qt::PreciseTimer);
+	connect(readTimer, SIGNAL(timeout()), this, SLOT(slotReadTimer()));
+}
+
+MCP39F511AcquisitionScheduler::~MCP39F511AcquisitionScheduler() {
+}
+
+void MCP39F511AcquisitionScheduler::printMessage(QString message) {
+	qDebug() << "MCP39F511 acquisition: " << message;
+}
+
+int MCP39F511AcquisitionScheduler::accumulationPeriod(int accumulationIntervalParameter, double lineFrequency) {
+	if(lineFrequency <= 0) {
+		lineFrequency = MCP_ACQ_NOMINAL_LINE_FREQUENCY;
+	}
+	int cycles = 1 << qBound(0, accumulationIntervalParameter, MCP_ACQ_MAX_ACCUMULATION_INTERVAL);
+	return qRound(cycles * 1000 / lineFrequency);
+}
+
+void MCP39F511AcquisitionScheduler::start() {
+	clock.start();
+	running = true;
+	locked = false;
+	lastStaleTime = -1;
+	lastMeasurementsLength = 0;
+	reads = 0;
+	samples = 0;
+	staleReads = 0;
+	readTimer->start(0);
+}
+
+void MCP39F511AcquisitionScheduler::stop() {
+	running = false;
+	readTimer->stop();
+}
+
+bool MCP39F511AcquisitionScheduler::isRunning() {
+	return running;
+}
+
+void MCP39F511AcquisitionScheduler::setAccumulationPeriod(int period) {
+	if(period != this->period) {
+		/* The update times found so far no longer apply */
+		this->period = period;
+		if(locked) {
+			locked = false;
+			printMessage(QString("Accumulation period changed to %1 ms, searching for the register update.").arg(period));
+		}
+		lastStaleTime = -1;
+	}
+}
+
+bool MCP39F511AcquisitionScheduler::readComplete(const void *measurements, int length) {
+	length = qMin(length, MCP_ACQ_MAX_MEASUREMENT_SIZE);
+	qint64 now = clock.elapsed();
+	bool sample = true;
+	
+	reads++;
+	if(lastMeasurementsLength == 0) {
+		/* Nothing to compare the first read with */
+		updateTime = now;
+	} else if(length != lastMeasurementsLength || memcmp(measurements, lastMeasurements, length)) {
+		if(lastStaleTime >= 0) {
+			/* The update happened between the last unchanged read and this one */
+			updateTime = lastStaleTime + (now - lastStaleTime) / 2;
+			if(!locked) {
+				locked = true;
+				printMessage(QString("Locked to the register update, accumulation period %1 ms.").arg(period));
+			}
+		} else if(locked) {
+			/* Already updated when read, it may have been a while ago so read a little earlier next time */
+			qint64 expected = updateTime + period;
+			while(expected + period <= now) {
+				expected += period;
+			}
+			updateTime = expected - MCP_ACQ_PHASE_STEP;
+		} else {
+			updateTime = now;
+		}
+	} else if(now - lastSampleTime >= period + MCP_ACQ_GUARD_TIME) {
+		/* A whole period has passed so the registers have updated to the same values */
+		if(locked) {
+			updateTime += period;
+		} else {
+			updateTime = now - MCP_ACQ_GUARD_TIME;
+			locked = true;
+		}
+	} else {
+		sample = false;
+	}
+	
+	if(!running) {
+		return sample;
+	}
+	if(sample) {
+		samples++;
+		lastSampleTime = now;
+		lastStaleTime = -1;
+		memcpy(lastMeasurements, measurements, length);
+		lastMeasurementsLength = length;
+		if(locked) {
+			scheduleAt(updateTime + period + MCP_ACQ_GUARD_TIME);
+		} else {
+			scheduleAt(now + qMax(period / MCP_ACQ_SEARCH_READS, MCP_ACQ_RETRY_TIME));
+		}
+	} else {
+		staleReads++;
+		lastStaleTime = now;
+		if(locked) {
+			scheduleAt(now + MCP_ACQ_RETRY_TIME);
+		} else {
+			scheduleAt(now + qMax(period / MCP_ACQ_SEARCH_READS, MCP_ACQ_RETRY_TIME));
+		}
+	}
+	return sample;
+}
+
+void MCP39F511AcquisitionScheduler::readFailed() {
+	if(running) {
+		scheduleAt(clock.elapsed() + MCP_ACQ_RETRY_TIME);
+	}
+}
+
+void MCP39F511AcquisitionScheduler::scheduleAt(qint64 time) {
+	readTimer->start((int)qMax(time - clock.elapsed(), (qint64)0));
+}
+
+void MCP39F511AcquisitionScheduler::slotReadTimer() {
+	if(running) {
+		emit readDue();
+	}
+}
+
+Mcp39F511AcquisitionStats MCP39F511AcquisitionScheduler::getStats() {
+	Mcp39F511AcquisitionStats stats;
+	stats.period = period;
+	stats.locked = locked;
+	stats.reads = reads;
+	stats.samples = samples;
+	stats.staleReads = staleReads;
+	return stats;
+}
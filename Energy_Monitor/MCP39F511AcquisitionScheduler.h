@@ -0,0 +1,152 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511AcquisitionScheduler.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 18:20
+ */
+
+#ifndef MCP39F511ACQUISITIONSCHEDULER_H
+#define MCP39F511ACQUISITIONSCHEDULER_H
+
+#include <sys/types.h>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+/* Time in milliseconds after the predicted register update that the read is made */
+#define MCP_ACQ_GUARD_TIME 40
+/* Time in milliseconds before reading again when the registers haven't updated yet */
+#define MCP_ACQ_RETRY_TIME 20
+/* Time in milliseconds each read is pulled earlier to follow drift between the chip and our clock */
+#define MCP_ACQ_PHASE_STEP 5
+/* Until the update has been found the registers are read this many times per accumulation period */
+#define MCP_ACQ_SEARCH_READS 16
+/* Largest accumulation interval parameter used, 2^16 line cycles */
+#define MCP_ACQ_MAX_ACCUMULATION_INTERVAL 16
+/* Line frequency assumed until the MCP39F511 has measured it */
+#define MCP_ACQ_NOMINAL_LINE_FREQUENCY 50
+/* Largest measurement block readComplete() compares, kept in a fixed buffer so no read allocates */
+#define MCP_ACQ_MAX_MEASUREMENT_SIZE 64
+
+/**
+ * Acquisition statistics
+ */
+typedef struct {
+	int period;			/* Accumulation period in milliseconds */
+	bool locked;		/* Reads are timed to follow each register update */
+	int reads;			/* Measurement reads made */
+	int samples;		/* Reads that returned a new measurement */
+	int staleReads;		/* Reads made before the registers had updated */
+} Mcp39F511AcquisitionStats;
+
+/**
+ * Times measurement reads to land just after the MCP39F511 refreshes its output registers.
+ * The chip only updates them once every 2^N line cycles, N being the accumulation interval
+ * parameter, so reading on a fixed timer returns the same measurement several times over and
+ * sees each update late.
+ * Until an update has been seen the registers are read several times per period.  The first
+ * read that returns changed values brackets the update, after that one read is made per period,
+ * MCP_ACQ_GUARD_TIME after the update is due.  Each read is pulled a little earlier until one
+ * comes back unchanged, so the phase follows any drift.
+ * Registers that don't change at all, e.g. with no load, are accepted once a whole period has
+ * passed since the last sample.
+ */
+class MCP39F511AcquisitionScheduler : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511AcquisitionScheduler(QObject *parent);
+	virtual ~MCP39F511AcquisitionScheduler();
+	
+	/**
+	 * Start timing reads, the first is due straight away
+	 */
+	void start();
+	
+	/**
+	 * Stop requesting reads
+	 */
+	void stop();
+	
+	bool isRunning();
+	
+	/**
+	 * @param period Time in milliseconds between register updates
+	 */
+	void setAccumulationPeriod(int period);
+	
+	/**
+	 * Calculate the time between register updates
+	 * @param accumulationIntervalParameter N from the accumulation interval register, 2^N line cycles are accumulated
+	 * @param lineFrequency Measured line frequency in Hz, 0 if not yet known
+	 * @return Accumulation period in milliseconds
+	 */
+	static int accumulationPeriod(int accumulationIntervalParameter, double lineFrequency);
+	
+	/**
+	 * Tell the scheduler a read has completed and schedule the next one
+	 * @param measurements The measurement registers read, without the status registers
+	 * @param length Length of the measurement registers, at most MCP_ACQ_MAX_MEASUREMENT_SIZE
+	 * @return true if the read returned a new measurement, false if it is the same as the last one
+	 */
+	bool readComplete(const void *measurements, int length);
+	
+	/**
+	 * Tell the scheduler a read failed, another is tried shortly
+	 */
+	void readFailed();
+	
+	Mcp39F511AcquisitionStats getStats();
+	
+signals:
+	/**
+	 * Emitted when the registers should be read
+	 */
+	void readDue();
+	
+private slots:
+	void slotReadTimer();
+	
+private:
+	void scheduleAt(qint64 time);
+	void printMessage(QString message);
+	
+	QTimer *readTimer;
+	QElapsedTimer clock;
+	bool running;
+	int period;
+	bool locked;
+	/* Estimated time of the last register update */
+	qint64 updateTime;
+	qint64 lastSampleTime;
+	/* Time of the last read that came back unchanged, -1 if the last read was a sample */
+	qint64 lastStaleTime;
+	u_int8_t lastMeasurements[MCP_ACQ_MAX_MEASUREMENT_SIZE];
+	int lastMeasurementsLength;		/* 0 until a sample has been kept */
+	int reads;
+	int samples;
+	int staleReads;
+};
+
+#endif /* MCP39F511ACQUISITIONSCHEDULER_H */
@@ -0,0 +1,193 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511BurstCapture.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 19:50
+ */
+
+#include <QDebug>
+
+#include "MCP39F511BurstCapture.h"
+
+MCP39F511BurstCapture::MCP39F511BurstCapture(MCP39F511Interface *powerMeter, QObject *parent) : QObject(parent) {
+	this->powerMeter = powerMeter;
+	running = false;
+	currentThreshold = 0;
+	aboveThreshold = false;
+	eventMask = 0;
+	lastEvents = 0;
+	savedAccumulationInterval = MCP_ACCUMULATION_INTERVAL_PRECISION;
+	savedAcquisitionRunning = false;
+	
+	/* Allocated once so a burst never waits on the heap */
+	burst.samples.reserve(MCP_BURST_MAX_SAMPLES);
+	burst.deviceId = 0;
+	burst.accumulationPeriod = 0;
+	
+	connect(powerMeter, SIGNAL(measurementsReady(DecodedMeasurements)), this, SLOT(slotMeasurementsReady(DecodedMeasurements)));
+	connect(powerMeter, SIGNAL(outputRegistersReady(McpOutputRegisters, int)), this, SLOT(slotOutputRegistersReady(McpOutputRegisters)));
+}
+
+MCP39F511BurstCapture::~MCP39F511BurstCapture() {
+}
+
+void MCP39F511BurstCapture::printMessage(QString message) {
+	qDebug() << "Burst capture: " << message;
+}
+
+void MCP39F511BurstCapture::setCurrentThreshold(double amps) {
+	currentThreshold = amps;
+	aboveThreshold = false;
+}
+
+void MCP39F511BurstCapture::setEventMask(u_int16_t mask) {
+	eventMask = mask;
+	lastEvents = 0;
+}
+
+bool MCP39F511BurstCapture::isRunning() {
+	return running;
+}
+
+void MCP39F511BurstCapture::slotMeasurementsReady(DecodedMeasurements values) {
+	bool above = currentThreshold > 0 && values.currentRms > currentThreshold;
+	if(above && !aboveThreshold && !running) {
+		printMessage(QString("Current rose to %1 A, triggering a burst.").arg(values.currentRms));
+		trigger();
+	}
+	aboveThreshold = above;
+}
+
+void MCP39F511BurstCapture::slotOutputRegistersReady(McpOutputRegisters registers) {
+	u_int16_t events = registers.system_status & eventMask;
+	if((events & ~lastEvents) && !running) {
+		printMessage(QString("Event flags 0x%1 raised, triggering a burst.").arg(events, 4, 16, QChar('0')));
+		trigger();
+	}
+	lastEvents = events;
+}
+
+bool MCP39F511BurstCapture::trigger() {
+	if(running) {
+		return false;
+	}
+	running = true;
+	
+	savedAccumulationInterval = powerMeter->mcpConfigReg2.accumulation_interval_parameter;
+	savedAcquisitionRunning = powerMeter->isAcquisitionRunning();
+	powerMeter->stopAcquisition();
+	
+	powerMeter->mcpConfigReg2.accumulation_interval_parameter = MCP_ACCUMULATION_INTERVAL_MIN;
+	int transactionId = powerMeter->setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t *)&powerMeter->mcpConfigReg2.accumulation_interval_parameter, sizeof(powerMeter->mcpConfigReg2.accumulation_interval_parameter));
+	if(transactionId == 0) {
+		printMessage("Queue full, burst not started.");
+		abandon();
+		return false;
+	}
+	
+	burst.samples.resize(0);
+	burst.start = QDateTime::currentDateTime();
+	burst.deviceId = powerMeter->getDeviceId();
+	burst.accumulationPeriod = MCP39F511AcquisitionScheduler::accumulationPeriod(MCP_ACCUMULATION_INTERVAL_MIN, McpFrequencyScale::toDouble(powerMeter->mcpOutputReg.line_frequency));
+	
+	/* Measurement reads overtake control writes so wait for the new interval to be written */
+	powerMeter->onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		if(transaction->status != COMMS_COMPLETE) {
+			printMessage("Unable to shorten the accumulation interval, burst abandoned.");
+			abandon();
+			return;
+		}
+		clock.start();
+		readNext();
+	});
+	return true;
+}
+
+void MCP39F511BurstCapture::triggerDevice(int deviceId) {
+	if(deviceId == powerMeter->getDeviceId()) {
+		trigger();
+	}
+}
+
+/**
+ * Put the accumulation interval and acquisition back as they were after a burst that couldn't start
+ * or finish
+ */
+void MCP39F511BurstCapture::abandon() {
+	powerMeter->mcpConfigReg2.accumulation_interval_parameter = savedAccumulationInterval;
+	powerMeter->setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t *)&powerMeter->mcpConfigReg2.accumulation_interval_parameter, sizeof(powerMeter->mcpConfigReg2.accumulation_interval_parameter));
+	if(savedAcquisitionRunning) {
+		powerMeter->startAcquisition();
+	}
+	running = false;
+}
+
+/**
+ * Reads are made one after another, each as soon as the last completes
+ */
+void MCP39F511BurstCapture::readNext() {
+	if(clock.elapsed() >= MCP_BURST_DURATION || burst.samples.size() >= MCP_BURST_MAX_SAMPLES) {
+		finish();
+		return;
+	}
+	int transactionId = powerMeter->getRegister(MCP_OUTPUT_REGISTERS_START, (u_int8_t *)&readBuffer, MCP_OUTPUT_REGISTERS_SIZE, MCP_PRIORITY_MEASUREMENT);
+	if(transactionId == 0) {
+		printMessage("Queue full, burst ended early.");
+		finish();
+		return;
+	}
+	powerMeter->onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		if(transaction->status == COMMS_COMPLETE) {
+			BurstSample sample;
+			sample.time = clock.nsecsElapsed() / 1000;
+			sample.systemStatus = readBuffer.system_status;
+			sample.values = MCP39F511Interface::decodeOutputRegistersFixed(readBuffer);
+			burst.samples.append(sample);
+		}
+		readNext();
+	});
+}
+
+void MCP39F511BurstCapture::finish() {
+	powerMeter->mcpConfigReg2.accumulation_interval_parameter = savedAccumulationInterval;
+	int transactionId = powerMeter->setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t *)&powerMeter->mcpConfigReg2.accumulation_interval_parameter, sizeof(powerMeter->mcpConfigReg2.accumulation_interval_parameter));
+	if(transactionId == 0) {
+		printMessage("Queue full, unable to restore the accumulation interval, burst abandoned.");
+		abandon();
+		return;
+	}
+	
+	powerMeter->onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		if(transaction->status != COMMS_COMPLETE) {
+			printMessage("Unable to restore the accumulation interval, burst abandoned.");
+			abandon();
+			return;
+		}
+		if(savedAcquisitionRunning) {
+			powerMeter->startAcquisition();
+		}
+		running = false;
+		printMessage(QString("%1 samples captured over %2 ms.").arg(burst.samples.size()).arg(clock.elapsed()));
+		emit burstReady(burst);
+	});
+}
@@ -0,0 +1,139 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511BurstCapture.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 19:50
+ */
+
+#ifndef MCP39F511BURSTCAPTURE_H
+#define MCP39F511BURSTCAPTURE_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+
+#include "MCP39F511Interface.h"
+
+/* Time in milliseconds a burst runs for */
+#define MCP_BURST_DURATION 5000
+/* Samples held in RAM for a burst, the burst ends early if it fills.  A read of the output
+   registers takes around 4 ms at 115200 baud so this covers MCP_BURST_DURATION with room to spare. */
+#define MCP_BURST_MAX_SAMPLES 2048
+/* Event flags in system_status that trigger a burst when event triggering is on */
+#define MCP_BURST_EVENT_MASK (MCP_SYSTEM_STATUS_OVERCUR | MCP_SYSTEM_STATUS_OVERPOW | MCP_SYSTEM_STATUS_VSAG | MCP_SYSTEM_STATUS_VSURGE)
+
+typedef struct {
+	qint64 time;				/* Microseconds since the burst started */
+	u_int16_t systemStatus;
+	FixedMeasurements values;		/* Kept as read, a burst holds thousands of samples */
+} BurstSample;
+
+/**
+ * A completed burst, samples holds every read made in order
+ */
+typedef struct {
+	QDateTime start;
+	int deviceId;				/* The MCP39F511 it was captured from */
+	int accumulationPeriod;		/* Milliseconds each sample is averaged over */
+	QVector<BurstSample> samples;
+} MeasurementBurst;
+
+/**
+ * Captures inrush and other transients that are averaged away at the normal sample rate.
+ * A burst drops the accumulation interval to a single line cycle and reads the output
+ * registers back to back for MCP_BURST_DURATION into a buffer allocated up front, then puts
+ * the accumulation interval and acquisition back as they were and hands the whole burst on
+ * in one go.
+ * Bursts are triggered by calling trigger(), by the RMS current rising through a threshold,
+ * or by the MCP39F511 raising an over current, over power, sag or surge event.
+ */
+class MCP39F511BurstCapture : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511BurstCapture(MCP39F511Interface *powerMeter, QObject *parent);
+	virtual ~MCP39F511BurstCapture();
+	
+	/**
+	 * Trigger a burst when the RMS current rises above a threshold
+	 * @param amps Threshold in amps, 0 to turn off
+	 */
+	void setCurrentThreshold(double amps);
+	
+	/**
+	 * Trigger a burst when any of the event flags rises in system_status
+	 * @param mask system_status flags to watch, e.g. MCP_BURST_EVENT_MASK, 0 to turn off
+	 */
+	void setEventMask(u_int16_t mask);
+	
+	bool isRunning();
+	
+signals:
+	/**
+	 * Emitted when a burst has been captured and the previous configuration restored
+	 */
+	void burstReady(const MeasurementBurst &burst);
+	
+public slots:
+	/**
+	 * Start a burst now
+	 * @return false if a burst is already running or couldn't be queued.  A burst whose
+	 * accumulation interval can't be shortened or put back afterwards is abandoned later
+	 * without burstReady being emitted.
+	 */
+	bool trigger();
+	
+	/**
+	 * Start a burst now if it is asked for on this capture's MCP39F511
+	 * @param deviceId Device ID of the MCP39F511 to capture from
+	 */
+	void triggerDevice(int deviceId);
+	
+private slots:
+	void slotMeasurementsReady(DecodedMeasurements values);
+	void slotOutputRegistersReady(McpOutputRegisters registers);
+	
+private:
+	void readNext();
+	void finish();
+	void abandon();
+	void printMessage(QString message);
+	
+	MCP39F511Interface *powerMeter;
+	bool running;
+	double currentThreshold;
+	bool aboveThreshold;
+	u_int16_t eventMask;
+	u_int16_t lastEvents;
+	
+	/* Configuration to go back to after the burst */
+	u_int16_t savedAccumulationInterval;
+	bool savedAcquisitionRunning;
+	
+	QElapsedTimer clock;
+	McpOutputRegisters readBuffer;
+	MeasurementBurst burst;
+};
+
+#endif /* MCP39F511BURSTCAPTURE_H */
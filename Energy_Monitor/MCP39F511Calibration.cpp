@@ -31,9 +31,12 @@
 
 #include <QDebug>
 #include <QIODevice>
-#include <QtMath>
 #include <QSocketNotifier>
 #include <QTextStream>
+#include <QTimer>
+
+/* Time in milliseconds to let the MCP39F511 measurements settle before writing the calibrated frequency */
+#define CALIB_SETTLE_TIME 1000
 
 MCP39F511Calibration::MCP39F511Calibration(QObject *parent, MCP39F511Interface *powerMeter) {
 	setParent(parent);
@@ -41,7 +44,6 @@ MCP39F511Calibration::MCP39F511Calibration(QObject *parent, MCP39F511Interface *
 	/* Set up the connections to the MCP39F511 power meter */
 	calibrationState = CALIB_STATE_IDLE;
 	mcp39F511Interface = powerMeter;
-	connect(powerMeter, SIGNAL(dataReady(Mcp39F511Transaction)), this, SLOT(dataReady(Mcp39F511Transaction)));
 	connect(powerMeter, SIGNAL(outputRegistersReady(McpOutputRegisters, int)), this, SLOT(mcpMeasurementsReady(McpOutputRegisters)));
 	
 	/* Create an instance of the Tektronix PA1000 power analyser */
@@ -72,8 +74,8 @@ void MCP39F511Calibration::startCalibration(QString hostName, bool performReacti
     
 	/* Start by writing out accumulation, range and zero offset registers */
     
-    /* Set the accumulation register to 2^7 = 128.  So all measurements averaged over 128 * 20 ms = 2.56 seconds */
-    mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter = 7;
+    /* Calibrate in precision mode, 2^7 = 128.  So all measurements averaged over 128 * 20 ms = 2.56 seconds */
+    mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter = MCP_ACCUMULATION_INTERVAL_PRECISION;
     /* Write out just the accumulation interval parameter register */
     mcp39F511Interface->setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t*)&mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter, sizeof(mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter));
 
@@ -92,10 +94,10 @@ void MCP39F511Calibration::startCalibration(QString hostName, bool performReacti
     mcp39F511Interface->mcpCalibReg.offset_current_RMS = 0;
     mcp39F511Interface->mcpCalibReg.offset_active_power = 0;
     mcp39F511Interface->mcpCalibReg.offset_reactive_power = 0;
-    mcp39F511Interface->setRegister(MCP_CALIB_OFFSET_CURRENT_RMS, (u_int8_t *)&mcp39F511Interface->mcpCalibReg.offset_current_RMS,
-                                    sizeof(mcp39F511Interface->mcpCalibReg.offset_current_RMS) + 
-                                    sizeof(mcp39F511Interface->mcpCalibReg.offset_active_power) + 
-                                    sizeof(mcp39F511Interface->mcpCalibReg.offset_reactive_power));
+    /* Neighbouring registers are merged into a single write by the comms layer */
+    mcp39F511Interface->setRegister(MCP_CALIB_OFFSET_CURRENT_RMS, (u_int8_t *)&mcp39F511Interface->mcpCalibReg.offset_current_RMS, sizeof(mcp39F511Interface->mcpCalibReg.offset_current_RMS));
+    mcp39F511Interface->setRegister(MCP_CALIB_OFFSET_ACTIVE_POWER, (u_int8_t *)&mcp39F511Interface->mcpCalibReg.offset_active_power, sizeof(mcp39F511Interface->mcpCalibReg.offset_active_power));
+    mcp39F511Interface->setRegister(MCP_CALIB_OFFSET_REACTIVE_POWER, (u_int8_t *)&mcp39F511Interface->mcpCalibReg.offset_reactive_power, sizeof(mcp39F511Interface->mcpCalibReg.offset_reactive_power));
     
     /* Set up some other system configuration options */
     /* Disable zero cross detect output */
@@ -103,8 +105,8 @@ void MCP39F511Calibration::startCalibration(QString hostName, bool performReacti
     /* Enable temperature compensation */
     mcp39F511Interface->mcpConfigReg1.system_configuration |= MCP_SYSTEM_CONFIG_TEMPCOMP;
     /* Write out just the system config register. */
-    transactionId = mcp39F511Interface->setRegister(MCP_CONFIG_1_SYSTEM_CONFIG, (u_int8_t*)&mcp39F511Interface->mcpConfigReg1.system_configuration, sizeof(mcp39F511Interface->mcpConfigReg1.system_configuration));
     calibrationState = CALIB_STATE_WAIT_FOR_LOAD_PF_ONE;
+    afterTransaction(mcp39F511Interface->setRegister(MCP_CONFIG_1_SYSTEM_CONFIG, (u_int8_t*)&mcp39F511Interface->mcpConfigReg1.system_configuration, sizeof(mcp39F511Interface->mcpConfigReg1.system_configuration)));
 }
 
 void MCP39F511Calibration::cancelCalibration() {
@@ -135,103 +137,115 @@ void MCP39F511Calibration::pa1000MeasurementsReady(PowerCalibrationData *measure
 	}
 }
 
-void MCP39F511Calibration::dataReady(Mcp39F511Transaction transaction) {
-	if(transaction.unique_id == transactionId) {
-		switch(calibrationState) {
-			case CALIB_STATE_IDLE:
-				/* Do nothing */
-			break;
-			case CALIB_STATE_WAIT_FOR_LOAD_PF_ONE:
-                /* Wait for user input to continue */
-                //		For bypassing [y] checks
-                //		calibrationState = CALIB_STATE_CONNECT_TO_PA1000;
-                //		pa1000Analyer->connectToAnalyser(pa1000Hostname);
-                printMessage("Please apply approximately 60W load with a power factor of 1.  For example, connect a 60W light bulb.");
+void MCP39F511Calibration::afterTransaction(int transactionId) {
+	CalibrationState waitingState = calibrationState;
+	
+	mcp39F511Interface->onComplete(transactionId, [this, waitingState](const Mcp39F511TransactionRef &transaction) {
+		/* Calibration may have been cancelled or restarted while the transaction was queued */
+		if(calibrationState != waitingState) {
+			return;
+		}
+		if(transaction->status != COMMS_COMPLETE) {
+			printMessage(QString("Transaction %1 failed, calibration aborted.").arg(transaction->unique_id));
+			pa1000Analyer->disconnectFromAnalyser();
+			calibrationState = CALIB_STATE_IDLE;
+			emit calibrationComplete(false);
+			return;
+		}
+		stepComplete();
+	});
+}
+
+void MCP39F511Calibration::stepComplete() {
+	switch(calibrationState) {
+		case CALIB_STATE_IDLE:
+			/* Do nothing */
+		break;
+		case CALIB_STATE_WAIT_FOR_LOAD_PF_ONE:
+            /* Wait for user input to continue */
+            //		For bypassing [y] checks
+            //		calibrationState = CALIB_STATE_CONNECT_TO_PA1000;
+            //		pa1000Analyer->connectToAnalyser(pa1000Hostname);
+            printMessage("Please apply approximately 60W load with a power factor of 1.  For example, connect a 60W light bulb.");
+            printMessage("Press [y] and enter to continue.");
+            calibrationState = CALIB_STATE_WAIT_FOR_LOAD_PF_ONE;
+        break;
+        
+		case CALIB_STATE_WRITE_FREQUENCY:
+			/* Frequency written */
+			printMessage("Calibrated frequency written.");
+			printMessage("Calling auto calibrate frequency command...");
+			calibrationState = CALIB_STATE_AUTO_CALIB_FREQUENCY;
+			afterTransaction(mcp39F511Interface->autoCalibrateFrequency());
+		break;
+		
+		case CALIB_STATE_AUTO_CALIB_FREQUENCY:
+			printMessage("Auto calibrate frequency command complete.");
+			printMessage("Writing calibrated Amps, Volts and Watts...");
+			calibrationState = CALIB_STATE_WRITE_VOLTS_AMPS_WATTS_PF_ONE;
+			afterTransaction(writeMcpCalibrationData());
+		break;
+		
+		case CALIB_STATE_WRITE_VOLTS_AMPS_WATTS_PF_ONE:
+			printMessage("Active Amps, Volts and Watts written.");
+			printMessage("Calling auto calibrate gain command...");
+			calibrationState = CALIB_STATE_AUTO_CALIB_GAIN;
+			afterTransaction(mcp39F511Interface->autoCalibrateGain());
+		break;
+		
+		case CALIB_STATE_AUTO_CALIB_GAIN:
+			printMessage("Auto calibration at power factor 1 complete.");
+            /* Bypass the reactive calibration if reactive cal procedure is not to be run. */
+            if(performReactive) {
+                printMessage("Please apply approximately 10W load with a power factor of 0.5.");
                 printMessage("Press [y] and enter to continue.");
-                calibrationState = CALIB_STATE_WAIT_FOR_LOAD_PF_ONE;
-            break;
-            
-			case CALIB_STATE_WRITE_FREQUENCY:
-				/* Frequency written */
-				printMessage("Calibrated frequency written.");
-				printMessage("Calling auto calibrate frequency command...");
-				calibrationState = CALIB_STATE_AUTO_CALIB_FREQUENCY;
-				transactionId = mcp39F511Interface->autoCalibrateFrequency();
-			break;
-			
-			case CALIB_STATE_AUTO_CALIB_FREQUENCY:
-				printMessage("Auto calibrate frequency command complete.");
-				printMessage("Writing calibrated Amps, Volts and Watts...");
-				calibrationState = CALIB_STATE_WRITE_VOLTS_AMPS_WATTS_PF_ONE;
-				writeMcpCalibrationData();
-			break;
-			
-			case CALIB_STATE_WRITE_VOLTS_AMPS_WATTS_PF_ONE:
-				printMessage("Active Amps, Volts and Watts written.");
-				printMessage("Calling auto calibrate gain command...");
-				calibrationState = CALIB_STATE_AUTO_CALIB_GAIN;
-				transactionId = mcp39F511Interface->autoCalibrateGain();
-			break;
-			
-			case CALIB_STATE_AUTO_CALIB_GAIN:
-				printMessage("Auto calibration at power factor 1 complete.");
-                /* Bypass the reactive calibration if reactive cal procedure is not to be run. */
-                if(performReactive) {
-                    printMessage("Please apply approximately 10W load with a power factor of 0.5.");
-                    printMessage("Press [y] and enter to continue.");
-                    //	For bypassing [y] checks
-                    //	calibrationState = CALIB_STATE_GET_PA1000_PF_HALF;
-                    //	pa1000Analyer->getPowerMeasurements();
-                    calibrationState = CALIB_STATE_WAIT_FOR_LOAD_PF_HALF;
-                } else {
-                    setMcpConfiguration();
-                }
-			break;
-			
-			case CALIB_STATE_WRITE_VOLTS_AMPS_WATTS_PF_HALF:
-				printMessage("Reactive Amps, Volts and Watts written.");
-				printMessage("Calling auto calibrate reactive gain command...");
-				calibrationState = CALIB_STATE_AUTO_CALIB_REACTIVE_GAIN;
-				transactionId = mcp39F511Interface->autoCalibrateReactiveGain();
-			break;
-			
-			case CALIB_STATE_AUTO_CALIB_REACTIVE_GAIN:
-				printMessage(QString("Auto calibration at power factor %1 complete.").arg(pa1000Measurements->powerFactor));
+                //	For bypassing [y] checks
+                //	calibrationState = CALIB_STATE_GET_PA1000_PF_HALF;
+                //	pa1000Analyer->getPowerMeasurements();
+                calibrationState = CALIB_STATE_WAIT_FOR_LOAD_PF_HALF;
+            } else {
                 setMcpConfiguration();
-            break;
-			
-			case CALIB_STATE_SET_SYSTEM_CONFIG:
-                calibrationState = CALIB_STATE_READ_ALL_REGISTERS;
-                transactionId = mcp39F511Interface->readAllRegisters();
-			break;
-			
-			case CALIB_STATE_SAVE_TO_FLASH:
-                /* Delay before reset to allow for flash configuration to be written */
-                usleep(1000000);
-                mcp39F511Interface->close();
-                mcp39F511Interface->initialise();
-				printMessage("Settings stored in flash and MCP39F511.  Calibration complete!");
-                calibrationState = CALIB_STATE_IDLE;
-                emit calibrationComplete(true);
-			break;
+            }
+		break;
+		
+		case CALIB_STATE_WRITE_VOLTS_AMPS_WATTS_PF_HALF:
+			printMessage("Reactive Amps, Volts and Watts written.");
+			printMessage("Calling auto calibrate reactive gain command...");
+			calibrationState = CALIB_STATE_AUTO_CALIB_REACTIVE_GAIN;
+			afterTransaction(mcp39F511Interface->autoCalibrateReactiveGain());
+		break;
+		
+		case CALIB_STATE_AUTO_CALIB_REACTIVE_GAIN:
+			printMessage(QString("Auto calibration at power factor %1 complete.").arg(pa1000Measurements->powerFactor));
+            setMcpConfiguration();
+        break;
+		
+		case CALIB_STATE_SET_SYSTEM_CONFIG:
+            calibrationState = CALIB_STATE_READ_ALL_REGISTERS;
+            afterTransaction(mcp39F511Interface->readAllRegisters());
+		break;
+		
+		case CALIB_STATE_SAVE_TO_FLASH:
+            /* Delay before reset to allow for flash configuration to be written */
+            QTimer::singleShot(MCP_FLASH_SAVE_TIME, this, SLOT(slotFlashSaved()));
+		break;
+        
+        case CALIB_STATE_READ_ALL_REGISTERS:
+            qDebug() << "Voltage range register: " << mcp39F511Interface->mcpConfigReg1.range_voltage;
+            qDebug() << "Vurrent range register: " << mcp39F511Interface->mcpConfigReg1.range_current;
+            qDebug() << "Power range register: " << mcp39F511Interface->mcpConfigReg1.range_power;
             
-            case CALIB_STATE_READ_ALL_REGISTERS:
-                qDebug() << "Voltage range register: " << mcp39F511Interface->mcpConfigReg1.range_voltage;
-                qDebug() << "Vurrent range register: " << mcp39F511Interface->mcpConfigReg1.range_current;
-                qDebug() << "Power range register: " << mcp39F511Interface->mcpConfigReg1.range_power;
-                
-                qDebug() << "Calibration voltage gain register: " << mcp39F511Interface->mcpCalibReg.gain_voltage_RMS;
-                qDebug() << "Calibration current gain register: " << mcp39F511Interface->mcpCalibReg.gain_current_RMS;
-                qDebug() << "Calibration power gain register: " << mcp39F511Interface->mcpCalibReg.gain_active_power;
-                
-                calibrationState = CALIB_STATE_SAVE_TO_FLASH;
-                saveSettingsToFlash();
-            break;
-			
-			default:
-			
-				break;
-		}
+            qDebug() << "Calibration voltage gain register: " << mcp39F511Interface->mcpCalibReg.gain_voltage_RMS;
+            qDebug() << "Calibration current gain register: " << mcp39F511Interface->mcpCalibReg.gain_current_RMS;
+            qDebug() << "Calibration power gain register: " << mcp39F511Interface->mcpCalibReg.gain_active_power;
+            
+            calibrationState = CALIB_STATE_SAVE_TO_FLASH;
+            afterTransaction(saveSettingsToFlash());
+        break;
+		
+		default:
+		
+			break;
 	}
 }
 
@@ -240,26 +254,26 @@ void MCP39F511Calibration::setMcpConfiguration() {
     printMessage("Setting system configuration registers...");
     calibrationState = CALIB_STATE_SET_SYSTEM_CONFIG;
     
-    /* Set the accumulation register to 2^7 = 128.  So all measurements averaged over 128 * 20 ms = 2.56 seconds */
-    mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter = 7;
+    /* Calibrate in precision mode, 2^7 = 128.  So all measurements averaged over 128 * 20 ms = 2.56 seconds */
+    mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter = MCP_ACCUMULATION_INTERVAL_PRECISION;
     /* Write out just the accumulation interval parameter register */
-    transactionId = mcp39F511Interface->setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t*)&mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter, sizeof(mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter));
+    afterTransaction(mcp39F511Interface->setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t*)&mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter, sizeof(mcp39F511Interface->mcpConfigReg2.accumulation_interval_parameter)));
 }
 
-void MCP39F511Calibration::saveSettingsToFlash() {
+int MCP39F511Calibration::saveSettingsToFlash() {
     printMessage("Storing settings in flash...");
     /* Save registers to flash */
-    transactionId = mcp39F511Interface->saveRegistersToFlash();
+    return mcp39F511Interface->saveRegistersToFlash();
 }
 
 void MCP39F511Calibration::adjustRangeAndCopyPA1000(McpOutputRegisters values) {
 	/* Convert PA1000 measurements to the range used by MCP39F511 */
-	pa1000AdjustsedMeasurements.volts = pa1000Measurements->voltsRMS * 10;
-	pa1000AdjustsedMeasurements.amps = pa1000Measurements->ampsRMS * 10000;
-	pa1000AdjustsedMeasurements.activePower = pa1000Measurements->activePower * 100;
-	pa1000AdjustsedMeasurements.frequency = pa1000Measurements->frequency * 1000;
-	pa1000AdjustsedMeasurements.powerFactor = pa1000Measurements->powerFactor / qPow(2, -15);
-	pa1000AdjustsedMeasurements.reactivePower = pa1000Measurements->reactivePower * 100;
+	pa1000AdjustsedMeasurements.volts = McpVoltageScale::fromDouble(pa1000Measurements->voltsRMS);
+	pa1000AdjustsedMeasurements.amps = McpCurrentScale::fromDouble(pa1000Measurements->ampsRMS);
+	pa1000AdjustsedMeasurements.activePower = McpPowerScale::fromDouble(pa1000Measurements->activePower);
+	pa1000AdjustsedMeasurements.frequency = McpFrequencyScale::fromDouble(pa1000Measurements->frequency);
+	pa1000AdjustsedMeasurements.powerFactor = McpPowerFactorScale::fromDouble(pa1000Measurements->powerFactor);
+	pa1000AdjustsedMeasurements.reactivePower = McpPowerScale::fromDouble(pa1000Measurements->reactivePower);
 
 	printMessage(QString("PA1000 Volts: %1").arg(pa1000AdjustsedMeasurements.volts));
 	printMessage(QString("MCP Volts: %1").arg(values.voltage_RMS));
@@ -292,19 +306,43 @@ void MCP39F511Calibration::mcpMeasurementsReady(McpOutputRegisters values) {
 		/* Write out the calibrated frequency value to the MCP39F511 */
 		calibrationState = CALIB_STATE_WRITE_FREQUENCY;
 		printMessage("Writing calibrated frequency...");
-        usleep(1000000);
-		transactionId = mcp39F511Interface->setRegister(MCP_CONFIG_1_LINE_FREQ_REF, (u_int8_t *)&mcp39F511Interface->mcpConfigReg1.line_frequency_reference, sizeof(mcp39F511Interface->mcpConfigReg1.line_frequency_reference));
+		QTimer::singleShot(CALIB_SETTLE_TIME, this, SLOT(slotWriteFrequency()));
 	}
 	if(calibrationState == CALIB_STATE_GET_MCP_MEASUREMENTS_PF_HALF) {
 		adjustRangeAndCopyPA1000(values);
 		printMessage("Got power factor 0.5 measurements.");
 		calibrationState = CALIB_STATE_WRITE_VOLTS_AMPS_WATTS_PF_HALF;
-		writeMcpCalibrationData();
+		afterTransaction(writeMcpCalibrationData());
+	}
+}
+
+/**
+ * Writes the calibrated frequency once the measurements have settled
+ */
+void MCP39F511Calibration::slotWriteFrequency() {
+	/* Calibration may have been cancelled while waiting */
+	if(calibrationState != CALIB_STATE_WRITE_FREQUENCY) {
+		return;
 	}
+	afterTransaction(mcp39F511Interface->setRegister(MCP_CONFIG_1_LINE_FREQ_REF, (u_int8_t *)&mcp39F511Interface->mcpConfigReg1.line_frequency_reference, sizeof(mcp39F511Interface->mcpConfigReg1.line_frequency_reference)));
+}
+
+/**
+ * Restarts the MCP39F511 once the calibration has been written to its flash
+ */
+void MCP39F511Calibration::slotFlashSaved() {
+	if(calibrationState != CALIB_STATE_SAVE_TO_FLASH) {
+		return;
+	}
+	mcp39F511Interface->close();
+	mcp39F511Interface->initialise();
+	printMessage("Settings stored in flash and MCP39F511.  Calibration complete!");
+	calibrationState = CALIB_STATE_IDLE;
+	emit calibrationComplete(true);
 }
 
-void MCP39F511Calibration::writeMcpCalibrationData() {
-	transactionId = mcp39F511Interface->setRegister(MCP_CONFIG_1_CALIB_CURRENT, (u_int8_t *)&mcp39F511Interface->mcpConfigReg1.calibration_current, 
+int MCP39F511Calibration::writeMcpCalibrationData() {
+	return mcp39F511Interface->setRegister(MCP_CONFIG_1_CALIB_CURRENT, (u_int8_t *)&mcp39F511Interface->mcpConfigReg1.calibration_current, 
 						        sizeof(mcp39F511Interface->mcpConfigReg1.calibration_current) + 
 						        sizeof(mcp39F511Interface->mcpConfigReg1.calibration_voltage) + 
 						        sizeof(mcp39F511Interface->mcpConfigReg1.calibration_power_active) + 
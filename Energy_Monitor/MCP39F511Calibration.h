@@ -56,13 +56,14 @@ typedef enum {
     CALIB_STATE_READ_ALL_REGISTERS
 } CalibrationState;
 
+/* PA1000 measurements in the units of the MCP39F511 registers */
 typedef struct {
-	u_int16_t volts;
-	u_int16_t amps;
-	u_int16_t activePower;
-	u_int16_t frequency;
-	u_int16_t reactivePower;
-	int16_t powerFactor;
+	McpVoltageScale::raw_type volts;
+	McpCurrentScale::raw_type amps;
+	McpPowerScale::raw_type activePower;
+	McpFrequencyScale::raw_type frequency;
+	McpPowerScale::raw_type reactivePower;
+	McpPowerFactorScale::raw_type powerFactor;
 } PA1000AdjustedMeasurements;
 
 class MCP39F511Calibration : public QObject {
@@ -86,14 +87,20 @@ public slots:
 private:
 	void printMessage(QString);
 	void adjustRangeAndCopyPA1000(McpOutputRegisters values);
-	void writeMcpCalibrationData();
-    void saveSettingsToFlash();
+	int writeMcpCalibrationData();
+    int saveSettingsToFlash();
     void setMcpConfiguration();
+	/**
+	 * Move on to the next calibration step when a transaction completes, or abort the calibration
+	 * if it failed.  Ignored if the calibration has changed state in the meantime.
+	 * @param transactionId ID of the transaction the current state is waiting for
+	 */
+	void afterTransaction(int transactionId);
+	void stepComplete();
 	
 	CalibrationState calibrationState;
 	MCP39F511Interface *mcp39F511Interface;
 	PA1000PowerAnalyser *pa1000Analyer;
-	int transactionId;
 	QString pa1000Hostname;
 	McpOutputRegisters mcp39f511Values;
 	PowerCalibrationData *pa1000Measurements;
@@ -101,11 +108,12 @@ private:
     bool performReactive;
 	
 private slots:
-	void dataReady(Mcp39F511Transaction);
 	void pa1000Connected();
 	void pa1000MeasurementsReady(PowerCalibrationData *);
 	void mcpMeasurementsReady(McpOutputRegisters);
 	void slotOnStdinData();
+	void slotWriteFrequency();
+	void slotFlashSaved();
 };
 
 #endif /* MCP39F511CALIBRATION_H */
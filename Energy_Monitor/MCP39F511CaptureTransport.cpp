@@ -0,0 +1,159 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511CaptureTransport.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 17:30
+ */
+
+#include <string.h>
+
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+
+#include "MCP39F511CaptureTransport.h"
+
+/* Most data carried by one record */
+#define CAPTURE_MAX_RECORD_DATA 0xFF
+
+MCP39F511CaptureTransport::MCP39F511CaptureTransport(MCP39F511Transport *transport, QObject *parent) : MCP39F511Transport(parent) {
+	this->transport = transport;
+	transport->setParent(this);
+	connect(transport, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+	
+	ring = new u_int8_t[MCP_CAPTURE_BUFFER_SIZE];
+	head = 0;
+	tail = 0;
+	used = 0;
+	clock.start();
+	lastRecordTime = 0;
+}
+
+MCP39F511CaptureTransport::~MCP39F511CaptureTransport() {
+	delete[] ring;
+}
+
+void MCP39F511CaptureTransport::printMessage(QString message) {
+	qDebug() << "MCP39F511 capture: " << message;
+}
+
+bool MCP39F511CaptureTransport::open() {
+	return transport->open();
+}
+
+void MCP39F511CaptureTransport::close() {
+	transport->close();
+}
+
+bool MCP39F511CaptureTransport::isOpen() {
+	return transport->isOpen();
+}
+
+void MCP39F511CaptureTransport::flush() {
+	transport->flush();
+}
+
+void MCP39F511CaptureTransport::setReset(bool asserted) {
+	record(asserted ? CAPTURE_RESET_ON : CAPTURE_RESET_OFF, NULL, 0);
+	transport->setReset(asserted);
+}
+
+int MCP39F511CaptureTransport::write(const u_int8_t *data, int length) {
+	int written = transport->write(data, length);
+	if(written > 0) {
+		record(CAPTURE_TX, data, written);
+	}
+	return written;
+}
+
+int MCP39F511CaptureTransport::read(u_int8_t *data, int length) {
+	int count = transport->read(data, length);
+	if(count > 0) {
+		record(CAPTURE_RX, data, count);
+	}
+	return count;
+}
+
+/**
+ * Appends records to the ring, dropping the oldest records to make room
+ */
+void MCP39F511CaptureTransport::record(mcp39F511_capture_direction direction, const u_int8_t *data, int length) {
+	QMutexLocker locker(&ringMutex);
+	int position = 0;
+	
+	do {
+		Mcp39F511CaptureRecord header;
+		qint64 now = clock.nsecsElapsed() / 1000;
+		header.delta = qMin(now - lastRecordTime, (qint64)0xFFFFFFFF);
+		header.direction = direction;
+		header.length = qMin(length - position, CAPTURE_MAX_RECORD_DATA);
+		lastRecordTime = now;
+		
+		int size = sizeof(header) + header.length;
+		while(MCP_CAPTURE_BUFFER_SIZE - used < size) {
+			/* The length of the oldest record is the last byte of its header */
+			int oldestLength = ring[(tail + sizeof(Mcp39F511CaptureRecord) - 1) % MCP_CAPTURE_BUFFER_SIZE];
+			int oldestSize = sizeof(Mcp39F511CaptureRecord) + oldestLength;
+			tail = (tail + oldestSize) % MCP_CAPTURE_BUFFER_SIZE;
+			used -= oldestSize;
+		}
+		ringWrite(&header, sizeof(header));
+		if(header.length > 0) {
+			ringWrite(&data[position], header.length);
+		}
+		position += header.length;
+	} while(position < length);
+}
+
+void MCP39F511CaptureTransport::ringWrite(const void *data, int length) {
+	int first = qMin(length, MCP_CAPTURE_BUFFER_SIZE - head);
+	memcpy(&ring[head], data, first);
+	memcpy(ring, (const u_int8_t *)data + first, length - first);
+	head = (head + length) % MCP_CAPTURE_BUFFER_SIZE;
+	used += length;
+}
+
+bool MCP39F511CaptureTransport::save(QString fileName) {
+	QByteArray capture;
+	Mcp39F511CaptureHeader header;
+	
+	memcpy(header.magic, MCP_CAPTURE_MAGIC, sizeof(header.magic));
+	header.version = MCP_CAPTURE_VERSION;
+	header.reserved = 0;
+	capture.append((const char *)&header, sizeof(header));
+	
+	/* Copy out under the lock, write the file without it so the comms thread isn't held up */
+	ringMutex.lock();
+	int first = qMin(used, MCP_CAPTURE_BUFFER_SIZE - tail);
+	capture.append((const char *)&ring[tail], first);
+	capture.append((const char *)ring, used - first);
+	ringMutex.unlock();
+	
+	QFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(capture) != capture.size()) {
+		printMessage(QString("Failed to write capture to %1!").arg(fileName));
+		return false;
+	}
+	printMessage(QString("%1 bytes of serial traffic saved to %2.").arg(capture.size() - (int)sizeof(header)).arg(fileName));
+	return true;
+}
@@ -0,0 +1,118 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511CaptureTransport.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 17:30
+ */
+
+#ifndef MCP39F511CAPTURETRANSPORT_H
+#define MCP39F511CAPTURETRANSPORT_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+
+#include "MCP39F511Transport.h"
+
+/* Size in bytes of the RAM ring holding the capture, the oldest records are dropped when it is full */
+#define MCP_CAPTURE_BUFFER_SIZE (256 * 1024)
+/* Identifies a capture file, followed by MCP_CAPTURE_VERSION */
+#define MCP_CAPTURE_MAGIC "MCPC"
+#define MCP_CAPTURE_VERSION 1
+
+typedef enum {
+	CAPTURE_TX,			/* Bytes sent to the MCP39F511 */
+	CAPTURE_RX,			/* Bytes received from the MCP39F511 */
+	CAPTURE_RESET_ON,	/* Reset line asserted, no data */
+	CAPTURE_RESET_OFF	/* Reset line released, no data */
+} mcp39F511_capture_direction;
+
+/**
+ * Capture file header
+ */
+typedef struct __attribute__((packed)) {
+	char magic[4];
+	u_int16_t version;
+	u_int16_t reserved;
+} Mcp39F511CaptureHeader;
+
+/**
+ * Each record in a capture file is this header followed by length bytes of data.
+ * Reads and writes longer than 255 bytes are split over several records.
+ */
+typedef struct __attribute__((packed)) {
+	u_int32_t delta;		/* Microseconds since the previous record, from a monotonic clock */
+	u_int8_t direction;		/* mcp39F511_capture_direction */
+	u_int8_t length;
+} Mcp39F511CaptureRecord;
+
+/**
+ * Transport that sits between MCP39F511Comms and the real transport and records every byte
+ * sent and received, with timestamps, into a ring buffer in RAM.  Nothing touches the file
+ * system until save() is called, so capturing doesn't disturb the serial timing.
+ * The capture can be fed back through the comms with MCP39F511ReplayTransport.
+ */
+class MCP39F511CaptureTransport : public MCP39F511Transport {
+	Q_OBJECT
+	
+public:
+	/**
+	 * @param transport Transport to the MCP39F511, ownership is taken
+	 */
+	MCP39F511CaptureTransport(MCP39F511Transport *transport, QObject *parent);
+	virtual ~MCP39F511CaptureTransport();
+	
+	bool open();
+	void close();
+	bool isOpen();
+	int read(u_int8_t *data, int length);
+	int write(const u_int8_t *data, int length);
+	void flush();
+	void setReset(bool asserted);
+	
+	/**
+	 * Write the capture held in RAM to a file, oldest record first.  Capturing carries on.
+	 * Safe to call from any thread.
+	 * @param fileName File to write, overwritten if it exists
+	 * @return true if the file was written
+	 */
+	bool save(QString fileName);
+	
+private:
+	void record(mcp39F511_capture_direction direction, const u_int8_t *data, int length);
+	void ringWrite(const void *data, int length);
+	void printMessage(QString message);
+	
+	MCP39F511Transport *transport;
+	QElapsedTimer clock;
+	qint64 lastRecordTime;
+	
+	/* Ring of records, head is where the next byte goes and tail the oldest record */
+	QMutex ringMutex;
+	u_int8_t *ring;
+	int head;
+	int tail;
+	int used;
+};
+
+#endif /* MCP39F511CAPTURETRANSPORT_H */
@@ -24,31 +24,32 @@
  * Created on 22 July 2016, 14:02
  */
 
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
+#include <string.h>
+#include <time.h>
 
 #include <QtGlobal>
+#include <QDateTime>
 #include <QDebug>
 #include <QTimer>
 #include <QSharedDataPointer>
 
-extern "C" {
-	#include <wiringSerial.h>
-	#include <wiringPi.h>
-};
-
 #include "MCP39F511Comms.h"
 
 //#define COMMS_DEBUG
 
-/* Service timer in milliseconds */
-#define SERVICE_UPDATE_INTERVAL 50
+/* Run the comms thread with SCHED_FIFO priority, pinned to one core of the H3.
+   Comment out to leave the thread under the default scheduler. */
+#define COMMS_THREAD_REALTIME
+#define COMMS_THREAD_PRIORITY 50
 
-/* Serial port configuration */
-#define SERIAL_PORT (char*)"/dev/ttyS3"
-#define SERIAL_BAUD_RATE 115200
-#define SERIAL_FLAGS 0
+/* Time in milliseconds the MCP39F511 has to respond to a transaction before it is retried */
+#define TRANSACTION_TIMEOUT 100
+/* Flash, EEPROM and auto calibration commands take longer before the MCP39F511 responds */
+#define TRANSACTION_TIMEOUT_LONG 3000
 
 /* MCP39F511 responses */
 #define RESP_ACK 0x06
@@ -68,8 +69,50 @@ typedef struct {
 
 MCP39F511Comms::MCP39F511Comms(QObject *parent) {
 	setParent(parent);
-	serial_handle = 0;
+	transport = NULL;
+	threadCpu = COMMS_THREAD_CPU;
     transaction_id = 1;
+	requestWakePending = 0;
+	completionWakePending = 0;
+	completionBacklogPending = 0;
+	pipelined = false;
+	inFlightQueue.reserve(MCP_PIPELINE_DEPTH);
+	throughputCount = 0;
+	transactionRate = 0;
+	receivedMonotonic = 0;
+	receivedWallClock = 0;
+	
+	/* Monotonic clock used to time how long transactions wait in the queue */
+	queueClock.start();
+	for(int i = 0; i < MCP_PRIORITY_CLASSES; i++) {
+		queueDepth[i] = 0;
+		queueLastWait[i] = 0;
+		queueMaxWait[i] = 0;
+	}
+	
+	/* Deadline timer, started each time a frame is sent to the MCP39F511 */
+	transactionTimer = new QTimer(this);
+	transactionTimer->setSingleShot(true);
+	connect(transactionTimer, SIGNAL(timeout()), this, SLOT(slotTransactionTimeout()));
+	
+	/* Paces out the bytes of a frame when an inter-byte gap is configured */
+	interByteGap = SERIAL_INTER_BYTE_GAP;
+	transmit_length = 0;
+	transmit_position = 0;
+	transmitTimer = new QTimer(this);
+	transmitTimer->setTimerType(Qt::PreciseTimer);
+	connect(transmitTimer, SIGNAL(timeout()), this, SLOT(slotTransmitNextByte()));
+	
+	/* Holds off retries after a failure */
+	retryTimer = new QTimer(this);
+	retryTimer->setSingleShot(true);
+	connect(retryTimer, SIGNAL(timeout()), this, SLOT(service()));
+	resetRecoveryStats();
+	
+	/* Releases the reset line, the event loop keeps running while the MCP39F511 is held */
+	resetTimer = new QTimer(this);
+	resetTimer->setSingleShot(true);
+	connect(resetTimer, SIGNAL(timeout()), this, SLOT(slotResetReleased()));
 }
 
 MCP39F511Comms::~MCP39F511Comms() {
@@ -79,22 +122,51 @@ MCP39F511Comms::~MCP39F511Comms() {
  * Initialise the MCP39F511 energy monitor
  */
 bool MCP39F511Comms::initialise() {
+    configureThread();
+    
+	if(transport == NULL) {
+		printMessage("No transport to the MCP39F511!");
+		return false;
+	}
     resetMCP39F511();
     
-	serial_handle = serialOpen(SERIAL_PORT, SERIAL_BAUD_RATE);
-	if(serial_handle < 0) {
-		printMessage("Failed to open serial port!");
+	if(!transport->open()) {
+		printMessage("Failed to open transport!");
 		return false;	
 	}
 	
-	mcp_command = MCP_CMD_IDLE;
 	receiver_cur_state = RECV_HEADER;
 	
-	QTimer::singleShot(SERVICE_UPDATE_INTERVAL, this, SLOT(service()));
+	/* Service the receiver as soon as bytes arrive rather than polling the serial port */
+	connect(transport, SIGNAL(readyRead()), this, SLOT(slotSerialDataAvailable()));
+	
+	/* Start any transactions queued before the port was opened */
+	QTimer::singleShot(0, this, SLOT(service()));
 
 	return true;
 }
 
+/**
+ * Raise the priority of the comms thread and pin it to its own core
+ * so sample timing is not disturbed by the GUI.
+ */
+void MCP39F511Comms::configureThread() {
+#ifdef COMMS_THREAD_REALTIME
+	struct sched_param schedulerParam;
+	schedulerParam.sched_priority = COMMS_THREAD_PRIORITY;
+	if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &schedulerParam)) {
+		printMessage("Unable to set real-time priority for the comms thread.");
+	}
+	
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(threadCpu, &cpuSet);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet)) {
+		printMessage(QString("Unable to pin the comms thread to CPU %1.").arg(threadCpu));
+	}
+#endif
+}
+
 void MCP39F511Comms::printMessage(QString message) {
 	qDebug() << "MCP39F511 comms: " << message;
 }
@@ -104,122 +176,266 @@ void MCP39F511Comms::printMessage(QString message) {
  * @return Returns TRUE if OK, otherwise FALSE
  */
 bool MCP39F511Comms::close() {
-	serialClose(serial_handle);
+	transmitTimer->stop();
+	transactionTimer->stop();
+	retryTimer->stop();
+	if(transport) {
+		if(resetTimer->isActive()) {
+			resetTimer->stop();
+			transport->setReset(false);
+		}
+		disconnect(transport, SIGNAL(readyRead()), this, SLOT(slotSerialDataAvailable()));
+		transport->close();
+	}
 	return true;
 }
 
-int MCP39F511Comms::sendCommand(mcp39F511_command command) {
-	return enqueTransaction(0, 0, 0, command);
+void MCP39F511Comms::setThreadCpu(int cpu) {
+	threadCpu = cpu;
+}
+
+void MCP39F511Comms::setTransport(MCP39F511Transport *transport) {
+	this->transport = transport;
+	transport->setParent(this);
+}
+
+int MCP39F511Comms::sendCommand(mcp39F511_command command, mcp39F511_priority priority) {
+	return enqueTransaction(0, 0, 0, command, priority);
+}
+
+void MCP39F511Comms::setInterByteGap(int milliseconds) {
+	if(milliseconds < 0) {
+		milliseconds = 0;
+	}
+	interByteGap = milliseconds;
 }
 
 /**
  * Hardware resets the MCP39F511
  */
 void MCP39F511Comms::resetMCP39F511() {
-    /* Set reset pin as an output and set to low (reset state) */
-    pinMode(GPIO_MCP39F511_RESET, OUTPUT);
-	pullUpDnControl(GPIO_MCP39F511_RESET, PUD_OFF);
+	/* Whatever is in flight will not be answered, send it again once the MCP39F511 is running */
+	requeueInFlight();
     /* Pull the reset low */
-	digitalWrite (GPIO_MCP39F511_RESET, LOW);
-    /* Delay 1000 milliseconds between reset */
-	usleep(1000000);
-    /* Release the reset */
-    digitalWrite (GPIO_MCP39F511_RESET, HIGH);
-}
-
-int MCP39F511Comms::enqueTransaction(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_command command) {
-	Mcp39F511Transaction transaction;
-	transaction.command = command;
-	transaction.regAddress = address;
-	/* When performing a read no pointer is supplied so point to the pre-allocated buffer */
-	if(data == NULL) {
-		transaction.dataPtr = transaction.data;
-	} else {
-		transaction.dataPtr = data;
+	transport->setReset(true);
+	resetTimer->start(MCP_RESET_HOLD_TIME);
+}
+
+/**
+ * Releases the MCP39F511 from reset and restarts the queue
+ */
+void MCP39F511Comms::slotResetReleased() {
+	transport->setReset(false);
+	service();
+}
+
+int MCP39F511Comms::enqueTransaction(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_command command,
+									  mcp39F511_priority priority) {
+	int uniqueId;
+	int parts = 1;
+	int partLength = command == MCP_CMD_REGISTER_WRITE ? SERIAL_MAX_LENGTH_TX : SERIAL_MAX_LENGTH_RX;
+	
+	if(command == MCP_CMD_REGISTER_READ || command == MCP_CMD_REGISTER_WRITE) {
+		/* Split register accesses too long for one frame */
+		if(length > partLength) {
+			parts = (length + partLength - 1) / partLength;
+		}
+	} else if(length > SERIAL_MAX_LENGTH_RX) {
+		printMessage(QString("Transaction of %1 bytes is too long.").arg(length));
+		return 0;
+	}
+	
+	/* Queue all the parts or none of them */
+	if(requestQueue.freeSpace() < parts) {
+		printMessage("Request queue full, transaction dropped.");
+		return 0;
 	}
 	
-	transaction.length = length;
-	transaction_id++;
-	transaction.unique_id = transaction_id;
+	uniqueId = transaction_id.fetchAndAddOrdered(1) + 1;
+	for(int part = 0; part < parts; part++) {
+		int offset = part * partLength;
+		Mcp39F511TransactionRef request = Mcp39F511TransactionPool::allocate();
+		Mcp39F511Transaction *transaction = request.writable();
+		transaction->command = command;
+		transaction->priority = priority;
+		transaction->queuedTime = queueClock.nsecsElapsed();
+		transaction->unique_id = uniqueId;
+		transaction->regAddress = address + offset;
+		transaction->dataPtr = data != NULL ? data + offset : NULL;
+		transaction->length = qMin(length - offset, partLength);
+		transaction->partOffset = offset;
+		transaction->lastPart = (part == parts - 1);
+		transaction->retries = 0;
+		transaction->status = COMMS_BUSY;
+		transaction->receivedMonotonic = 0;
+		transaction->receivedWallClock = 0;
+		/* Take a copy of anything to be written so the caller's buffer is free once queued */
+		if(data != NULL && command != MCP_CMD_REGISTER_READ) {
+			memcpy(transaction->data, data + offset, transaction->length);
+		}
+		requestQueue.push(request);
+		queueDepth[priority].ref();
+	}
 #ifdef COMMS_DEBUG
-	qDebug("Write transaction queued: %d, command: 0x%x", transaction_id, (u_int8_t)command);
+	qDebug("Write transaction queued: %d, command: 0x%x", uniqueId, (u_int8_t)command);
 #endif
-	mcp39F511_queue.enqueue(transaction);
-	return transaction_id;
+	
+	/* Wake the comms thread unless a wake up is already on its way */
+	if(requestWakePending.testAndSetOrdered(0, 1)) {
+		QMetaObject::invokeMethod(this, "slotRequestsAvailable", Qt::QueuedConnection);
+	}
+	return uniqueId;
 }
 
-/*
- * Service the MCP39F511 energy monitor
+/**
+ * Runs on the comms thread to move new requests into the transaction queue
  */
-void MCP39F511Comms::service() {
-	static int watchdogTimer = 0;
-	comms_status comms_state = COMMS_COMPLETE;
+void MCP39F511Comms::slotRequestsAvailable() {
+	Mcp39F511TransactionRef transaction;
 	
-	watchdogTimer++;
-	
-	/* Service the receiver */
-	if(mcp_command != MCP_CMD_IDLE) {
-		comms_state = get_mcp39f511_data();
+	/* Clear the flag first so a request pushed while draining triggers another wake up */
+	requestWakePending.storeRelease(0);
+	while(requestQueue.pop(&transaction)) {
+		mcp39F511_queue[transaction->priority].enqueue(transaction);
+	}
+	service();
+}
+
+/**
+ * Hands a completed transaction to the owning thread
+ */
+void MCP39F511Comms::publishCompletion(const Mcp39F511TransactionRef &transaction) {
+	completionBacklog.enqueue(transaction);
+	slotDrainCompletionBacklog();
+}
+
+/**
+ * Moves completions held back while the completion queue was full onto it.
+ * Runs on the comms thread, takeCompletion() calls it again once it has made room.
+ */
+void MCP39F511Comms::slotDrainCompletionBacklog() {
+	/* Set before trying so a completion taken while the queue is full always asks for another drain */
+	completionBacklogPending.storeRelease(1);
+	while(!completionBacklog.isEmpty() && completionQueue.push(completionBacklog.head())) {
+		completionBacklog.dequeue();
+	}
+	if(completionBacklog.isEmpty()) {
+		completionBacklogPending.storeRelease(0);
+	}
+	if(completionWakePending.testAndSetOrdered(0, 1)) {
+		emit completionsAvailable();
+	}
+}
+
+bool MCP39F511Comms::takeCompletion(Mcp39F511TransactionRef *completion) {
+	Mcp39F511Transaction *transaction;
+	bool failed;
 	
-		/* Retry if comms failed or software watchdog times out */
-		if(comms_state == COMMS_FAIL || watchdogTimer > 10) {
-			/* Move to IDLE state if comms failed
-			   Item not dequeued so will get re-tried */
-			watchdogTimer = 0;
-			receiver_cur_state = RECV_HEADER;
-			mcp_command = MCP_CMD_IDLE;
-			printMessage("Packet receive error (NAK 0x15), retrying...");
-			comms_state = COMMS_COMPLETE;
-			
-		} else if(comms_state == COMMS_CHECKSUM_FAIL) {
-			/* Move to IDLE state if checksum failed 
-			   Item not dequeued so will get re-tried */
-			printMessage("Packet checksum error (CSFAIL 0x51), retrying...");
-			comms_state = COMMS_COMPLETE;
-			mcp_command = MCP_CMD_IDLE;
-			
-		} else if(comms_state == COMMS_COMPLETE) {
-			/* Transaction successful so dequeue the item and emit signal with return data */
-			if(!mcp39F511_queue.isEmpty()) {
-				emit(transactionComplete(mcp39F511_queue.dequeue()));
+	/* Parts of a split request can be interleaved with other completions and the last part may
+	   not have been published yet, so whether any part failed is kept by unique_id until it is */
+	while(true) {
+		if(!completionQueue.pop(completion)) {
+			completionWakePending.storeRelease(0);
+			/* A completion may have been published before the flag was cleared */
+			if(!completionQueue.pop(completion)) {
+				return false;
 			}
-			
-			mcp_command = MCP_CMD_IDLE;
 		}
+		/* There is room now for anything held back while the queue was full */
+		if(completionBacklogPending.testAndSetOrdered(1, 0)) {
+			QMetaObject::invokeMethod(this, "slotDrainCompletionBacklog", Qt::QueuedConnection);
+		}
+		/* The comms thread has finished with it once published */
+		transaction = completion->writable();
+
+		/* Copy read data out to the caller's buffer now we are back on its thread */
+		failed = transaction->status != COMMS_COMPLETE;
+		if(!failed && transaction->dataPtr != NULL &&
+		   (transaction->command == MCP_CMD_REGISTER_READ || transaction->command == MCP_CMD_PAGE_READ_EEPROM)) {
+			memcpy(transaction->dataPtr, transaction->data, transaction->length);
+		}
+		if(transaction->lastPart) {
+			break;
+		}
+		splitFailed[transaction->unique_id] |= failed;
+	}
+	
+	/* A split request fails if any part of it did */
+	if(transaction->partOffset != 0 && splitFailed.take(transaction->unique_id)) {
+		failed = true;
+	}
+	if(failed) {
+		transaction->status = COMMS_FAIL;
+	}
+	
+	/* Report a split request as the original */
+	transaction->regAddress -= transaction->partOffset;
+	transaction->length += transaction->partOffset;
+	if(transaction->dataPtr != NULL) {
+		transaction->dataPtr -= transaction->partOffset;
+	}
+	return true;
+}
+
+/*
+ * Transmit the transaction at the head of the queue once the previous one has completed,
+ * or in pipelined mode as soon as the previous response has started to arrive.
+ */
+void MCP39F511Comms::service() {
+	/* Wait for a frame being paced out to finish */
+	if(transport == NULL || !transport->isOpen() || transmitTimer->isActive() || retryTimer->isActive() || resetTimer->isActive()) {
+		return;
 	}
 	
-	/* Perform the next transfer in the queue if the transfer has completed */
-	if(comms_state == COMMS_COMPLETE && !mcp39F511_queue.isEmpty()) {
+	while(canTransmitNext()) {
+		if(inFlightQueue.isEmpty()) {
+			/* Flush out any junk left in the buffer before starting a new transaction */
+			transport->flush();
+			receiver_cur_state = RECV_HEADER;
+		}
 		
-		/* Flush out any junk left in the buffer before starting a new transaction */
-		serialFlush(serial_handle);
+		QQueue<Mcp39F511TransactionRef> *queue = nextQueue();
 		
-		/* Clear the software based watchdog timer */
-		watchdogTimer = 0;
-
-		/* Get the next item from the head of the queue */
-		Mcp39F511Transaction mcp_transaction = mcp39F511_queue.head();
-		mcp_command = mcp_transaction.command;
+		/* Sync points need no serial traffic, the queue ahead of them has drained so complete them now */
+		if(queue->head()->command == MCP_CMD_SYNC) {
+			Mcp39F511TransactionRef sync = takeNext(queue);
+			sync.writable()->status = COMMS_COMPLETE;
+			publishCompletion(sync);
+			continue;
+		}
+		
+		/* Build the frame in place at the tail of the in flight queue from the next item at the head of
+		   the queue, merging any following accesses to neighbouring registers into it, and send it */
+		inFlightQueue.resize(inFlightQueue.size() + 1);
+		Mcp39F511Frame &frame = inFlightQueue.last();
+		frame.requests[0] = takeNext(queue);
+		frame.requestCount = 1;
+		frame.transaction = *frame.requests[0];
+		while(!queue->isEmpty() && canCoalesce(frame, *queue->head())) {
+			coalesce(&frame, takeNext(queue));
+		}
+		Mcp39F511Transaction *transaction = &frame.transaction;
 		
-		switch(mcp_command) {
+		switch(transaction->command) {
 			case MCP_CMD_IDLE:
+			case MCP_CMD_SYNC:
 				/* Must never reach this case! */
 				break;
 				
 			case MCP_CMD_REGISTER_READ:
-				register_read(&mcp_transaction);
+				register_read(transaction);
 				break;
 			
 			case MCP_CMD_REGISTER_WRITE:
-				register_write(&mcp_transaction);
+				register_write(transaction);
 				break;
 
 			case MCP_CMD_PAGE_READ_EEPROM:
-				page_read_eeprom(*(u_int8_t*)mcp_transaction.dataPtr);
+				page_read_eeprom(transaction->data[0]);
 				break;
 				
 			case MCP_CMD_PAGE_WRITE_EEPROM:
-				send_frame(MCP_CMD_PAGE_WRITE_EEPROM, (u_int8_t*) mcp_transaction.dataPtr, mcp_transaction.length, false);
+				send_frame(MCP_CMD_PAGE_WRITE_EEPROM, transaction->data, transaction->length);
 				break;
 				
 			/* Commands that do not need further processing */
@@ -229,22 +445,375 @@ void MCP39F511Comms::service() {
 			case MCP_CMD_AUTO_CALIBRATE_GAIN:
 			case MCP_CMD_BULK_ERASE_EEPROM:
 			case MCP_CMD_SAVE_REGISTERS_TO_FLASH:
-				send_frame(mcp_command, (u_int8_t*) mcp_transaction.dataPtr, mcp_transaction.length, false);
+				send_frame(transaction->command, transaction->data, transaction->length);
 				break;
 		}
+		
+		/* Only one frame can be paced out at a time */
+		if(transmitTimer->isActive()) {
+			break;
+		}
+	}
+}
+
+/**
+ * @return The highest priority queue with anything waiting, NULL if all are empty
+ */
+QQueue<Mcp39F511TransactionRef> *MCP39F511Comms::nextQueue() {
+	for(int i = 0; i < MCP_PRIORITY_CLASSES; i++) {
+		if(!mcp39F511_queue[i].isEmpty()) {
+			return &mcp39F511_queue[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Takes the transaction at the head of a queue and records how long it waited
+ */
+Mcp39F511TransactionRef MCP39F511Comms::takeNext(QQueue<Mcp39F511TransactionRef> *queue) {
+	Mcp39F511TransactionRef transaction = queue->dequeue();
+	int wait = (int)((queueClock.nsecsElapsed() - transaction->queuedTime) / 1000);
+	
+	queueDepth[transaction->priority].deref();
+	queueLastWait[transaction->priority].storeRelease(wait);
+	if(wait > queueMaxWait[transaction->priority].loadAcquire()) {
+		queueMaxWait[transaction->priority].storeRelease(wait);
+	}
+	return transaction;
+}
+
+/**
+ * Puts a transaction back at the head of its queue to be re-tried
+ */
+void MCP39F511Comms::requeue(const Mcp39F511TransactionRef &transaction) {
+	mcp39F511_queue[transaction->priority].prepend(transaction);
+	queueDepth[transaction->priority].ref();
+}
+
+/**
+ * Checks whether the next queued transaction can be sent now
+ * @return true if the next transaction can be transmitted
+ */
+bool MCP39F511Comms::canTransmitNext() {
+	QQueue<Mcp39F511TransactionRef> *queue = nextQueue();
+	if(queue == NULL) {
+		return false;
+	}
+	if(inFlightQueue.isEmpty()) {
+		return true;
+	}
+	
+	/* Pipelining only overlaps independent register accesses, and only once the MCP39F511
+	   has started responding to the frame in front so it has finished with its receive buffer */
+	return pipelined &&
+		   inFlightQueue.size() < MCP_PIPELINE_DEPTH &&
+		   receiver_cur_state != RECV_HEADER &&
+		   isPipelineable(inFlightQueue.last().transaction.command) &&
+		   isPipelineable(queue->head()->command);
+}
+
+/**
+ * Checks whether a queued transaction can be merged into a frame.
+ * Only reads with reads and writes with writes, and only where the registers touch or overlap
+ * and the result still fits in one frame.  Writes carry more around the data so fit less of it.
+ */
+bool MCP39F511Comms::canCoalesce(const Mcp39F511Frame &frame, const Mcp39F511Transaction &next) {
+	const Mcp39F511Transaction &current = frame.transaction;
+	if(frame.requestCount >= MCP_MAX_COALESCE || next.command != current.command || !isPipelineable(next.command)) {
+		return false;
+	}
+	int start = qMin(current.regAddress, next.regAddress);
+	int end = qMax(current.regAddress + current.length, next.regAddress + next.length);
+	if(next.regAddress > current.regAddress + current.length || next.regAddress + next.length < current.regAddress) {
+		return false;
 	}
+	return end - start <= (next.command == MCP_CMD_REGISTER_WRITE ? SERIAL_MAX_LENGTH_TX : SERIAL_MAX_LENGTH_RX);
+}
+
+/**
+ * Merge a transaction into a frame, canCoalesce() must have been checked first.
+ * Overlapping writes are applied in queue order so the later data wins.
+ */
+void MCP39F511Comms::coalesce(Mcp39F511Frame *frame, const Mcp39F511TransactionRef &next) {
+	Mcp39F511Transaction *current = &frame->transaction;
+	int start = qMin(current->regAddress, next->regAddress);
+	int end = qMax(current->regAddress + current->length, next->regAddress + next->length);
 	
-	QTimer::singleShot(SERVICE_UPDATE_INTERVAL, this, SLOT(service()));
+	if(current->command == MCP_CMD_REGISTER_WRITE) {
+		if(start < current->regAddress) {
+			memmove(&current->data[current->regAddress - start], current->data, current->length);
+		}
+		memcpy(&current->data[next->regAddress - start], next->data, next->length);
+	}
+	current->regAddress = start;
+	current->length = end - start;
+	frame->requests[frame->requestCount++] = next;
+}
+
+/**
+ * Pass back each request sent in a frame, reads get their own slice of the data received.
+ */
+void MCP39F511Comms::completeFrame(Mcp39F511Frame &frame) {
+	for(int i = 0; i < frame.requestCount; i++) {
+		Mcp39F511Transaction *request = frame.requests[i].writable();
+		if(request->command == MCP_CMD_REGISTER_READ) {
+			memcpy(request->data, &frame.transaction.data[request->regAddress - frame.transaction.regAddress], request->length);
+		} else if(request->command == MCP_CMD_PAGE_READ_EEPROM) {
+			memcpy(request->data, frame.transaction.data, receiver_data_count);
+			request->length = receiver_data_count;
+		}
+		request->status = COMMS_COMPLETE;
+		request->receivedMonotonic = receivedMonotonic;
+		request->receivedWallClock = receivedWallClock;
+		publishCompletion(frame.requests[i]);
+	}
+}
+
+/**
+ * Register reads and writes are independent of each other once the previous one has been
+ * acknowledged.  Flash, EEPROM and calibration commands keep the MCP39F511 busy so are never overlapped.
+ */
+bool MCP39F511Comms::isPipelineable(mcp39F511_command command) {
+	return command == MCP_CMD_REGISTER_READ || command == MCP_CMD_REGISTER_WRITE;
+}
+
+/**
+ * Called by the socket notifier when bytes are waiting on the serial port.
+ * Everything available is read in one go and fed to the receiver state machine.
+ * Responses are matched in order against the transactions in flight.
+ */
+void MCP39F511Comms::slotSerialDataAvailable() {
+	comms_status comms_state;
+	int offset = 0;
+	int consumed = 0;
+	int bytes_read = transport->read(receive_buffer, SERIAL_RECEIVE_BUFFER_SIZE);
+	
+	if(bytes_read <= 0) {
+		return;
+	}
+	
+	/* Stamp the responses once, as close to their arrival as the comms thread sees it */
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	receivedMonotonic = (qint64)now.tv_sec * 1000000000 + now.tv_nsec;
+	receivedWallClock = QDateTime::currentMSecsSinceEpoch();
+	
+	/* Bytes received outside of a transaction are junk so drop them */
+	while(offset < bytes_read && !inFlightQueue.isEmpty()) {
+		comms_state = get_mcp39f511_data(&receive_buffer[offset], bytes_read - offset, &consumed);
+		offset += consumed;
+		
+		if(comms_state == COMMS_BUSY) {
+			/* Wait for the rest of the response */
+			break;
+		}
+		
+		receiver_cur_state = RECV_HEADER;
+		
+		if(comms_state == COMMS_COMPLETE) {
+			/* Transaction successful so dequeue the frame and pass back each request with any data read */
+			completeFrame(inFlightQueue.first());
+			inFlightQueue.removeFirst();
+			updateThroughput();
+			updateRecovery();
+			
+			/* Restart the deadline for the next response in flight */
+			transactionTimer->stop();
+			if(!inFlightQueue.isEmpty()) {
+				transactionTimer->start(transactionDeadline(inFlightQueue.first().transaction.command));
+			}
+		} else {
+			if(comms_state == COMMS_CHECKSUM_FAIL) {
+				printMessage("Packet checksum error (CSFAIL 0x51), retrying...");
+			} else {
+				printMessage("Packet receive error (NAK 0x15), retrying...");
+			}
+			/* Anything following the failed response can't be trusted */
+			retryInFlight();
+			break;
+		}
+	}
+	
+	/* Perform the next transfer in the queue */
+	service();
+}
+
+/**
+ * Called when the MCP39F511 has not responded to a transaction in time.
+ */
+void MCP39F511Comms::slotTransactionTimeout() {
+	printMessage("Response timed out, retrying...");
+	retryInFlight();
+	service();
+}
+
+/**
+ * Puts every request in flight back at the head of the queue, in order, so they get re-tried.
+ * The frame at the head is the one that failed, its requests are given up on once they have
+ * been tried MCP_MAX_RETRIES times.  Retrying is held off for an exponentially increasing time.
+ */
+void MCP39F511Comms::retryInFlight() {
+	int retries = 0;
+	
+	if(inFlightQueue.isEmpty()) {
+		requeueInFlight();
+		return;
+	}
+	if(failureStartTime < 0) {
+		failureStartTime = queueClock.nsecsElapsed();
+	}
+	failureCount.ref();
+	
+	/* Count the attempt against the requests in the frame that failed */
+	for(int i = 0; i < inFlightQueue.first().requestCount; i++) {
+		retries = ++inFlightQueue.first().requests[i].writable()->retries;
+	}
+	requeueInFlight();
+	
+	/* Back off before retrying */
+	retryTimer->start(qMin(MCP_RETRY_BACKOFF_BASE << (retries - 1), MCP_RETRY_BACKOFF_MAX));
+}
+
+/**
+ * Stops anything being sent or received and puts every request in flight back at the head of
+ * its queue, in order.  Requests that have used up their retries are reported as failed.
+ */
+void MCP39F511Comms::requeueInFlight() {
+	transmitTimer->stop();
+	transactionTimer->stop();
+	receiver_cur_state = RECV_HEADER;
+	
+	while(!inFlightQueue.isEmpty()) {
+		Mcp39F511Frame &frame = inFlightQueue.last();
+		while(frame.requestCount > 0) {
+			Mcp39F511TransactionRef &request = frame.requests[--frame.requestCount];
+			if(request->retries > MCP_MAX_RETRIES) {
+				printMessage(QString("Transaction %1 failed after %2 retries.").arg(request->unique_id).arg(MCP_MAX_RETRIES));
+				request.writable()->status = COMMS_FAIL;
+				abandonedCount.ref();
+				publishCompletion(request);
+			} else {
+				requeue(request);
+			}
+		}
+		inFlightQueue.removeLast();
+	}
+}
+
+/**
+ * Records the time taken to recover from a failure once a transaction succeeds
+ */
+void MCP39F511Comms::updateRecovery() {
+	if(failureStartTime < 0) {
+		return;
+	}
+	int recovery = (int)((queueClock.nsecsElapsed() - failureStartTime) / 1000);
+	failureStartTime = -1;
+	
+	recoveryCount.ref();
+	recoveryTotal += recovery;
+	recoveryMean.storeRelease((int)(recoveryTotal / recoveryCount.loadAcquire()));
+	if(recovery > recoveryMax.loadAcquire()) {
+		recoveryMax.storeRelease(recovery);
+	}
+}
+
+Mcp39F511RecoveryStats MCP39F511Comms::getRecoveryStats() {
+	Mcp39F511RecoveryStats stats;
+	stats.failures = failureCount.loadAcquire();
+	stats.abandoned = abandonedCount.loadAcquire();
+	stats.recoveries = recoveryCount.loadAcquire();
+	stats.meanRecovery = recoveryMean.loadAcquire();
+	stats.maxRecovery = recoveryMax.loadAcquire();
+	return stats;
+}
+
+void MCP39F511Comms::resetRecoveryStats() {
+	failureStartTime = -1;
+	failureCount = 0;
+	abandonedCount = 0;
+	recoveryCount = 0;
+	recoveryTotal = 0;
+	recoveryMean = 0;
+	recoveryMax = 0;
+}
+
+/**
+ * @return true if the MCP39F511 responds to the command with data as well as an ACK
+ */
+bool MCP39F511Comms::expectsData(mcp39F511_command command) {
+	return command == MCP_CMD_REGISTER_READ || command == MCP_CMD_PAGE_READ_EEPROM;
+}
+
+/**
+ * Counts completed transactions and recalculates the transactions per second every COMMS_THROUGHPUT_INTERVAL
+ */
+void MCP39F511Comms::updateThroughput() {
+	if(!throughputTimer.isValid()) {
+		throughputTimer.start();
+		throughputCount = 0;
+		return;
+	}
+	throughputCount++;
+	qint64 elapsed = throughputTimer.elapsed();
+	if(elapsed >= COMMS_THROUGHPUT_INTERVAL) {
+		transactionRate.storeRelease((int)(throughputCount * 1000 * 1000 / elapsed));
+#ifdef COMMS_DEBUG
+		qDebug("Comms throughput: %.1f transactions/s", getTransactionRate());
+		for(int i = 0; i < MCP_PRIORITY_CLASSES; i++) {
+			Mcp39F511QueueStats stats = getQueueStats((mcp39F511_priority)i);
+			qDebug("Priority %d: depth %d, wait %d us, max wait %d us", i, stats.depth, stats.lastWait, stats.maxWait);
+		}
+#endif
+		throughputCount = 0;
+		throughputTimer.restart();
+	}
+}
+
+double MCP39F511Comms::getTransactionRate() {
+	return transactionRate.loadAcquire() / (double)1000;
+}
+
+Mcp39F511QueueStats MCP39F511Comms::getQueueStats(mcp39F511_priority priority) {
+	Mcp39F511QueueStats stats;
+	stats.depth = queueDepth[priority].loadAcquire();
+	stats.lastWait = queueLastWait[priority].loadAcquire();
+	stats.maxWait = queueMaxWait[priority].loadAcquire();
+	return stats;
+}
+
+void MCP39F511Comms::setPipelined(bool enabled) {
+	pipelined = enabled;
+	service();
+}
+
+/**
+ * Time allowed for the MCP39F511 to respond to a command
+ * @param command MCP39F511 command being sent
+ * @return Deadline in milliseconds
+ */
+int MCP39F511Comms::transactionDeadline(mcp39F511_command command) {
+	switch(command) {
+		case MCP_CMD_SAVE_REGISTERS_TO_FLASH:
+		case MCP_CMD_PAGE_WRITE_EEPROM:
+		case MCP_CMD_BULK_ERASE_EEPROM:
+		case MCP_CMD_AUTO_CALIBRATE_GAIN:
+		case MCP_CMD_AUTO_CALIBRATE_REACTIVE_GAIN:
+		case MCP_CMD_AUTO_CALIBRATE_FREQUENCY:
+			return TRANSACTION_TIMEOUT_LONG;
+		default:
+			return TRANSACTION_TIMEOUT;
+	}
 }
 
 bool MCP39F511Comms::register_read(Mcp39F511Transaction *transaction) {
-	receiver_data_ptr = (u_int8_t *)transaction->dataPtr;
 	u_int8_t buffer[4];
 	buffer[0] = (transaction->regAddress >> 8) & 0xFF;
 	buffer[1] = transaction->regAddress & 0xFF;
 	buffer[2] = MCP_CMD_REGISTER_READ;
 	buffer[3] = transaction->length;
-	return send_frame(MCP_CMD_SET_ADDRESS_POINTER, buffer, 4, true);
+	return send_frame(MCP_CMD_SET_ADDRESS_POINTER, buffer, 4);
 }
 
 bool MCP39F511Comms::register_write(Mcp39F511Transaction *transaction) {
@@ -259,24 +828,24 @@ bool MCP39F511Comms::register_write(Mcp39F511Transaction *transaction) {
 	buffer[i++] = transaction->length;
 	
 	for(j=0; j<transaction->length; j++) {
-		byte_ptr = (u_int8_t *)transaction->dataPtr;
+		byte_ptr = (u_int8_t *)transaction->data;
 		buffer[i++] = byte_ptr[j];
 	}
-	return send_frame(MCP_CMD_SET_ADDRESS_POINTER, buffer, frame_length, false);
+	return send_frame(MCP_CMD_SET_ADDRESS_POINTER, buffer, frame_length);
 }
 
 bool MCP39F511Comms::set_address_pointer(u_int16_t address) {
 	u_int8_t buffer[2];
 	buffer[0] = (address >> 8) & 0xFF;
 	buffer[1] = address & 0xFF;
-	return send_frame(MCP_CMD_SET_ADDRESS_POINTER, buffer, 2, false);
+	return send_frame(MCP_CMD_SET_ADDRESS_POINTER, buffer, 2);
 }
 
 
 bool MCP39F511Comms::page_read_eeprom(u_int8_t page) {
 	u_int8_t buffer[1];
 	buffer[0] = page;
-	return send_frame(MCP_CMD_PAGE_READ_EEPROM, buffer, 1, true);
+	return send_frame(MCP_CMD_PAGE_READ_EEPROM, buffer, 1);
 }
 
 /**
@@ -284,38 +853,84 @@ bool MCP39F511Comms::page_read_eeprom(u_int8_t page) {
  * @param command A valid command from the MCP39F511 instruction set
  * @param data Pointer to u_int8_t array of bytes to send
  * @param length Number of bytes to send
- * @param read true if the command returns more than just an ack
  * @return TRUE if frame sent successfully, FALSE if not
  */
-bool MCP39F511Comms::send_frame(u_int8_t command, u_int8_t *data, int length, bool read) {
+bool MCP39F511Comms::send_frame(u_int8_t command, u_int8_t *data, int length) {
 	int i = 0;
 	int j = 0;
 	int frame_length = length + 4;
-	u_int8_t buffer[frame_length];
 	
-	serial_read = read;
+	if(frame_length > SERIAL_MAX_FRAME_LENGTH) {
+		printMessage("Frame too long to send.");
+		return false;
+	}
 	
-	buffer[i++] = FRAME_HEADER;
-	buffer[i++] = frame_length;
-	buffer[i++] = command;
+	transmit_buffer[i++] = FRAME_HEADER;
+	transmit_buffer[i++] = frame_length;
+	transmit_buffer[i++] = command;
 	
-	for(j=0; j<length + 1; j++) {
-		buffer[i++] = data[j];
+	for(j=0; j<length; j++) {
+		transmit_buffer[i++] = data[j];
 	}
 	
-	buffer[frame_length - 1] = calculate_checksum(buffer, frame_length - 1);
-	
-	for(i=0; i<frame_length; i++) {
-		/* Delay 2 ms between bytes as the MCP39F511 can't keep up otherwise */
-		usleep(2000);
+	transmit_buffer[frame_length - 1] = calculate_checksum(transmit_buffer, frame_length - 1);
+	transmit_length = frame_length;
+	transmit_position = 0;
+
 #ifdef COMMS_DEBUG
-        qDebug("byte tx: 0x%x", buffer[i]);
+	for(i=0; i<frame_length; i++) {
+        qDebug("byte tx: 0x%x", transmit_buffer[i]);
+	}
 #endif
-		serialPutchar(serial_handle, buffer[i]);
+
+	if(interByteGap == 0) {
+		/* Send the whole frame in one go */
+		while(transmit_position < transmit_length) {
+			int written = transport->write(&transmit_buffer[transmit_position], transmit_length - transmit_position);
+			if(written < 0) {
+				printMessage("Serial port write failed.");
+				break;
+			}
+			transmit_position += written;
+		}
+		transmitComplete();
+	} else {
+		/* Send the first byte now and the remainder paced out by the transmit timer */
+		slotTransmitNextByte();
+		if(transmit_position < transmit_length) {
+			transmitTimer->start(interByteGap);
+		}
 	}
 	return true;
 }
 
+/**
+ * Writes the next byte of the frame being paced out to the MCP39F511
+ */
+void MCP39F511Comms::slotTransmitNextByte() {
+	if(transmit_position < transmit_length) {
+		if(transport->write(&transmit_buffer[transmit_position], 1) == 1) {
+			transmit_position++;
+		}
+	}
+	if(transmit_position >= transmit_length) {
+		transmitTimer->stop();
+		transmitComplete();
+		/* A pipelined frame may be waiting for the transmitter */
+		service();
+	}
+}
+
+/**
+ * Called once the last byte of a frame has been handed to the serial port
+ */
+void MCP39F511Comms::transmitComplete() {
+	/* Arm the deadline for the response unless one is already running for an earlier frame */
+	if(!transactionTimer->isActive() && !inFlightQueue.isEmpty()) {
+		transactionTimer->start(transactionDeadline(inFlightQueue.first().transaction.command));
+	}
+}
+
 u_int8_t MCP39F511Comms::calculate_checksum(u_int8_t *pkt, int length) {
 	int i = 0;
 	u_int8_t checksum = 0;
@@ -329,80 +944,79 @@ u_int8_t MCP39F511Comms::calculate_checksum(u_int8_t *pkt, int length) {
 	return checksum;
 }
 
-comms_status MCP39F511Comms::get_mcp39f511_data() {
-	int read_byte = 0;
+/**
+ * Runs received bytes through the receiver state machine for the transaction at the head of the in flight queue
+ * @param data Bytes read from the serial port
+ * @param length Number of bytes in data
+ * @param consumed Set to the number of bytes used, any remaining belong to the next response
+ * @return COMMS_BUSY until a full response has been received
+ */
+comms_status MCP39F511Comms::get_mcp39f511_data(u_int8_t *data, int length, int *consumed) {
 	int8_t cur_byte = 0;
+	int i = 0;
 	
-	int bytes_available = serialDataAvail(serial_handle);
-	
-	if(bytes_available < 0) {
-		return COMMS_FAIL;
-	} else {
-		while(bytes_available > 0) {
-			bytes_available--;
-			read_byte = serialGetchar(serial_handle);
-			
-			/* Check if serial port threw an error when reading it */
-			if(read_byte < 0) {
-				return COMMS_FAIL;
-				break;
-			}
-			
-			/* Ensure we only process the lowest byte read in from serial port */
-			cur_byte = (int8_t) (read_byte & 0xFF);
+	while(i < length) {
+		cur_byte = (int8_t) data[i++];
+		*consumed = i;
 #ifdef COMMS_DEBUG
-			qDebug("byte rx: 0x%x", (u_int8_t)cur_byte);
+		qDebug("byte rx: 0x%x", (u_int8_t)cur_byte);
 #endif
-			switch(receiver_cur_state) {
-				case RECV_HEADER:
-					receiver_checksum = cur_byte;
-					if(cur_byte == RESP_NAK) {
-						return COMMS_FAIL;
-					}
-					if(cur_byte == RESP_CSFAIL) {
-						return COMMS_CHECKSUM_FAIL;
-					}
-					if(cur_byte == RESP_ACK) {
+		switch(receiver_cur_state) {
+			case RECV_HEADER:
+				receiver_checksum = cur_byte;
+				if(cur_byte == RESP_NAK) {
+					return COMMS_FAIL;
+				}
+				if(cur_byte == RESP_CSFAIL) {
+					return COMMS_CHECKSUM_FAIL;
+				}
+				if(cur_byte == RESP_ACK) {
 #ifdef COMMS_DEBUG
-                        qDebug("Transaction complete: %d", mcp39F511_queue.head().unique_id);
+					qDebug("Transaction complete: %d", inFlightQueue.first().transaction.unique_id);
 #endif
-						if(serial_read == false) {
-							return COMMS_COMPLETE;
-						} else {
-							receiver_cur_state = RECV_NUM_BYTES;
-						}
-					}
-					break;
-				
-				case RECV_NUM_BYTES:
-					receiver_packet_length = cur_byte;
-					receiver_checksum += cur_byte;
-					receiver_cur_state = RECV_DATA;
-					break;
-					
-				case RECV_DATA:
-					receiver_checksum += cur_byte;
-					receiver_packet_length--;
-					*receiver_data_ptr = cur_byte;
-					receiver_data_ptr++;
-					if(receiver_packet_length - 3 == 0) {
-						receiver_cur_state = RECV_CHECKSUM;
-					}
-					break;
-					
-				case RECV_CHECKSUM:
-					receiver_cur_state = RECV_HEADER;
-					// take the modulus after dividing by 256
-					receiver_checksum &= 0xFF;
-					if(cur_byte == (int8_t) receiver_checksum) {
+					if(!expectsData(inFlightQueue.first().transaction.command)) {
 						return COMMS_COMPLETE;
 					} else {
-						printMessage("Receive checksum failed.");
-						return COMMS_FAIL;
+						receiver_data_ptr = inFlightQueue.first().transaction.data;
+						receiver_data_count = 0;
+						receiver_cur_state = RECV_NUM_BYTES;
 					}
-					break;
-			}
-		}	
-		return COMMS_BUSY;
+				}
+				break;
+			
+			case RECV_NUM_BYTES:
+				receiver_packet_length = cur_byte;
+				receiver_checksum += cur_byte;
+				receiver_cur_state = RECV_DATA;
+				break;
+				
+			case RECV_DATA:
+				if(receiver_data_count >= SERIAL_MAX_LENGTH_RX) {
+					printMessage("Receive buffer overflow.");
+					return COMMS_FAIL;
+				}
+				receiver_checksum += cur_byte;
+				receiver_packet_length--;
+				*receiver_data_ptr = cur_byte;
+				receiver_data_ptr++;
+				receiver_data_count++;
+				if(receiver_packet_length - 3 == 0) {
+					receiver_cur_state = RECV_CHECKSUM;
+				}
+				break;
+				
+			case RECV_CHECKSUM:
+				receiver_cur_state = RECV_HEADER;
+				// take the modulus after dividing by 256
+				receiver_checksum &= 0xFF;
+				if(cur_byte == (int8_t) receiver_checksum) {
+					return COMMS_COMPLETE;
+				} else {
+					printMessage("Receive checksum failed.");
+					return COMMS_FAIL;
+				}
+				break;
+		}
 	}
+	return COMMS_BUSY;
 }
@@ -27,19 +27,68 @@
 #ifndef MCP39F511COMMS_H
 #define MCP39F511COMMS_H
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
 #include <QQueue>
 #include <QSharedData>
+#include <QTimer>
+#include <QVector>
+
+#include "BufferPool.h"
+#include "LockFreeQueue.h"
+#include "MCP39F511Transport.h"
 
 /* Maximum number of bytes that can be read from the MCP39F511 in one go (32 bytes)
    Any more than this will need to be split into separate transactions
  */
 #define SERIAL_MAX_LENGTH_RX 0x20
 
-/**
- * Defines the GPIO pin used to reset the MCP39F511
- */
-#define GPIO_MCP39F511_RESET 1
+/* Maximum number of register bytes written to the MCP39F511 in one go (27 bytes), a write
+   frame carries 8 bytes of header, address, command and checksum around the data */
+#define SERIAL_MAX_LENGTH_TX (SERIAL_MAX_FRAME_LENGTH - 8)
+
+/* Size of the buffer used to bulk read bytes from the serial port */
+#define SERIAL_RECEIVE_BUFFER_SIZE 256
+
+/* Longest frame the MCP39F511 accepts (35 bytes), also the size of the transmit frame buffer */
+#define SERIAL_MAX_FRAME_LENGTH 0x23
+
+/* Number of transactions in the pool shared by the queues, comms thread and receivers */
+#define MCP_TRANSACTION_POOL_SIZE 256
+
+/* Maximum number of queued requests merged into one frame */
+#define MCP_MAX_COALESCE 8
+
+/* Number of requests / completed transactions that can be waiting to cross between threads */
+#define COMMS_HANDOFF_QUEUE_SIZE 64
+
+/* Maximum number of frames sent to the MCP39F511 before the first has been fully answered */
+#define MCP_PIPELINE_DEPTH 2
+
+/* Number of times a transaction is retried before it is reported as failed */
+#define MCP_MAX_RETRIES 5
+
+/* Retries are held off for MCP_RETRY_BACKOFF_BASE milliseconds, doubling with each
+   consecutive failure of the same transaction up to MCP_RETRY_BACKOFF_MAX */
+#define MCP_RETRY_BACKOFF_BASE 2
+#define MCP_RETRY_BACKOFF_MAX 100
+
+/* Time in milliseconds the MCP39F511 is held in reset, nothing is sent until it is released */
+#define MCP_RESET_HOLD_TIME 1000
+
+/* Cores of the H3 the comms threads are pinned to, the first MCP39F511 gets COMMS_THREAD_CPU and
+   each one after the next core down, wrapping after COMMS_THREAD_CPUS so core 0 is left to the GUI */
+#define COMMS_THREAD_CPU 3
+#define COMMS_THREAD_CPUS 3
+
+/* Interval in milliseconds over which the transaction rate is measured */
+#define COMMS_THROUGHPUT_INTERVAL 5000
+
+/* Default gap in milliseconds between transmitted bytes, the MCP39F511 can't keep up otherwise.
+   0 writes the whole frame to the serial port in one go, not yet checked on hardware. */
+#define SERIAL_INTER_BYTE_GAP 2
 
 typedef enum {
 	COMMS_BUSY,
@@ -52,6 +101,7 @@ typedef enum {
 /* MCP39F511 command bytes */
 typedef enum {
 	MCP_CMD_IDLE,
+	MCP_CMD_SYNC = 0x01, /* Not sent, completes in queue order once everything before it has */
 	MCP_CMD_REGISTER_READ = 0x4E,
 	MCP_CMD_REGISTER_WRITE = 0x4D,
 	MCP_CMD_SET_ADDRESS_POINTER = 0x41,
@@ -64,6 +114,36 @@ typedef enum {
 	MCP_CMD_AUTO_CALIBRATE_FREQUENCY = 0x76
 } mcp39F511_command;
 
+/* Transaction priority classes, the highest priority queued transaction is always sent next */
+typedef enum {
+	MCP_PRIORITY_MEASUREMENT,	/* Real-time measurement reads */
+	MCP_PRIORITY_CONTROL,		/* Register writes, configuration and calibration */
+	MCP_PRIORITY_BACKGROUND,	/* Long running jobs such as EEPROM access */
+	MCP_PRIORITY_CLASSES
+} mcp39F511_priority;
+
+/**
+ * Queue statistics for one priority class.
+ * Wait time is from being queued to being sent to the MCP39F511, in microseconds.
+ */
+typedef struct {
+	int depth;
+	int lastWait;
+	int maxWait;
+} Mcp39F511QueueStats;
+
+/**
+ * Link failure statistics.  A recovery is timed from the first failure to the next
+ * transaction that succeeds, in microseconds.
+ */
+typedef struct {
+	int failures;
+	int abandoned;
+	int recoveries;
+	int meanRecovery;
+	int maxRecovery;
+} Mcp39F511RecoveryStats;
+
 typedef enum {
 	RECV_HEADER,
 	RECV_NUM_BYTES,
@@ -72,6 +152,18 @@ typedef enum {
 
 } receive_state;
 
+/**
+ * A single transaction with the MCP39F511.
+ * Data to write is copied into data when the transaction is queued and data read back
+ * is received into data, so the comms thread never touches the caller's memory.
+ * For reads dataPtr is where the result is copied to when the completion is taken
+ * and length is updated to the number of bytes received.
+ * Register reads longer than SERIAL_MAX_LENGTH_RX and writes longer than SERIAL_MAX_LENGTH_TX
+ * are split into parts sharing the
+ * same unique_id, partOffset is the part's offset into the original request.
+ * status is COMMS_COMPLETE on success or COMMS_FAIL once MCP_MAX_RETRIES have been used up,
+ * in which case no data is copied to dataPtr.
+ */
 typedef struct {
 	u_int16_t regAddress;
 	u_int8_t data[SERIAL_MAX_LENGTH_RX];
@@ -79,8 +171,45 @@ typedef struct {
 	u_int8_t length;
 	mcp39F511_command command;
 	int unique_id;
+	u_int8_t partOffset;
+	bool lastPart;
+	mcp39F511_priority priority;
+	qint64 queuedTime;
+	int retries;
+	comms_status status;
+	/* When the response was received, only valid for COMMS_COMPLETE register reads and writes */
+	qint64 receivedMonotonic;	/* CLOCK_MONOTONIC, nanoseconds */
+	qint64 receivedWallClock;	/* Milliseconds since the epoch */
 } Mcp39F511Transaction;
 
+/**
+ * Transactions live in a fixed pool and are passed between threads and on to receivers by
+ * reference, so the polling path neither allocates nor copies them.  Receivers get a read-only view.
+ */
+class MCP39F511Comms;
+typedef BufferPool<Mcp39F511Transaction, MCP_TRANSACTION_POOL_SIZE, MCP39F511Comms> Mcp39F511TransactionPool;
+typedef Mcp39F511TransactionPool::Ref Mcp39F511TransactionRef;
+Q_DECLARE_TYPEINFO(Mcp39F511TransactionRef, Q_MOVABLE_TYPE);
+
+/**
+ * A frame sent to the MCP39F511.  Queued register reads or writes of adjacent or
+ * overlapping ranges are merged into one frame, requests holds the originals so each
+ * can be completed individually.
+ */
+typedef struct {
+	Mcp39F511Transaction transaction;
+	Mcp39F511TransactionRef requests[MCP_MAX_COALESCE];
+	int requestCount;
+} Mcp39F511Frame;
+
+/**
+ * Serial comms with the MCP39F511.
+ * The object is moved onto its own thread by MCP39F511Interface so all serial I/O, framing
+ * and retries run independently of the GUI.  Requests and completed transactions are
+ * handed across threads through single producer, single consumer lock free queues.
+ * enqueTransaction(), sendCommand() and takeCompletion() are called from the owning
+ * (GUI) thread, everything else runs on the comms thread.
+ */
 class MCP39F511Comms : public QObject {
 	Q_OBJECT
 	
@@ -89,65 +218,208 @@ public:
 	virtual ~MCP39F511Comms();
 
 	/* Initialise the energy monitor */
-	bool initialise();
+	Q_INVOKABLE bool initialise();
 
     /**
      * Hardware resets the MCP39F511.
-     * It appears comms still operates when the chip is held in reset.
+     * Returns straight away, the reset is released MCP_RESET_HOLD_TIME later and the queue
+     * is held until then.  Anything in flight is sent again afterwards.
      */
-    void resetMCP39F511();
+    Q_INVOKABLE void resetMCP39F511();
     
 	/**
 	 * Close the MCP39F511 serial port
 	 * @return Returns TRUE if OK, otherwise FALSE
 	 */
-	bool close();
+	Q_INVOKABLE bool close();
 	
 	/**
-	 * Enqueues a read or write to the MCP39F511
+	 * Set how the MCP39F511 is reached, must be called before initialise().
+	 * @param transport Transport to use, ownership is taken.
+	 */
+	void setTransport(MCP39F511Transport *transport);
+	
+	/**
+	 * Set the core the comms thread is pinned to, must be called before initialise().
+	 * @param cpu Core number, COMMS_THREAD_CPU by default
+	 */
+	void setThreadCpu(int cpu);
+	
+	/**
+	 * Enqueues a read or write to the MCP39F511.
+	 * Register reads and writes of any length are split into frames of at most SERIAL_MAX_LENGTH_RX
+	 * bytes read or SERIAL_MAX_LENGTH_TX bytes written, only one completion is reported once all
+	 * of them are done.
 	 * @param address Address in memory to access.  Set to 0 if the command does not require it.
-	 * @param data Data pointer to read from when writing to MCP39F511.
-	 * When reading from MCP39F511 an internal buffer will be used so a copy is made when the signal is emitted.
+	 * @param data Data pointer to read from when writing to MCP39F511, the data is copied when queued.
+	 * When reading from MCP39F511 the result is copied here by takeCompletion().
 	 * @param length Length of the data to read or write.
 	 * @param command MCP39F511 command to use.
-	 * @return Unique ID for the transaction
+	 * @param priority Priority class to queue the transaction in.
+	 * @return Unique ID for the transaction, 0 if it could not be queued
 	 */
-	int enqueTransaction(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_command command);
+	int enqueTransaction(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_command command,
+						 mcp39F511_priority priority = MCP_PRIORITY_CONTROL);
 
 	/**
 	 * Send a command byte to the MCP39F511
 	 * @param command to send
+	 * @param priority Priority class to queue the transaction in.
 	 * @return Unique ID for the transaction
 	 */
-	int sendCommand(mcp39F511_command command);
+	int sendCommand(mcp39F511_command command, mcp39F511_priority priority = MCP_PRIORITY_CONTROL);
+	
+	/**
+	 * Takes the next completed transaction off the completion queue.
+	 * Read data is copied to the transaction's dataPtr before returning.
+	 * Split requests are reported once, with the original address and length, when the last part completes.
+	 * @param completion Set to the completed transaction
+	 * @return false when there are no more completed transactions
+	 */
+	bool takeCompletion(Mcp39F511TransactionRef *completion);
+	
+	/**
+	 * Set the gap between bytes sent to the MCP39F511.
+	 * Pacing is timer driven so never blocks the event loop.
+	 * @param milliseconds Gap between bytes, 0 sends each frame with a single write.
+	 */
+	Q_INVOKABLE void setInterByteGap(int milliseconds);
+	
+	/**
+	 * Allow the next register read or write to be sent while the previous response is still arriving.
+	 * @param enabled true to overlap transactions, false to strictly wait for each to complete.
+	 */
+	Q_INVOKABLE void setPipelined(bool enabled);
+	
+	/**
+	 * Safe to call from any thread.
+	 * @return Completed transactions per second over the last COMMS_THROUGHPUT_INTERVAL
+	 */
+	double getTransactionRate();
+	
+	/**
+	 * Safe to call from any thread.
+	 * @param priority Priority class
+	 * @return Number of transactions waiting to be sent and how long they waited
+	 */
+	Mcp39F511QueueStats getQueueStats(mcp39F511_priority priority);
+	
+	/**
+	 * Safe to call from any thread.
+	 * @return Failure and recovery statistics since the last reset
+	 */
+	Mcp39F511RecoveryStats getRecoveryStats();
+	
+	/**
+	 * Clear the failure and recovery statistics
+	 */
+	Q_INVOKABLE void resetRecoveryStats();
 	
 signals:
-	void transactionComplete(Mcp39F511Transaction);
+	/**
+	 * Emitted from the comms thread when the completion queue goes from empty to not empty.
+	 * Drain it with takeCompletion().
+	 */
+	void completionsAvailable();
 
 private:
-	bool send_frame(u_int8_t command, u_int8_t *data, int length, bool read);
+	bool send_frame(u_int8_t command, u_int8_t *data, int length);
 	u_int8_t calculate_checksum(u_int8_t *pkt, int length);
 	bool register_read(Mcp39F511Transaction *transaction);
 	bool set_address_pointer(u_int16_t address);
 	bool register_write(Mcp39F511Transaction *transaction);
 	bool page_read_eeprom(u_int8_t page);
-	comms_status get_mcp39f511_data();
+	comms_status get_mcp39f511_data(u_int8_t *data, int length, int *consumed);
+	QQueue<Mcp39F511TransactionRef> *nextQueue();
+	void requeue(const Mcp39F511TransactionRef &transaction);
+	Mcp39F511TransactionRef takeNext(QQueue<Mcp39F511TransactionRef> *queue);
+	bool canTransmitNext();
+	bool canCoalesce(const Mcp39F511Frame &frame, const Mcp39F511Transaction &next);
+	void coalesce(Mcp39F511Frame *frame, const Mcp39F511TransactionRef &next);
+	void completeFrame(Mcp39F511Frame &frame);
+	bool isPipelineable(mcp39F511_command command);
+	bool expectsData(mcp39F511_command command);
+	void retryInFlight();
+	void requeueInFlight();
+	void updateRecovery();
+	void updateThroughput();
+	int transactionDeadline(mcp39F511_command command);
+	void transmitComplete();
+	void publishCompletion(const Mcp39F511TransactionRef &transaction);
+	void configureThread();
 	void printMessage(QString message);
 
-	int8_t serial_handle;
-	mcp39F511_command mcp_command;
-	int8_t serial_read;
-	QQueue<Mcp39F511Transaction> mcp39F511_queue;
+	MCP39F511Transport *transport;
+	int threadCpu;
+	QQueue<Mcp39F511TransactionRef> mcp39F511_queue[MCP_PRIORITY_CLASSES];
+	/* Never more than MCP_PIPELINE_DEPTH frames, space is reserved up front */
+	QVector<Mcp39F511Frame> inFlightQueue;
+	bool pipelined;
+	
+	/* Throughput measurement */
+	QElapsedTimer throughputTimer;
+	qint64 throughputCount;
+	QAtomicInt transactionRate;
+	
+	/* Per priority class queue statistics */
+	QElapsedTimer queueClock;
+	QAtomicInt queueDepth[MCP_PRIORITY_CLASSES];
+	QAtomicInt queueLastWait[MCP_PRIORITY_CLASSES];
+	QAtomicInt queueMaxWait[MCP_PRIORITY_CLASSES];
+	
+	/* Time the last bytes were read from the serial port, stamped on the responses they complete */
+	qint64 receivedMonotonic;
+	qint64 receivedWallClock;
+	
+	/* Hardware reset */
+	QTimer *resetTimer;
+	
+	/* Failure recovery */
+	QTimer *retryTimer;
+	qint64 failureStartTime;
+	qint64 recoveryTotal;
+	QAtomicInt failureCount;
+	QAtomicInt abandonedCount;
+	QAtomicInt recoveryCount;
+	QAtomicInt recoveryMean;
+	QAtomicInt recoveryMax;
+	
+	/* Cross thread hand off */
+	LockFreeQueue<Mcp39F511TransactionRef, COMMS_HANDOFF_QUEUE_SIZE> requestQueue;
+	LockFreeQueue<Mcp39F511TransactionRef, COMMS_HANDOFF_QUEUE_SIZE> completionQueue;
+	QQueue<Mcp39F511TransactionRef> completionBacklog;
+	QAtomicInt completionBacklogPending;
+	QAtomicInt requestWakePending;
+	QAtomicInt completionWakePending;
+	/* Split requests with parts taken but not the last, true if any part failed.
+	   Only used on the owning thread. */
+	QHash<int, bool> splitFailed;
 
 	/* Receiver members*/
+	QTimer *transactionTimer;
+	u_int8_t receive_buffer[SERIAL_RECEIVE_BUFFER_SIZE];
 	u_int8_t *receiver_data_ptr;
 	int receiver_packet_length;
+	int receiver_data_count;
 	receive_state receiver_cur_state;
 	u_int receiver_checksum;
-	int transaction_id;
+	QAtomicInt transaction_id;
+	
+	/* Transmitter members */
+	QTimer *transmitTimer;
+	u_int8_t transmit_buffer[SERIAL_MAX_FRAME_LENGTH];
+	int transmit_length;
+	int transmit_position;
+	int interByteGap;
 	
 private slots:
 	void service();
+	void slotRequestsAvailable();
+	void slotDrainCompletionBacklog();
+	void slotTransmitNextByte();
+	void slotSerialDataAvailable();
+	void slotTransactionTimeout();
+	void slotResetReleased();
 };
 
 #endif /* MCP39F511COMMS_H */
@@ -0,0 +1,87 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/*
+ * File:   MCP39F511CompletionRegistry.cpp
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 15:10
+ */
+
+#include "MCP39F511CompletionRegistry.h"
+
+MCP39F511CompletionRegistry::MCP39F511CompletionRegistry() {
+	clear();
+}
+
+void MCP39F511CompletionRegistry::add(int transactionId, const Mcp39F511Callback &callback) {
+	if(transactionId == 0 || !callback) {
+		return;
+	}
+	
+	/* Chain on to anything already waiting for the same transaction */
+	Mcp39F511Callback existing = take(transactionId);
+	Mcp39F511Callback combined = callback;
+	if(existing) {
+		combined = [existing, callback](const Mcp39F511TransactionRef &transaction) {
+			existing(transaction);
+			callback(transaction);
+		};
+	}
+	
+	Entry &entry = entries[(unsigned int)transactionId % MCP_COMPLETION_SLOTS];
+	if(entry.transactionId == 0) {
+		entry.transactionId = transactionId;
+		entry.callback = combined;
+	} else {
+		overflow.insert(transactionId, combined);
+	}
+}
+
+bool MCP39F511CompletionRegistry::dispatch(const Mcp39F511TransactionRef &transaction) {
+	/* Taken out first so the callback can register the next step of a sequence */
+	Mcp39F511Callback callback = take(transaction->unique_id);
+	if(!callback) {
+		return false;
+	}
+	callback(transaction);
+	return true;
+}
+
+Mcp39F511Callback MCP39F511CompletionRegistry::take(int transactionId) {
+	Mcp39F511Callback callback;
+	Entry &entry = entries[(unsigned int)transactionId % MCP_COMPLETION_SLOTS];
+	
+	if(entry.transactionId == transactionId) {
+		callback.swap(entry.callback);
+		entry.transactionId = 0;
+	} else if(!overflow.isEmpty()) {
+		callback = overflow.take(transactionId);
+	}
+	return callback;
+}
+
+void MCP39F511CompletionRegistry::clear() {
+	for(int i = 0; i < MCP_COMPLETION_SLOTS; i++) {
+		entries[i].transactionId = 0;
+		entries[i].callback = Mcp39F511Callback();
+	}
+	overflow.clear();
+}
@@ -0,0 +1,83 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/*
+ * File:   MCP39F511CompletionRegistry.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 15:10
+ */
+
+#ifndef MCP39F511COMPLETIONREGISTRY_H
+#define MCP39F511COMPLETIONREGISTRY_H
+
+#include <functional>
+
+#include <QHash>
+
+#include "MCP39F511Comms.h"
+
+/* Number of completion callbacks that can be waiting without falling back to a hash table.
+   Transaction IDs are sequential so each waiting transaction normally gets a slot to itself. */
+#define MCP_COMPLETION_SLOTS MCP_TRANSACTION_POOL_SIZE
+
+/**
+ * Continuation run on the interface's thread when a transaction completes, successfully or not
+ */
+typedef std::function<void(const Mcp39F511TransactionRef &)> Mcp39F511Callback;
+
+/**
+ * Callbacks waiting for MCP39F511 transactions to complete, keyed by transaction ID.
+ * Registering and dispatching are O(1) and do not allocate unless two waiting
+ * transactions land on the same slot.
+ */
+class MCP39F511CompletionRegistry {
+public:
+	MCP39F511CompletionRegistry();
+	
+	/**
+	 * Register a callback for a transaction.  A second callback for the same transaction
+	 * runs after the first.
+	 */
+	void add(int transactionId, const Mcp39F511Callback &callback);
+	
+	/**
+	 * Run and forget the callback waiting for a transaction, if there is one
+	 * @return true if a callback was run
+	 */
+	bool dispatch(const Mcp39F511TransactionRef &transaction);
+	
+	/**
+	 * Forget every waiting callback, e.g. when the transactions they wait for will never complete
+	 */
+	void clear();
+	
+private:
+	Mcp39F511Callback take(int transactionId);
+	
+	struct Entry {
+		int transactionId;
+		Mcp39F511Callback callback;
+	};
+	Entry entries[MCP_COMPLETION_SLOTS];
+	QHash<int, Mcp39F511Callback> overflow;
+};
+
+#endif /* MCP39F511COMPLETIONREGISTRY_H */
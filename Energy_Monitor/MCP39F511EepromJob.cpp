@@ -0,0 +1,180 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511EepromJob.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 01:15
+ */
+
+#include <string.h>
+
+#include <QDebug>
+
+#include "MCP39F511EepromJob.h"
+
+MCP39F511EepromJob::MCP39F511EepromJob(MCP39F511Interface *powerMeter, QObject *parent) : QObject(parent) {
+	this->powerMeter = powerMeter;
+	state = EEPROM_JOB_IDLE;
+	readBuffer = NULL;
+	writeBuffer = NULL;
+	dumping = false;
+	nextPage = 0;
+	pageCount = MCP_EEPROM_PAGE_COUNT;
+	pagesInFlight = 0;
+	pagesDone = 0;
+	cancelled = false;
+	failed = false;
+}
+
+MCP39F511EepromJob::~MCP39F511EepromJob() {
+}
+
+void MCP39F511EepromJob::printMessage(QString message) {
+	qDebug() << "EEPROM job: " << message;
+}
+
+bool MCP39F511EepromJob::isRunning() {
+	return state != EEPROM_JOB_IDLE;
+}
+
+bool MCP39F511EepromJob::startRead(u_int8_t *buffer) {
+	if(isRunning()) {
+		return false;
+	}
+	state = EEPROM_JOB_READ;
+	readBuffer = buffer;
+	nextPage = 0;
+	pageCount = MCP_EEPROM_PAGE_COUNT;
+	pagesDone = 0;
+	cancelled = false;
+	failed = false;
+	emit started();
+	queuePages();
+	return true;
+}
+
+bool MCP39F511EepromJob::startWrite(const u_int8_t *buffer) {
+	if(isRunning()) {
+		return false;
+	}
+	state = EEPROM_JOB_WRITE;
+	writeBuffer = buffer;
+	nextPage = 0;
+	pageCount = MCP_CHECKPOINT_FIRST_PAGE;
+	pagesDone = 0;
+	cancelled = false;
+	failed = false;
+	emit started();
+	queuePages();
+	return true;
+}
+
+void MCP39F511EepromJob::cancel() {
+	if(isRunning()) {
+		printMessage("Cancelled.");
+		cancelled = true;
+	}
+}
+
+void MCP39F511EepromJob::dump() {
+	/* Whoever asked gets the dump already under way */
+	if(dumping) {
+		return;
+	}
+	if(isRunning()) {
+		printMessage("A job is already running, the EEPROM can't be dumped.");
+		emit dumpReady(QByteArray(), powerMeter->getDeviceId());
+		return;
+	}
+	dumping = true;
+	startRead(dumpBuffer);
+}
+
+void MCP39F511EepromJob::dumpDevice(int deviceId) {
+	if(deviceId == powerMeter->getDeviceId()) {
+		dump();
+	}
+}
+
+void MCP39F511EepromJob::queuePages() {
+	while(!cancelled && !failed && nextPage < pageCount && pagesInFlight < MCP_EEPROM_JOB_WINDOW) {
+		int page = nextPage;
+		int transactionId;
+		if(state == EEPROM_JOB_WRITE) {
+			transactionId = powerMeter->eepromWritePage(page, (u_int8_t *)writeBuffer + page * MCP_EEPROM_PAGE_SIZE);
+		} else if(state == EEPROM_JOB_VERIFY) {
+			transactionId = powerMeter->eepromReadPage(page, verifyBuffer + page * MCP_EEPROM_PAGE_SIZE);
+		} else {
+			transactionId = powerMeter->eepromReadPage(page, readBuffer + page * MCP_EEPROM_PAGE_SIZE);
+		}
+		if(transactionId == 0) {
+			printMessage(QString("Page %1 could not be queued.").arg(page));
+			failed = true;
+			break;
+		}
+		nextPage++;
+		pagesInFlight++;
+		powerMeter->onComplete(transactionId, [this, page](const Mcp39F511TransactionRef &transaction) {
+			/* A short page read is as good as a failed one */
+			pageComplete(page, transaction->status == COMMS_COMPLETE
+						 && (transaction->command != MCP_CMD_PAGE_READ_EEPROM || transaction->length == MCP_EEPROM_PAGE_SIZE));
+		});
+	}
+	if(pagesInFlight > 0) {
+		return;
+	}
+	
+	/* Nothing left in the queue, either move on to verifying or the job is over */
+	if(state == EEPROM_JOB_WRITE && !cancelled && !failed) {
+		state = EEPROM_JOB_VERIFY;
+		nextPage = 0;
+		queuePages();
+		return;
+	}
+	bool success = !cancelled && !failed;
+	eeprom_job_state finishedState = state;
+	state = EEPROM_JOB_IDLE;
+	if(success) {
+		printMessage(finishedState == EEPROM_JOB_READ ? "EEPROM read." : "EEPROM written and verified.");
+	}
+	if(dumping) {
+		dumping = false;
+		emit dumpReady(success ? QByteArray((const char *)dumpBuffer, MCP_EEPROM_SIZE) : QByteArray(), powerMeter->getDeviceId());
+	}
+	emit finished(success);
+}
+
+void MCP39F511EepromJob::pageComplete(int page, bool success) {
+	pagesInFlight--;
+	if(!success) {
+		printMessage(QString("Page %1 failed.").arg(page));
+		failed = true;
+	} else if(state == EEPROM_JOB_VERIFY
+			  && memcmp(verifyBuffer + page * MCP_EEPROM_PAGE_SIZE, writeBuffer + page * MCP_EEPROM_PAGE_SIZE, MCP_EEPROM_PAGE_SIZE)) {
+		printMessage(QString("Page %1 did not verify.").arg(page));
+		failed = true;
+	} else {
+		pagesDone++;
+		emit progress(pagesDone, state == EEPROM_JOB_READ ? pageCount : 2 * pageCount);
+	}
+	queuePages();
+}
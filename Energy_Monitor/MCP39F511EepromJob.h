@@ -0,0 +1,141 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511EepromJob.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 01:15
+ */
+
+#ifndef MCP39F511EEPROMJOB_H
+#define MCP39F511EEPROMJOB_H
+
+#include <QByteArray>
+#include <QObject>
+
+#include "MCP39F511EnergyCheckpoint.h"
+#include "MCP39F511Interface.h"
+
+/* Pages queued ahead of those completed, keeps the comms busy without filling the request queue */
+#define MCP_EEPROM_JOB_WINDOW 8
+
+typedef enum {
+	EEPROM_JOB_IDLE,
+	EEPROM_JOB_READ,
+	EEPROM_JOB_WRITE,
+	EEPROM_JOB_VERIFY		/* Reading back what was written */
+} eeprom_job_state;
+
+/**
+ * Reads or writes the whole MCP39F511 EEPROM as one background job.
+ * Pages are queued MCP_EEPROM_JOB_WINDOW at a time, each into its own part of the buffer, so the
+ * comms go from one page to the next without waiting on this thread.  A write is read back and
+ * compared once every page has been written.  All access is at background priority so
+ * measurements carry on as normal.
+ */
+class MCP39F511EepromJob : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511EepromJob(MCP39F511Interface *powerMeter, QObject *parent);
+	virtual ~MCP39F511EepromJob();
+	
+	/**
+	 * Read every page into a buffer
+	 * @param buffer MCP_EEPROM_SIZE bytes, must stay valid until finished is emitted
+	 * @return false if a job is already running
+	 */
+	bool startRead(u_int8_t *buffer);
+	
+	/**
+	 * Write every page below the energy checkpoints from a buffer then read them back to verify.
+	 * The checkpoint pages are left as they are, an old image would take the energy totals back.
+	 * @param buffer MCP_EEPROM_SIZE bytes, must stay valid until finished is emitted
+	 * @return false if a job is already running
+	 */
+	bool startWrite(const u_int8_t *buffer);
+	
+	bool isRunning();
+	
+signals:
+	/**
+	 * Emitted when a job starts, anything else writing the EEPROM should hold off until finished
+	 */
+	void started();
+	
+	/**
+	 * @param pagesDone Pages read, written or verified so far
+	 * @param pagesTotal Pages in the whole job, twice the pages written for a write
+	 */
+	void progress(int pagesDone, int pagesTotal);
+	
+	/**
+	 * Emitted once nothing from the job is left in the queue
+	 * @param success false if a page failed, didn't verify or the job was cancelled
+	 */
+	void finished(bool success);
+	
+	/**
+	 * Emitted when a dump() completes
+	 * @param image The whole EEPROM, empty if it couldn't be read
+	 * @param deviceId Device ID of the MCP39F511 it was read from
+	 */
+	void dumpReady(QByteArray image, int deviceId);
+	
+public slots:
+	/**
+	 * Stop queuing pages, finished is emitted once those already queued complete
+	 */
+	void cancel();
+	
+	/**
+	 * Read the EEPROM into a buffer of the job's own, dumpReady is emitted with it
+	 */
+	void dump();
+	
+	/**
+	 * Dump the EEPROM if it is asked for on this job's MCP39F511
+	 * @param deviceId Device ID of the MCP39F511 to dump
+	 */
+	void dumpDevice(int deviceId);
+	
+private:
+	void queuePages();
+	void pageComplete(int page, bool success);
+	void printMessage(QString message);
+	
+	MCP39F511Interface *powerMeter;
+	eeprom_job_state state;
+	u_int8_t *readBuffer;
+	const u_int8_t *writeBuffer;
+	u_int8_t verifyBuffer[MCP_EEPROM_SIZE];
+	u_int8_t dumpBuffer[MCP_EEPROM_SIZE];
+	bool dumping;
+	int nextPage;
+	/* Pages from 0 the job covers */
+	int pageCount;
+	int pagesInFlight;
+	int pagesDone;
+	bool cancelled;
+	bool failed;
+};
+
+#endif /* MCP39F511EEPROMJOB_H */
@@ -0,0 +1,102 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511EnergyAccumulator.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 21:10
+ */
+
+#include "MCP39F511EnergyAccumulator.h"
+#include "MCP39F511Units.h"
+
+MCP39F511EnergyAccumulator::MCP39F511EnergyAccumulator() {
+	for(int i = 0; i < ENERGY_COUNTERS; i++) {
+		lastCounters[i] = 0;
+	}
+	seeded = false;
+	clear();
+}
+
+void MCP39F511EnergyAccumulator::update(const u_int64_t counters[ENERGY_COUNTERS]) {
+	bool reset = false;
+	
+	if(!seeded) {
+		for(int i = 0; i < ENERGY_COUNTERS; i++) {
+			lastCounters[i] = counters[i];
+		}
+		seeded = true;
+		return;
+	}
+	for(int i = 0; i < ENERGY_COUNTERS; i++) {
+		if(counters[i] >= lastCounters[i]) {
+			totals[i] += counters[i] - lastCounters[i];
+		} else if(lastCounters[i] >= (u_int64_t)-MCP_ENERGY_COUNTER_WRAP_GUARD) {
+			/* Unsigned subtraction counts across the wrap */
+			totals[i] += counters[i] - lastCounters[i];
+		} else {
+			/* Restarted from zero, everything now in the counter is new */
+			totals[i] += counters[i];
+			reset = true;
+		}
+		lastCounters[i] = counters[i];
+	}
+	if(reset) {
+		resets++;
+	}
+}
+
+void MCP39F511EnergyAccumulator::counterReset() {
+	for(int i = 0; i < ENERGY_COUNTERS; i++) {
+		lastCounters[i] = 0;
+	}
+	seeded = true;
+	resets++;
+}
+
+void MCP39F511EnergyAccumulator::carryOver(const u_int64_t previous[ENERGY_COUNTERS]) {
+	for(int i = 0; i < ENERGY_COUNTERS; i++) {
+		totals[i] += previous[i];
+	}
+}
+
+u_int64_t MCP39F511EnergyAccumulator::total(energy_counter counter) {
+	return totals[counter];
+}
+
+EnergyTotals MCP39F511EnergyAccumulator::getTotals() {
+	EnergyTotals energy;
+	energy.importActive = McpEnergyScale::toDouble(totals[ENERGY_IMPORT_ACTIVE]);
+	energy.exportActive = McpEnergyScale::toDouble(totals[ENERGY_EXPORT_ACTIVE]);
+	energy.importReactive = McpEnergyScale::toDouble(totals[ENERGY_IMPORT_REACTIVE]);
+	energy.exportReactive = McpEnergyScale::toDouble(totals[ENERGY_EXPORT_REACTIVE]);
+	energy.timeStamp = 0;
+	energy.resets = resets;
+	energy.deviceId = 0;
+	return energy;
+}
+
+void MCP39F511EnergyAccumulator::clear() {
+	for(int i = 0; i < ENERGY_COUNTERS; i++) {
+		totals[i] = 0;
+	}
+	resets = 0;
+}
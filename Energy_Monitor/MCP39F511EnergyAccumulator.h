@@ -0,0 +1,110 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511EnergyAccumulator.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 21:10
+ */
+
+#ifndef MCP39F511ENERGYACCUMULATOR_H
+#define MCP39F511ENERGYACCUMULATOR_H
+
+#include <sys/types.h>
+
+#include <QtGlobal>
+
+/* Energy counters in the order of McpEnergyCounterRegisters */
+typedef enum {
+	ENERGY_IMPORT_ACTIVE,
+	ENERGY_EXPORT_ACTIVE,
+	ENERGY_IMPORT_REACTIVE,
+	ENERGY_EXPORT_REACTIVE,
+	ENERGY_COUNTERS
+} energy_counter;
+
+/* A counter found this close to the top of its range that then goes down has wrapped rather than been reset */
+#define MCP_ENERGY_COUNTER_WRAP_GUARD ((u_int64_t)1 << 62)
+
+typedef struct {
+	/* Active energy in kWh, reactive in kvarh, see McpEnergyScale */
+	double importActive;
+	double exportActive;
+	double importReactive;
+	double exportReactive;
+	qint64 timeStamp;			/* Wall clock when the counters were read, milliseconds since the epoch */
+	int resets;					/* Times the MCP39F511 counters restarted and were carried over */
+	int deviceId;
+} EnergyTotals;
+
+/**
+ * Running totals of the MCP39F511 energy counters.
+ * The counters go back to zero whenever the MCP39F511 is reset or accumulation is turned off, the
+ * totals carry on from where they were so they only ever count up.  Energy accumulated between
+ * the last read and a reset is lost, so the counters should be read regularly.
+ */
+class MCP39F511EnergyAccumulator {
+public:
+	MCP39F511EnergyAccumulator();
+	
+	/**
+	 * Add what the counters have accumulated since they were last read.  The first read only
+	 * records where the counters are, what they held before then was counted by whoever read them.
+	 * @param counters The four energy counter registers, McpEnergyCounterRegisters
+	 */
+	void update(const u_int64_t counters[ENERGY_COUNTERS]);
+	
+	/**
+	 * The MCP39F511 has just been reset, everything in the counters at the next read is new.
+	 * Called on every reset as a counter read back soon after isn't always below the last read.
+	 */
+	void counterReset();
+	
+	/**
+	 * Add totals counted before, e.g. restored from a checkpoint
+	 * @param previous Totals in the units of the energy counter registers
+	 */
+	void carryOver(const u_int64_t previous[ENERGY_COUNTERS]);
+	
+	/**
+	 * @return Total counted in the units of the energy counter registers
+	 */
+	u_int64_t total(energy_counter counter);
+	
+	/**
+	 * @return Totals in kWh and kvarh
+	 */
+	EnergyTotals getTotals();
+	
+	/**
+	 * Start the totals again from zero, the energy already in the counters is not counted again
+	 */
+	void clear();
+	
+private:
+	u_int64_t totals[ENERGY_COUNTERS];
+	u_int64_t lastCounters[ENERGY_COUNTERS];
+	/* The counters have been read at least once or are known to be zero */
+	bool seeded;
+	int resets;
+};
+
+#endif /* MCP39F511ENERGYACCUMULATOR_H */
@@ -0,0 +1,255 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511EnergyCheckpoint.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 23:40
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <QDebug>
+
+#include "MCP39F511EnergyCheckpoint.h"
+
+MCP39F511EnergyCheckpoint::MCP39F511EnergyCheckpoint(MCP39F511Interface *powerMeter, QObject *parent) : QObject(parent) {
+	this->powerMeter = powerMeter;
+	restoring = false;
+	restoreComplete = false;
+	pagesRead = 0;
+	nextSequence = 1;
+	nextSlot = 0;
+	pageToWrite = -1;
+	writeInFlight = false;
+	paused = false;
+	for(int i = 0; i < ENERGY_COUNTERS; i++) {
+		lastTotals[i] = 0;
+	}
+	
+	checkpointTimer = new QTimer(this);
+	connect(checkpointTimer, SIGNAL(timeout()), this, SLOT(checkpoint()));
+	writeTimer = new QTimer(this);
+	writeTimer->setSingleShot(true);
+	connect(writeTimer, SIGNAL(timeout()), this, SLOT(slotWriteNextPage()));
+	
+	connect(powerMeter, SIGNAL(initialisationComplete()), this, SLOT(slotInitialisationComplete()));
+	connect(powerMeter, SIGNAL(outputRegistersReady(McpOutputRegisters, int)), this, SLOT(slotOutputRegistersReady()));
+}
+
+MCP39F511EnergyCheckpoint::~MCP39F511EnergyCheckpoint() {
+}
+
+void MCP39F511EnergyCheckpoint::printMessage(QString message) {
+	if(powerMeter->getDeviceId()) {
+		qDebug() << QString("Energy checkpoint %1: ").arg(powerMeter->getDeviceId()) << message;
+	} else {
+		qDebug() << "Energy checkpoint: " << message;
+	}
+}
+
+bool MCP39F511EnergyCheckpoint::isRestored() {
+	return restoreComplete;
+}
+
+/**
+ * CRC-16-CCITT, polynomial 0x1021 starting from 0xFFFF
+ */
+u_int16_t MCP39F511EnergyCheckpoint::checksum(const u_int8_t *data, int length) {
+	u_int16_t crc = 0xFFFF;
+	for(int i = 0; i < length; i++) {
+		crc ^= (u_int16_t)data[i] << 8;
+		for(int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+void MCP39F511EnergyCheckpoint::slotInitialisationComplete() {
+	/* Only restored once, the totals carry on over later resets by themselves */
+	if(!restoreComplete && !restoring) {
+		restoring = true;
+		pagesRead = 0;
+		restore();
+	}
+}
+
+/**
+ * Read the checkpoint pages one after another, they are only looked at once all have been read
+ */
+void MCP39F511EnergyCheckpoint::restore() {
+	if(pagesRead < MCP_CHECKPOINT_PAGES) {
+		int page = pagesRead;
+		pageValid[page] = false;
+		int transactionId = powerMeter->eepromReadPage(MCP_CHECKPOINT_FIRST_PAGE + page);
+		if(transactionId == 0) {
+			pagesRead++;
+			restore();
+			return;
+		}
+		powerMeter->onComplete(transactionId, [this, page](const Mcp39F511TransactionRef &transaction) {
+			if(transaction->status == COMMS_COMPLETE && transaction->length == MCP_EEPROM_PAGE_SIZE) {
+				memcpy(pages[page], transaction->data, MCP_EEPROM_PAGE_SIZE);
+				pageValid[page] = true;
+			}
+			pagesRead++;
+			restore();
+		});
+		return;
+	}
+	
+	/* A checkpoint written without knowing where the newest is could end up older than it */
+	for(int page = 0; page < MCP_CHECKPOINT_PAGES; page++) {
+		if(!pageValid[page]) {
+			printMessage(QString("Checkpoints could not be read, trying again in %1 s.").arg(MCP_CHECKPOINT_RETRY_INTERVAL / 1000));
+			restoring = false;
+			QTimer::singleShot(MCP_CHECKPOINT_RETRY_INTERVAL, this, SLOT(slotInitialisationComplete()));
+			return;
+		}
+	}
+	
+	/* Find the newest checkpoint with a good checksum, erased pages are all 0xFF */
+	int newestSlot = -1;
+	EnergyCheckpointRecord newest;
+	for(int slot = 0; slot < (int)MCP_CHECKPOINT_SLOTS; slot++) {
+		EnergyCheckpointRecord candidate;
+		memcpy(&candidate, pages[slot * MCP_CHECKPOINT_RECORD_PAGES], sizeof(candidate));
+		if(candidate.magic != MCP_CHECKPOINT_MAGIC
+				|| candidate.checksum != checksum((const u_int8_t *)&candidate, offsetof(EnergyCheckpointRecord, checksum))) {
+			continue;
+		}
+		if(newestSlot < 0 || candidate.sequence > newest.sequence) {
+			newest = candidate;
+			newestSlot = slot;
+		}
+	}
+	
+	restoring = false;
+	restoreComplete = true;
+	if(newestSlot >= 0) {
+		u_int64_t totals[ENERGY_COUNTERS];
+		for(int i = 0; i < ENERGY_COUNTERS; i++) {
+			totals[i] = 0;
+			for(int byte = MCP_CHECKPOINT_TOTAL_BYTES - 1; byte >= 0; byte--) {
+				totals[i] = (totals[i] << 8) | newest.totals[i][byte];
+			}
+		}
+		powerMeter->getEnergyAccumulator()->carryOver(totals);
+		nextSequence = newest.sequence + 1;
+		nextSlot = (newestSlot + 1) % MCP_CHECKPOINT_SLOTS;
+		printMessage(QString("Energy totals restored from checkpoint %1, %2 kWh imported.")
+					 .arg(newest.sequence).arg(McpEnergyScale::toDouble(totals[ENERGY_IMPORT_ACTIVE])));
+	} else {
+		printMessage("No checkpoint found, energy totals start from zero.");
+	}
+	checkpointTimer->start(MCP_CHECKPOINT_INTERVAL);
+	emit restored(newestSlot >= 0);
+}
+
+void MCP39F511EnergyCheckpoint::checkpoint() {
+	/* Writing before the restore would bury the newest checkpoint under a smaller one */
+	if(!restoreComplete || pageToWrite >= 0 || paused) {
+		return;
+	}
+	
+	MCP39F511EnergyAccumulator *accumulator = powerMeter->getEnergyAccumulator();
+	bool changed = false;
+	for(int i = 0; i < ENERGY_COUNTERS; i++) {
+		u_int64_t total = accumulator->total((energy_counter)i);
+		changed = changed || total != lastTotals[i];
+		lastTotals[i] = total;
+		for(int byte = 0; byte < MCP_CHECKPOINT_TOTAL_BYTES; byte++) {
+			record.totals[i][byte] = (total >> (byte * 8)) & 0xFF;
+		}
+	}
+	/* Don't wear the EEPROM writing the same totals again */
+	if(!changed) {
+		return;
+	}
+	record.magic = MCP_CHECKPOINT_MAGIC;
+	record.sequence = nextSequence;
+	record.checksum = checksum((const u_int8_t *)&record, offsetof(EnergyCheckpointRecord, checksum));
+	
+	pageToWrite = 0;
+	writeTimer->start(MCP_CHECKPOINT_WRITE_TIMEOUT);
+}
+
+void MCP39F511EnergyCheckpoint::pause() {
+	paused = true;
+	writeTimer->stop();
+}
+
+void MCP39F511EnergyCheckpoint::resume() {
+	paused = false;
+	if(pageToWrite >= 0) {
+		slotWriteNextPage();
+	} else {
+		/* Catch up on any checkpoint missed while paused */
+		checkpoint();
+	}
+}
+
+void MCP39F511EnergyCheckpoint::slotOutputRegistersReady() {
+	/* The next measurement read is as far away as it can be */
+	if(pageToWrite >= 0 && !writeInFlight) {
+		slotWriteNextPage();
+	}
+}
+
+void MCP39F511EnergyCheckpoint::slotWriteNextPage() {
+	if(pageToWrite < 0 || writeInFlight || paused) {
+		return;
+	}
+	writeTimer->stop();
+	int page = MCP_CHECKPOINT_FIRST_PAGE + nextSlot * MCP_CHECKPOINT_RECORD_PAGES + pageToWrite;
+	int transactionId = powerMeter->eepromWritePage(page, (u_int8_t *)&record + pageToWrite * MCP_EEPROM_PAGE_SIZE);
+	if(transactionId == 0) {
+		/* Queue full, try again later */
+		writeTimer->start(MCP_CHECKPOINT_WRITE_TIMEOUT);
+		return;
+	}
+	writeInFlight = true;
+	powerMeter->onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		writeInFlight = false;
+		if(transaction->status != COMMS_COMPLETE) {
+			/* The slot is left with a bad checksum, the checkpoint before it still stands */
+			printMessage(QString("Checkpoint %1 could not be written.").arg(nextSequence));
+			/* A later checkpoint may still be part written, never reuse its sequence number */
+			nextSequence++;
+			nextSlot = (nextSlot + 1) % MCP_CHECKPOINT_SLOTS;
+			pageToWrite = -1;
+			for(int i = 0; i < ENERGY_COUNTERS; i++) {
+				lastTotals[i] = 0;
+			}
+			return;
+		}
+		pageToWrite++;
+		if(pageToWrite < (int)MCP_CHECKPOINT_RECORD_PAGES) {
+			writeTimer->start(MCP_CHECKPOINT_WRITE_TIMEOUT);
+			return;
+		}
+		pageToWrite = -1;
+		nextSequence++;
+		nextSlot = (nextSlot + 1) % MCP_CHECKPOINT_SLOTS;
+	});
+}
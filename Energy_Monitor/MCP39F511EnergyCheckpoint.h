@@ -0,0 +1,134 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511EnergyCheckpoint.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 23:40
+ */
+
+#ifndef MCP39F511ENERGYCHECKPOINT_H
+#define MCP39F511ENERGYCHECKPOINT_H
+
+#include <QObject>
+#include <QTimer>
+
+#include "MCP39F511Interface.h"
+
+/* Milliseconds between checkpoints of the energy totals, at most this much energy is lost on restart */
+#define MCP_CHECKPOINT_INTERVAL 300000
+/* EEPROM pages given over to checkpoints, each checkpoint goes in the slot after the newest.
+   Only the top 16 pages are used, those below MCP_CHECKPOINT_FIRST_PAGE are left for other data. */
+#define MCP_CHECKPOINT_PAGES 16
+#define MCP_CHECKPOINT_FIRST_PAGE (MCP_EEPROM_PAGE_COUNT - MCP_CHECKPOINT_PAGES)
+#define MCP_CHECKPOINT_RECORD_PAGES (sizeof(EnergyCheckpointRecord) / MCP_EEPROM_PAGE_SIZE)
+#define MCP_CHECKPOINT_SLOTS (MCP_CHECKPOINT_PAGES / MCP_CHECKPOINT_RECORD_PAGES)
+/* Each page is written just after a measurement read so it doesn't hold one up, if no read
+   comes along within this many milliseconds it is written anyway */
+#define MCP_CHECKPOINT_WRITE_TIMEOUT 1000
+/* Milliseconds before trying again when the checkpoints couldn't be read */
+#define MCP_CHECKPOINT_RETRY_INTERVAL 10000
+
+#define MCP_CHECKPOINT_MAGIC 0x4E45
+/* Totals are stored in 48 bits, 281 GWh at 1 mWh per count */
+#define MCP_CHECKPOINT_TOTAL_BYTES 6
+
+/**
+ * A checkpoint as stored in EEPROM, little endian over two pages.  The checksum covers both
+ * pages so a checkpoint only partly written is ignored.
+ */
+typedef struct __attribute__((packed)) {
+	u_int16_t magic;
+	u_int32_t sequence;			/* Goes up by one each checkpoint, the highest valid one is the newest */
+	u_int8_t totals[ENERGY_COUNTERS][MCP_CHECKPOINT_TOTAL_BYTES];	/* Energy counter units */
+	u_int16_t checksum;			/* CRC-16-CCITT of everything before it */
+} EnergyCheckpointRecord;
+
+static_assert(sizeof(EnergyCheckpointRecord) % MCP_EEPROM_PAGE_SIZE == 0, "Checkpoint must fill whole EEPROM pages");
+
+/**
+ * Keeps the energy totals of one MCP39F511 over restarts by checkpointing them into its EEPROM.
+ * Checkpoints rotate through MCP_CHECKPOINT_SLOTS slots so each page is written rarely.  Once the
+ * MCP39F511 has initialised every slot is read, the newest valid checkpoint is carried over into the
+ * totals and checkpointing starts.  All EEPROM access is at background priority.
+ */
+class MCP39F511EnergyCheckpoint : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511EnergyCheckpoint(MCP39F511Interface *powerMeter, QObject *parent);
+	virtual ~MCP39F511EnergyCheckpoint();
+	
+	/**
+	 * @return true once the EEPROM has been read and checkpoints are being written
+	 */
+	bool isRestored();
+	
+	static u_int16_t checksum(const u_int8_t *data, int length);
+	
+signals:
+	/**
+	 * Emitted once the checkpoints have been read
+	 * @param found true if a valid checkpoint was carried over into the totals
+	 */
+	void restored(bool found);
+	
+public slots:
+	/**
+	 * Write a checkpoint now, nothing is written if the totals haven't changed since the last one
+	 */
+	void checkpoint();
+	
+	/**
+	 * Hold off writing while something else uses the EEPROM, a checkpoint part written is finished on resume()
+	 */
+	void pause();
+	void resume();
+	
+private slots:
+	void slotInitialisationComplete();
+	void slotOutputRegistersReady();
+	void slotWriteNextPage();
+	
+private:
+	void restore();
+	void printMessage(QString message);
+	
+	MCP39F511Interface *powerMeter;
+	QTimer *checkpointTimer;
+	QTimer *writeTimer;
+	bool restoring;
+	bool restoreComplete;
+	int pagesRead;
+	u_int8_t pages[MCP_CHECKPOINT_PAGES][MCP_EEPROM_PAGE_SIZE];
+	bool pageValid[MCP_CHECKPOINT_PAGES];
+	
+	EnergyCheckpointRecord record;
+	u_int32_t nextSequence;
+	int nextSlot;
+	/* Page of the record to write next, -1 when no checkpoint is being written */
+	int pageToWrite;
+	bool writeInFlight;
+	bool paused;
+	u_int64_t lastTotals[ENERGY_COUNTERS];
+};
+
+#endif /* MCP39F511ENERGYCHECKPOINT_H */
@@ -0,0 +1,106 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511FaultBenchmark.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 16:40
+ */
+
+#include <QDebug>
+
+#include "MCP39F511FaultBenchmark.h"
+
+MCP39F511FaultBenchmark::MCP39F511FaultBenchmark(MCP39F511Interface *powerMeter, QObject *parent) : QObject(parent) {
+	this->powerMeter = powerMeter;
+	currentFault = FAULT_NONE;
+	samples = 0;
+	injected = 0;
+	
+	pollTimer = new QTimer(this);
+	connect(pollTimer, SIGNAL(timeout()), this, SLOT(slotPoll()));
+}
+
+MCP39F511FaultBenchmark::~MCP39F511FaultBenchmark() {
+}
+
+void MCP39F511FaultBenchmark::start() {
+	results.clear();
+	/* Start with no faults as a baseline */
+	currentFault = FAULT_NONE;
+	runFault();
+}
+
+void MCP39F511FaultBenchmark::runFault() {
+	qDebug() << "Fault benchmark: injecting" << MCP39F511FaultInjector::faultName(currentFault);
+	samples = 0;
+	powerMeter->resetRecoveryStats();
+	powerMeter->setFault(currentFault, FAULT_BENCHMARK_PROBABILITY);
+	pollTimer->start(FAULT_BENCHMARK_POLL_INTERVAL);
+	QTimer::singleShot(FAULT_BENCHMARK_DURATION, this, SLOT(slotInjectionComplete()));
+}
+
+void MCP39F511FaultBenchmark::slotPoll() {
+	powerMeter->getOutputRegisters();
+	samples++;
+}
+
+void MCP39F511FaultBenchmark::slotInjectionComplete() {
+	/* Stop injecting but keep polling while the link recovers */
+	injected = powerMeter->getInjectedFaultCount();
+	powerMeter->setFault(FAULT_NONE, 0);
+	QTimer::singleShot(FAULT_BENCHMARK_SETTLE, this, SLOT(slotSettled()));
+}
+
+void MCP39F511FaultBenchmark::slotSettled() {
+	FaultResult result;
+	
+	pollTimer->stop();
+	result.fault = currentFault;
+	result.samples = samples;
+	result.lostSamples = powerMeter->getLostSamples();
+	result.injected = injected;
+	result.recovery = powerMeter->getRecoveryStats();
+	results.append(result);
+	
+	currentFault = (mcp39F511_fault)(currentFault + 1);
+	if(currentFault < FAULT_TYPES) {
+		runFault();
+	} else {
+		printReport();
+		emit finished();
+	}
+}
+
+void MCP39F511FaultBenchmark::printReport() {
+	qDebug("Fault benchmark, %d%% of responses hit, %d ms between samples", FAULT_BENCHMARK_PROBABILITY, FAULT_BENCHMARK_POLL_INTERVAL);
+	qDebug("%-24s %8s %8s %8s %8s %8s %12s %12s", "Fault", "Injected", "Failures", "Given up", "Samples", "Lost", "Mean rec us", "Max rec us");
+	for(QList<FaultResult>::size_type i = 0; i < results.size(); i++) {
+		const FaultResult &result = results.at(i);
+		qDebug("%-24s %8d %8d %8d %8d %8d %12d %12d",
+			   MCP39F511FaultInjector::faultName(result.fault).toLocal8Bit().constData(),
+			   result.injected, result.recovery.failures, result.recovery.abandoned,
+			   result.samples, result.lostSamples, result.recovery.meanRecovery, result.recovery.maxRecovery);
+	}
+	
+	BufferPoolStats pool = powerMeter->getPoolStats();
+	qDebug("Transaction pool: %d allocations, peak %d of %d in use, %d from the heap",
+		   pool.allocations, pool.peakInUse, pool.size, pool.heapAllocations);
+}
@@ -0,0 +1,93 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511FaultBenchmark.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 16:40
+ */
+
+#ifndef MCP39F511FAULTBENCHMARK_H
+#define MCP39F511FAULTBENCHMARK_H
+
+#include <QList>
+#include <QObject>
+#include <QTimer>
+
+#include "MCP39F511Interface.h"
+
+/* Time in milliseconds each fault type is injected for */
+#define FAULT_BENCHMARK_DURATION 20000
+/* Time in milliseconds allowed for the link to recover after injection stops */
+#define FAULT_BENCHMARK_SETTLE 1000
+/* Interval in milliseconds between measurement reads */
+#define FAULT_BENCHMARK_POLL_INTERVAL 100
+/* Percentage chance of each response being hit by the fault */
+#define FAULT_BENCHMARK_PROBABILITY 5
+
+/**
+ * Polls measurements while injecting each type of serial fault in turn, then reports
+ * the time taken to recover and the number of samples lost for each.
+ * Best run against the MCP39F511 simulator.
+ */
+class MCP39F511FaultBenchmark : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511FaultBenchmark(MCP39F511Interface *powerMeter, QObject *parent);
+	virtual ~MCP39F511FaultBenchmark();
+	
+	/**
+	 * Start the benchmark, fault injection must have been enabled before the power meter was initialised
+	 */
+	void start();
+	
+signals:
+	/**
+	 * Emitted once all fault types have been run and the report printed
+	 */
+	void finished();
+	
+private slots:
+	void slotPoll();
+	void slotInjectionComplete();
+	void slotSettled();
+	
+private:
+	typedef struct {
+		mcp39F511_fault fault;
+		int samples;
+		int lostSamples;
+		int injected;
+		Mcp39F511RecoveryStats recovery;
+	} FaultResult;
+	
+	void runFault();
+	void printReport();
+	
+	MCP39F511Interface *powerMeter;
+	QTimer *pollTimer;
+	mcp39F511_fault currentFault;
+	int samples;
+	int injected;
+	QList<FaultResult> results;
+};
+
+#endif /* MCP39F511FAULTBENCHMARK_H */
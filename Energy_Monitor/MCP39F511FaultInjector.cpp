@@ -0,0 +1,187 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511FaultInjector.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 16:40
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "MCP39F511FaultInjector.h"
+
+/* MCP39F511 NAK response */
+#define FAULT_RESP_NAK 0x15
+
+MCP39F511FaultInjector::MCP39F511FaultInjector(MCP39F511Transport *transport, QObject *parent) : MCP39F511Transport(parent) {
+	this->transport = transport;
+	transport->setParent(this);
+	connect(transport, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+	
+	fault = FAULT_NONE;
+	probability = 0;
+	pendingFault = FAULT_NONE;
+	nakBurstRemaining = 0;
+	releaseDelayed = false;
+	injectedCount = 0;
+	
+	delayTimer = new QTimer(this);
+	delayTimer->setSingleShot(true);
+	connect(delayTimer, SIGNAL(timeout()), this, SLOT(slotReleaseDelayed()));
+}
+
+MCP39F511FaultInjector::~MCP39F511FaultInjector() {
+}
+
+QString MCP39F511FaultInjector::faultName(mcp39F511_fault fault) {
+	switch(fault) {
+		case FAULT_NONE: return "None";
+		case FAULT_DROPPED_BYTE: return "Dropped byte";
+		case FAULT_CORRUPT_CHECKSUM: return "Corrupt checksum";
+		case FAULT_NAK_BURST: return "NAK burst";
+		case FAULT_DELAYED_RESPONSE: return "Delayed response";
+		case FAULT_GARBAGE: return "Garbage between frames";
+		default: return "Unknown";
+	}
+}
+
+void MCP39F511FaultInjector::setFault(int fault, int probability) {
+	this->fault = (mcp39F511_fault)fault;
+	this->probability = probability;
+	pendingFault = FAULT_NONE;
+	nakBurstRemaining = 0;
+	injectedCount = 0;
+	dropDelayed();
+}
+
+int MCP39F511FaultInjector::getInjectedCount() {
+	return injectedCount.loadAcquire();
+}
+
+bool MCP39F511FaultInjector::open() {
+	return transport->open();
+}
+
+void MCP39F511FaultInjector::close() {
+	dropDelayed();
+	transport->close();
+}
+
+bool MCP39F511FaultInjector::isOpen() {
+	return transport->isOpen();
+}
+
+/**
+ * A response still held back belongs to a frame that has been given up on, it must not be
+ * released against the retry
+ */
+void MCP39F511FaultInjector::flush() {
+	dropDelayed();
+	transport->flush();
+}
+
+void MCP39F511FaultInjector::dropDelayed() {
+	delayTimer->stop();
+	delayed.clear();
+	releaseDelayed = false;
+}
+
+void MCP39F511FaultInjector::setReset(bool asserted) {
+	transport->setReset(asserted);
+}
+
+/**
+ * Each frame sent decides whether its response will be damaged
+ */
+int MCP39F511FaultInjector::write(const u_int8_t *data, int length) {
+	if(nakBurstRemaining > 0) {
+		nakBurstRemaining--;
+		pendingFault = FAULT_NAK_BURST;
+	} else if(fault != FAULT_NONE && (rand() % 100) < probability) {
+		pendingFault = fault;
+		injectedCount.ref();
+		if(fault == FAULT_NAK_BURST) {
+			nakBurstRemaining = FAULT_NAK_BURST_LENGTH - 1;
+		}
+	}
+	return transport->write(data, length);
+}
+
+int MCP39F511FaultInjector::read(u_int8_t *data, int length) {
+	/* Hand over a response that was held back */
+	if(releaseDelayed) {
+		int count = qMin(length, delayed.size());
+		memcpy(data, delayed.constData(), count);
+		delayed.remove(0, count);
+		releaseDelayed = !delayed.isEmpty();
+		return count;
+	}
+	
+	/* Leave room for garbage to be inserted */
+	int count = transport->read(data, length - FAULT_GARBAGE_LENGTH);
+	if(count <= 0 || pendingFault == FAULT_NONE) {
+		return count;
+	}
+	
+	mcp39F511_fault applied = pendingFault;
+	pendingFault = FAULT_NONE;
+	switch(applied) {
+		case FAULT_DROPPED_BYTE: {
+			int position = rand() % count;
+			memmove(&data[position], &data[position + 1], count - position - 1);
+			count--;
+			break;
+		}
+		
+		case FAULT_CORRUPT_CHECKSUM:
+			data[count - 1] ^= 0x5A;
+			break;
+			
+		case FAULT_NAK_BURST:
+			data[0] = FAULT_RESP_NAK;
+			count = 1;
+			break;
+			
+		case FAULT_DELAYED_RESPONSE:
+			delayed.append((const char *)data, count);
+			delayTimer->start(FAULT_DELAY_TIME);
+			count = 0;
+			break;
+			
+		case FAULT_GARBAGE:
+			memmove(&data[FAULT_GARBAGE_LENGTH], data, count);
+			for(int i = 0; i < FAULT_GARBAGE_LENGTH; i++) {
+				data[i] = rand() & 0xFF;
+			}
+			count += FAULT_GARBAGE_LENGTH;
+			break;
+			
+		default:
+			break;
+	}
+	return count;
+}
+
+void MCP39F511FaultInjector::slotReleaseDelayed() {
+	releaseDelayed = true;
+	emit readyRead();
+}
@@ -0,0 +1,108 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511FaultInjector.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 16:40
+ */
+
+#ifndef MCP39F511FAULTINJECTOR_H
+#define MCP39F511FAULTINJECTOR_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QTimer>
+
+#include "MCP39F511Transport.h"
+
+/* Number of consecutive responses replaced by a NAK in a NAK burst */
+#define FAULT_NAK_BURST_LENGTH 3
+/* Time in milliseconds a delayed response is held back, longer than the transaction timeout */
+#define FAULT_DELAY_TIME 250
+/* Number of random bytes inserted ahead of a response */
+#define FAULT_GARBAGE_LENGTH 4
+
+typedef enum {
+	FAULT_NONE,
+	FAULT_DROPPED_BYTE,
+	FAULT_CORRUPT_CHECKSUM,
+	FAULT_NAK_BURST,
+	FAULT_DELAYED_RESPONSE,
+	FAULT_GARBAGE,
+	FAULT_TYPES
+} mcp39F511_fault;
+
+/**
+ * Transport that sits between MCP39F511Comms and the real transport and damages responses
+ * from the MCP39F511 so the retry and recovery paths can be exercised and benchmarked.
+ * Each frame sent has a configurable chance of its response being hit by the selected fault.
+ */
+class MCP39F511FaultInjector : public MCP39F511Transport {
+	Q_OBJECT
+	
+public:
+	/**
+	 * @param transport Transport to the MCP39F511, ownership is taken
+	 */
+	MCP39F511FaultInjector(MCP39F511Transport *transport, QObject *parent);
+	virtual ~MCP39F511FaultInjector();
+	
+	bool open();
+	void close();
+	bool isOpen();
+	int read(u_int8_t *data, int length);
+	int write(const u_int8_t *data, int length);
+	void flush();
+	void setReset(bool asserted);
+	
+	/**
+	 * Select the fault to inject
+	 * @param fault mcp39F511_fault to inject, FAULT_NONE to stop
+	 * @param probability Percentage chance of each response being hit
+	 */
+	Q_INVOKABLE void setFault(int fault, int probability);
+	
+	/**
+	 * Safe to call from any thread.
+	 * @return Number of faults injected since setFault() was called
+	 */
+	int getInjectedCount();
+	
+	static QString faultName(mcp39F511_fault fault);
+	
+private slots:
+	void slotReleaseDelayed();
+	
+private:
+	void dropDelayed();
+	
+	MCP39F511Transport *transport;
+	mcp39F511_fault fault;
+	int probability;
+	mcp39F511_fault pendingFault;
+	int nakBurstRemaining;
+	QTimer *delayTimer;
+	QByteArray delayed;
+	bool releaseDelayed;
+	QAtomicInt injectedCount;
+};
+
+#endif /* MCP39F511FAULTINJECTOR_H */
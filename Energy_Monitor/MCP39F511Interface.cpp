@@ -25,16 +25,27 @@
  */
 
 #include "MCP39F511Interface.h"
+#include "MeasurementFilter.h"
 
-#include <unistd.h>
+#include <string.h>
 
+#include <QDateTime>
 #include <QDebug>
+#include <QTimer>
 #include <QtMath>
 
-/* The number of samples that have to be over the threshold before the measurements are displayed / logged */
+static_assert(MCP_OUTPUT_REGISTERS_SIZE - MCP_OUTPUT_REG_VOLTAGE_RMS <= MCP_ACQ_MAX_MEASUREMENT_SIZE, "Measurements too long for the acquisition scheduler");
+
+/* The number of samples power has to be over the threshold before it is displayed / logged */
 #define NOISE_FILTER_SAMPLES 2
+/* Thresholds in precision mode, raised for shorter accumulation intervals */
 #define POWER_ACTIVE_THRESHOLD 0.05
 #define POWER_REACTIVE_THRESHOLD 0.05
+/* Threshold scale indexed by how many powers of two the accumulation interval is shorter than
+   precision mode, the square root of the number of times fewer line cycles are averaged */
+static const double noiseThresholdScales[MCP_ACCUMULATION_INTERVAL_PRECISION + 1] = {
+    1, M_SQRT2, 2, 2 * M_SQRT2, 4, 4 * M_SQRT2, 8, 8 * M_SQRT2
+};
 
 /* PWM module
  * PWM Frequency = 1 / (Ptimer * 2 * prescaler * PWM register)
@@ -50,40 +61,108 @@
 #define MCP_SOUNDER_PWM_DUTY_CYLCE 248
 
 
-MCP39F511Interface::MCP39F511Interface(QObject *parent) {
+MCP39F511Interface::MCP39F511Interface(QObject *parent) :
+	mcpOutputReg(*(McpOutputRegisters *)registerCache.shadow(MCP_OUTPUT_REGISTERS_START)),
+	mcpEnergyCounterReg(*(McpEnergyCounterRegisters *)registerCache.shadow(MCP_ENERGY_COUNTER_REGISTERS_START)),
+	mcpRecordReg(*(McpRecordRegisters *)registerCache.shadow(MCP_RECORD_REGISTERS_START)),
+	mcpCalibReg(*(McpCalibrationRegisters *)registerCache.shadow(MCP_CALIBRATION_REGISTERS_START)),
+	mcpConfigReg1(*(McpConfigurationRegisters1 *)registerCache.shadow(MCP_CONFIG_REGISTERS_1_START)),
+	mcpConfigReg2(*(McpConfigurationRegisters2 *)registerCache.shadow(MCP_CONFIG_REGISTERS_2_START)),
+	mcpCompPeriphReg(*(McpCompPeriphRegisters *)registerCache.shadow(MCP_COMP_PERIPH_REGISTERS_START)) {
 	setParent(parent);
+	mcp_comms = NULL;
+	commsThread = NULL;
+	interByteGap = SERIAL_INTER_BYTE_GAP;
+	pipelined = false;
+	serialDevice = SERIAL_PORT;
+	resetGpio = GPIO_MCP39F511_RESET;
+	deviceId = 0;
+	faultInjectionEnabled = false;
+	faultInjector = NULL;
+	captureTransport = NULL;
+	replayTransport = NULL;
+	lostSamples = 0;
+	measurementSequence = 0;
+	energyTimeStamp = 0;
+	counterResetWallClock = 0;
+	
+	acquisitionScheduler = new MCP39F511AcquisitionScheduler(this);
+	connect(acquisitionScheduler, SIGNAL(readDue()), this, SLOT(slotAcquisitionReadDue()));
+	
+	energyTimer = new QTimer(this);
+	connect(energyTimer, SIGNAL(timeout()), this, SLOT(slotEnergyReadDue()));
+	flashSaving = false;
+	acquisitionAfterFlashSave = false;
+	
+	noiseFilter = new MeasurementFilter(this);
+	FilterConfig powerNoise = {FILTER_DEADBAND, NOISE_FILTER_SAMPLES, 1, POWER_ACTIVE_THRESHOLD, 0};
+	noiseFilter->setFilter(MEASUREMENT_POWER_ACTIVE, powerNoise);
+	powerNoise.threshold = POWER_REACTIVE_THRESHOLD;
+	noiseFilter->setFilter(MEASUREMENT_POWER_REACTIVE, powerNoise);
 }
 
 MCP39F511Interface::~MCP39F511Interface() {
 }
 
+void MCP39F511Interface::printMessage(QString message) {
+	if(deviceId) {
+		qDebug() << QString("MCP39F511 interface %1: ").arg(deviceId) << message;
+	} else {
+		qDebug() << "MCP39F511 interface: " << message;
+	}
+}
+
 /*
  * Initialise the MCP39F511 energy monitor
  */
 bool MCP39F511Interface::initialise() {
-	mcp_comms = new MCP39F511Comms(this);
-	/* Ensure we are notified when a transaction has completed */
-	connect(mcp_comms, SIGNAL(transactionComplete(Mcp39F511Transaction)), this, SLOT(transactionComplete(Mcp39F511Transaction)));
-	if(!mcp_comms->initialise()) {
+	bool commsInitialised = false;
+	
+	/* Serial comms run on their own thread so the GUI can't disturb sample timing */
+	commsThread = new QThread(this);
+	mcp_comms = new MCP39F511Comms(NULL);
+	MCP39F511Transport *transport;
+	if(!replayFile.isEmpty()) {
+		replayTransport = new MCP39F511ReplayTransport(replayFile, NULL);
+		connect(replayTransport, SIGNAL(finished()), this, SIGNAL(replayFinished()), Qt::QueuedConnection);
+		transport = replayTransport;
+	} else {
+		transport = new MCP39F511SerialTransport(serialDevice, SERIAL_BAUD_RATE, resetGpio, NULL);
+		/* Capture what crosses the serial port, before any faults are injected */
+		if(!captureFile.isEmpty()) {
+			captureTransport = new MCP39F511CaptureTransport(transport, NULL);
+			transport = captureTransport;
+		}
+	}
+	if(faultInjectionEnabled) {
+		faultInjector = new MCP39F511FaultInjector(transport, NULL);
+		transport = faultInjector;
+	}
+	mcp_comms->setTransport(transport);
+	/* Spread the comms threads of several MCP39F511 over the cores */
+	mcp_comms->setThreadCpu(COMMS_THREAD_CPU - deviceId % COMMS_THREAD_CPUS);
+	mcp_comms->moveToThread(commsThread);
+	connect(commsThread, SIGNAL(finished()), mcp_comms, SLOT(deleteLater()));
+	/* Ensure we are notified when transactions have completed */
+	connect(mcp_comms, SIGNAL(completionsAvailable()), this, SLOT(slotCompletionsAvailable()), Qt::QueuedConnection);
+	mcp_comms->setInterByteGap(interByteGap);
+	mcp_comms->setPipelined(pipelined);
+	commsThread->start();
+	
+	QMetaObject::invokeMethod(mcp_comms, "initialise", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, commsInitialised));
+	if(!commsInitialised) {
 		return false;
 	}
 	
-    outputTransactionId = 0;
-	energyCounterTransactionId = 0;
-	recordTransactionId = 0;
-	calibrationTransactionId = 0;
-	config1TransactionId = 0;
-	config2TransactionId = 0;
-	compPeriphTransactionId = 0;
-    factoryResetId = 0;
-    readAllRegistersId = 0;
+    measurementTransactionId = 0;
     
     /* Setup PWM first so readAllRegisters() doesn't overwrite
        registers that have been configured whilst its in the queue
        to be sent to the chip. */
     setupPWM(MCP_SOUNDER_FREQUENCY, MCP_SOUNDER_PWM_DUTY_CYLCE);
-	readAllRegistersId = readAllRegisters();
-    initialisationInProgress = true;
+	onComplete(readAllRegisters(), [this](const Mcp39F511TransactionRef &) {
+		emit initialisationComplete();
+	});
 	return true;
 }
 
@@ -93,14 +172,33 @@ bool MCP39F511Interface::initialise() {
  * @return Returns TRUE if OK, otherwise FALSE.
  */
 bool MCP39F511Interface::close() {
-	bool close_state;
-	close_state = mcp_comms->close();
-	mcp_comms->deleteLater();
+	bool close_state = false;
+	acquisitionScheduler->stop();
+	energyTimer->stop();
+	QMetaObject::invokeMethod(mcp_comms, "close", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, close_state));
+	saveCapture();
+	/* Stopping the thread deletes the comms object */
+	commsThread->quit();
+	commsThread->wait();
+	commsThread->deleteLater();
+	mcp_comms = NULL;
+	commsThread = NULL;
+	/* The transports went with the comms object */
+	faultInjector = NULL;
+	captureTransport = NULL;
+	replayTransport = NULL;
+	/* Transaction IDs start again with the next comms object */
+	completionRegistry.clear();
 	return close_state;
 }
 
 void MCP39F511Interface::resetMCP39F511() {
-    mcp_comms->resetMCP39F511();
+    /* The registers go back to their flash values and the energy counters to zero,
+       the next energy read enables accumulation again and carries the totals over */
+    registerCache.invalidate();
+    energyAccumulator.counterReset();
+    counterResetWallClock = QDateTime::currentMSecsSinceEpoch();
+    QMetaObject::invokeMethod(mcp_comms, "resetMCP39F511", Qt::QueuedConnection);
 }
 
 /*
@@ -110,11 +208,11 @@ void MCP39F511Interface::beep_on(bool enabled) {
 	if(enabled) {
 		/* Ensure sounder is on */
 		mcpCompPeriphReg.PWM_control = MCP_PWM_CONTROL_PWM_CNTRL;
-		mcp_comms->enqueTransaction(MCP_COMP_PERIPH_REG_PWM_CONTROL, (u_int8_t*) &mcpCompPeriphReg.PWM_control, sizeof(mcpCompPeriphReg.PWM_control), MCP_CMD_REGISTER_WRITE);
+		setRegister(MCP_COMP_PERIPH_REG_PWM_CONTROL, (u_int8_t*) &mcpCompPeriphReg.PWM_control, sizeof(mcpCompPeriphReg.PWM_control));
 	} else {
 		/* Ensure sounder is off */
 		mcpCompPeriphReg.PWM_control = 0;
-		mcp_comms->enqueTransaction(MCP_COMP_PERIPH_REG_PWM_CONTROL, (u_int8_t*) &mcpCompPeriphReg.PWM_control, sizeof(mcpCompPeriphReg.PWM_control), MCP_CMD_REGISTER_WRITE);
+		setRegister(MCP_COMP_PERIPH_REG_PWM_CONTROL, (u_int8_t*) &mcpCompPeriphReg.PWM_control, sizeof(mcpCompPeriphReg.PWM_control));
 	}
 }
 
@@ -135,60 +233,318 @@ void MCP39F511Interface::setupPWM(int frequency, int duty_cycle) {
 	mcpCompPeriphReg.PWM_duty_cycle = (calculated_duty_cycle & MCP_PWM_DUTY_UPPER_MASK) << MCP_PWM_DUTY_UPPER_POS; //duty_cycle * 4 * frequency;
 	mcpCompPeriphReg.PWM_duty_cycle |= (calculated_duty_cycle & MCP_PWM_DUTY_LOWER_MASK) << MCP_PWM_DUTY_LOWER_POS;
 
-	mcp_comms->enqueTransaction(MCP_COMP_PERIPH_REG_PWM_PERIOD, (u_int8_t*) &mcpCompPeriphReg.PWM_period, sizeof(mcpCompPeriphReg.PWM_period) + sizeof(mcpCompPeriphReg.PWM_duty_cycle), MCP_CMD_REGISTER_WRITE);
+	setRegister(MCP_COMP_PERIPH_REG_PWM_PERIOD, (u_int8_t*) &mcpCompPeriphReg.PWM_period, sizeof(mcpCompPeriphReg.PWM_period) + sizeof(mcpCompPeriphReg.PWM_duty_cycle));
     
 	/* Ensure sounder is off */
 	beep_on(false);
 }
 
+void MCP39F511Interface::setInterByteGap(int milliseconds) {
+	interByteGap = milliseconds;
+	if(mcp_comms) {
+		QMetaObject::invokeMethod(mcp_comms, "setInterByteGap", Qt::QueuedConnection, Q_ARG(int, interByteGap));
+	}
+}
+
+void MCP39F511Interface::setSerialDevice(QString device, int resetGpio) {
+	serialDevice = device;
+	this->resetGpio = resetGpio;
+}
+
+void MCP39F511Interface::setDeviceId(int id) {
+	deviceId = id;
+}
+
+int MCP39F511Interface::getDeviceId() {
+	return deviceId;
+}
+
+void MCP39F511Interface::setFaultInjection(bool enabled) {
+	faultInjectionEnabled = enabled;
+}
+
+void MCP39F511Interface::setFault(mcp39F511_fault fault, int probability) {
+	if(faultInjector) {
+		QMetaObject::invokeMethod(faultInjector, "setFault", Qt::QueuedConnection, Q_ARG(int, fault), Q_ARG(int, probability));
+	}
+}
+
+int MCP39F511Interface::getInjectedFaultCount() {
+	if(faultInjector) {
+		return faultInjector->getInjectedCount();
+	}
+	return 0;
+}
+
+Mcp39F511RecoveryStats MCP39F511Interface::getRecoveryStats() {
+	Mcp39F511RecoveryStats stats = {0, 0, 0, 0, 0};
+	if(mcp_comms) {
+		stats = mcp_comms->getRecoveryStats();
+	}
+	return stats;
+}
+
+void MCP39F511Interface::resetRecoveryStats() {
+	lostSamples = 0;
+	if(mcp_comms) {
+		QMetaObject::invokeMethod(mcp_comms, "resetRecoveryStats", Qt::QueuedConnection);
+	}
+}
+
+int MCP39F511Interface::getLostSamples() {
+	return lostSamples;
+}
+
+void MCP39F511Interface::setPipelined(bool enabled) {
+	pipelined = enabled;
+	if(mcp_comms) {
+		QMetaObject::invokeMethod(mcp_comms, "setPipelined", Qt::QueuedConnection, Q_ARG(bool, pipelined));
+	}
+}
+
+Mcp39F511QueueStats MCP39F511Interface::getQueueStats(mcp39F511_priority priority) {
+	Mcp39F511QueueStats stats = {0, 0, 0};
+	if(mcp_comms) {
+		stats = mcp_comms->getQueueStats(priority);
+	}
+	return stats;
+}
+
+void MCP39F511Interface::startAcquisition() {
+	/* Started once the measurement mode has been written to flash */
+	if(flashSaving) {
+		acquisitionAfterFlashSave = true;
+		return;
+	}
+	acquisitionScheduler->start();
+	/* Carries on through bursts, which stop and start the acquisition */
+	if(!energyTimer->isActive()) {
+		slotEnergyReadDue();
+		energyTimer->start(MCP_ENERGY_READ_INTERVAL);
+	}
+}
+
+void MCP39F511Interface::stopAcquisition() {
+	acquisitionAfterFlashSave = false;
+	acquisitionScheduler->stop();
+}
+
+bool MCP39F511Interface::isAcquisitionRunning() {
+	return acquisitionScheduler->isRunning() || acquisitionAfterFlashSave;
+}
+
+int MCP39F511Interface::setAcquisitionRate(double samplesPerSecond) {
+	double lineFrequency = McpFrequencyScale::toDouble(mcpOutputReg.line_frequency);
+	if(samplesPerSecond <= 0) {
+		return 0;
+	}
+	if(lineFrequency <= 0) {
+		lineFrequency = MCP_ACQ_NOMINAL_LINE_FREQUENCY;
+	}
+	/* 2^N line cycles are accumulated for each measurement */
+	int parameter = qCeil(qLn(lineFrequency / samplesPerSecond) / qLn(2));
+	mcpConfigReg2.accumulation_interval_parameter = qBound(0, parameter, MCP_ACQ_MAX_ACCUMULATION_INTERVAL);
+	printMessage(QString("Accumulation interval set to %1 line cycles, %2 samples per second.")
+				 .arg(1 << mcpConfigReg2.accumulation_interval_parameter)
+				 .arg(lineFrequency / (1 << mcpConfigReg2.accumulation_interval_parameter)));
+	return setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t *)&mcpConfigReg2.accumulation_interval_parameter, sizeof(mcpConfigReg2.accumulation_interval_parameter));
+}
+
+measurement_mode MCP39F511Interface::getMeasurementMode() {
+	if(mcpConfigReg2.accumulation_interval_parameter <= MCP_ACCUMULATION_INTERVAL_FAST) {
+		return MEASUREMENT_MODE_FAST;
+	}
+	return MEASUREMENT_MODE_PRECISION;
+}
+
+int MCP39F511Interface::setMeasurementMode(int mode, bool persist) {
+	u_int16_t parameter = MCP_ACCUMULATION_INTERVAL_PRECISION;
+	if(mode == MEASUREMENT_MODE_FAST) {
+		parameter = MCP_ACCUMULATION_INTERVAL_FAST;
+	}
+	/* Don't wear the flash rewriting what is already there */
+	if(mcpConfigReg2.accumulation_interval_parameter == parameter) {
+		return 0;
+	}
+	
+	mcpConfigReg2.accumulation_interval_parameter = parameter;
+	int transactionId = setRegister(MCP_CONFIG_2_ACCUMULATION_INTERVAL, (u_int8_t *)&mcpConfigReg2.accumulation_interval_parameter, sizeof(mcpConfigReg2.accumulation_interval_parameter));
+	printMessage(QString("%1 measurement mode selected, averaging over %2 line cycles.")
+				 .arg(mode == MEASUREMENT_MODE_FAST ? "Fast" : "Precision").arg(1 << parameter));
+	if(!persist || flashSaving) {
+		return transactionId;
+	}
+	
+	/* Saved so the MCP39F511 starts up in this mode, nothing is read while the flash is written */
+	acquisitionAfterFlashSave = isAcquisitionRunning();
+	acquisitionScheduler->stop();
+	flashSaving = true;
+	transactionId = saveRegistersToFlash();
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &) {
+		QTimer::singleShot(MCP_FLASH_SAVE_TIME, this, [this]() {
+			flashSaving = false;
+			if(acquisitionAfterFlashSave) {
+				acquisitionAfterFlashSave = false;
+				startAcquisition();
+			}
+		});
+	});
+	return transactionId;
+}
+
+void MCP39F511Interface::slotAcquisitionReadDue() {
+	getOutputRegisters();
+}
+
+void MCP39F511Interface::slotEnergyReadDue() {
+	/* Nothing is written once the MCP39F511 is known to be accumulating, this catches it
+	   after a reset or factory reset has cleared the register */
+	mcpCompPeriphReg.energy_control = MCP_ENERGY_CONTROL_ENABLE;
+	setRegister(MCP_COMP_PERIPH_ENERGY_CONTROL, (u_int8_t *)&mcpCompPeriphReg.energy_control, sizeof(mcpCompPeriphReg.energy_control), MCP_PRIORITY_BACKGROUND);
+	getEnergyCounterRegisters(MCP_PRIORITY_BACKGROUND);
+}
+
+EnergyTotals MCP39F511Interface::getEnergyTotals() {
+	EnergyTotals energy = energyAccumulator.getTotals();
+	energy.timeStamp = energyTimeStamp;
+	energy.deviceId = deviceId;
+	return energy;
+}
+
+void MCP39F511Interface::clearEnergyTotals() {
+	energyAccumulator.clear();
+}
+
+MCP39F511EnergyAccumulator *MCP39F511Interface::getEnergyAccumulator() {
+	return &energyAccumulator;
+}
+
+Mcp39F511AcquisitionStats MCP39F511Interface::getAcquisitionStats() {
+	return acquisitionScheduler->getStats();
+}
+
+void MCP39F511Interface::setCaptureFile(QString fileName) {
+	captureFile = fileName;
+}
+
+bool MCP39F511Interface::saveCapture() {
+	if(captureTransport) {
+		return captureTransport->save(captureFile);
+	}
+	return false;
+}
+
+void MCP39F511Interface::setReplayFile(QString fileName) {
+	replayFile = fileName;
+}
+
+Mcp39F511ReplayStats MCP39F511Interface::getReplayStats() {
+	Mcp39F511ReplayStats stats = {0, 0, 0, false};
+	if(replayTransport) {
+		stats = replayTransport->getStats();
+	}
+	return stats;
+}
+
+BufferPoolStats MCP39F511Interface::getPoolStats() {
+	return Mcp39F511TransactionPool::getStats();
+}
+
+double MCP39F511Interface::getTransactionRate() {
+	if(mcp_comms) {
+		return mcp_comms->getTransactionRate();
+	}
+	return 0;
+}
+
 int MCP39F511Interface::readAllRegisters() {
-    if(readAllRegistersId) {
-        return readAllRegistersId;
-    } else {
-        getOutputRegisters();
-        getEnergyCounterRegisters();
-        getRecordRegisters();
-        getCalibrationRegisters();
-        getDesignConfig1Registers();
-        getDesignConfig2Registers();
-        readAllRegistersId = getCompPeriphRegisters();
-        return readAllRegistersId;
-    }
+	int transactionId;
+	
+	getOutputRegisters();
+	getEnergyCounterRegisters();
+	getRecordRegisters();
+	getCalibrationRegisters();
+	getDesignConfig1Registers();
+	getDesignConfig2Registers();
+	/* Completes last as everything else was queued ahead of it */
+	transactionId = getCompPeriphRegisters();
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		emit readAllRegistersComplete(transaction->unique_id);
+	});
+	return transactionId;
 }
 
 int MCP39F511Interface::getOutputRegisters() {
-	if(outputTransactionId) {
-		return outputTransactionId;
-	} else {
-		outputTransactionId = getRegister(MCP_OUTPUT_REGISTERS_START, (u_int8_t *)&mcpOutputReg, MCP_OUTPUT_REGISTERS_SIZE);
-		return outputTransactionId;
+	if(measurementTransactionId) {
+		/* The previous read hasn't completed so this sample is missed */
+		lostSamples++;
+		measurementSequence++;
+		return measurementTransactionId;
 	}
+	measurementTransactionId = getRegister(MCP_OUTPUT_REGISTERS_START, (u_int8_t *)&mcpOutputReg, MCP_OUTPUT_REGISTERS_SIZE, MCP_PRIORITY_MEASUREMENT);
+	onComplete(measurementTransactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		measurementTransactionId = 0;
+		if(transaction->status != COMMS_COMPLETE) {
+			/* A failed measurement read is a lost sample */
+			lostSamples++;
+			measurementSequence++;
+			if(acquisitionScheduler->isRunning()) {
+				acquisitionScheduler->readFailed();
+			}
+			return;
+		}
+		emit outputRegistersReady(mcpOutputReg, transaction->unique_id);
+		if(acquisitionScheduler->isRunning()) {
+			acquisitionScheduler->setAccumulationPeriod(MCP39F511AcquisitionScheduler::accumulationPeriod(mcpConfigReg2.accumulation_interval_parameter, McpFrequencyScale::toDouble(mcpOutputReg.line_frequency)));
+			/* Only new measurements are decoded so nothing is logged twice */
+			if(!acquisitionScheduler->readComplete((const u_int8_t *)&mcpOutputReg + MCP_OUTPUT_REG_VOLTAGE_RMS,
+												   MCP_OUTPUT_REGISTERS_SIZE - MCP_OUTPUT_REG_VOLTAGE_RMS)) {
+				return;
+			}
+		}
+		decodeMeasurements(transaction);
+	});
+	return measurementTransactionId;
 }
 
 /**
  * Get energy counter registers
  * @return Unique transaction ID.
  */
-int MCP39F511Interface::getEnergyCounterRegisters() {
-	if(energyCounterTransactionId) {
-		return energyCounterTransactionId;
-	} else {
-		energyCounterTransactionId = getRegister(MCP_ENERGY_COUNTER_REGISTERS_START, (u_int8_t *)&mcpEnergyCounterReg, MCP_ENERGY_COUNTER_REGISTERS_SIZE);
-		return energyCounterTransactionId;
-	}
+int MCP39F511Interface::getEnergyCounterRegisters(mcp39F511_priority priority) {
+	int transactionId = getRegister(MCP_ENERGY_COUNTER_REGISTERS_START, (u_int8_t *)&mcpEnergyCounterReg, MCP_ENERGY_COUNTER_REGISTERS_SIZE, priority);
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		if(transaction->status != COMMS_COMPLETE) {
+			return;
+		}
+		emit energyCounterRegistersReady(mcpEnergyCounterReg, transaction->unique_id);
+		/* Read before the reset but not yet handled, the counters have been cleared since */
+		if(transaction->receivedWallClock <= counterResetWallClock) {
+			return;
+		}
+		u_int64_t counters[ENERGY_COUNTERS] = {
+			mcpEnergyCounterReg.import_active_energy_counter,
+			mcpEnergyCounterReg.export_active_energy_counter,
+			mcpEnergyCounterReg.import_reactive_energy_counter,
+			mcpEnergyCounterReg.export_reactive_energy_counter
+		};
+		energyAccumulator.update(counters);
+		energyTimeStamp = transaction->receivedWallClock;
+		emit energyTotalsReady(getEnergyTotals());
+	});
+	return transactionId;
 }
 	
 /**
  * Get min / max record registers
  * @return Unique transaction ID.
  */
-int MCP39F511Interface::getRecordRegisters() {
-	if(recordTransactionId) {
-		return recordTransactionId;
-	} else {
-		recordTransactionId = getRegister(MCP_RECORD_REGISTERS_START, (u_int8_t *)&mcpRecordReg, MCP_RECORD_REGISTERS_SIZE);
-		return recordTransactionId;
-	}
+int MCP39F511Interface::getRecordRegisters(mcp39F511_priority priority) {
+	int transactionId = getRegister(MCP_RECORD_REGISTERS_START, (u_int8_t *)&mcpRecordReg, MCP_RECORD_REGISTERS_SIZE, priority);
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		emit recordRegistersReady(mcpRecordReg, transaction->unique_id);
+	});
+	return transactionId;
 }
 
 /**
@@ -196,12 +552,11 @@ int MCP39F511Interface::getRecordRegisters() {
  * @return Unique transaction ID.
  */
 int MCP39F511Interface::getCalibrationRegisters() {
-	if(calibrationTransactionId) {
-		return calibrationTransactionId;
-	} else {
-		calibrationTransactionId = getRegister(MCP_CALIBRATION_REGISTERS_START, (u_int8_t *)&mcpCalibReg, MCP_CALIBRATION_REGISTERS_SIZE);
-		return calibrationTransactionId;
-	}
+	int transactionId = getRegister(MCP_CALIBRATION_REGISTERS_START, (u_int8_t *)&mcpCalibReg, MCP_CALIBRATION_REGISTERS_SIZE);
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		emit calibrationRegistersReady(mcpCalibReg, transaction->unique_id);
+	});
+	return transactionId;
 }
 
 /**
@@ -209,12 +564,11 @@ int MCP39F511Interface::getCalibrationRegisters() {
  * @return Unique transaction ID.
  */
 int MCP39F511Interface::getDesignConfig1Registers() {
-	if(config1TransactionId) {
-		return config1TransactionId;
-	} else {
-		config1TransactionId = getRegister(MCP_CONFIG_REGISTERS_1_START, (u_int8_t *)&mcpConfigReg1, MCP_CONFIG_REGISTERS_1_SIZE);
-		return config1TransactionId;
-	}
+	int transactionId = getRegister(MCP_CONFIG_REGISTERS_1_START, (u_int8_t *)&mcpConfigReg1, MCP_CONFIG_REGISTERS_1_SIZE);
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		emit config1RegistersReady(mcpConfigReg1, transaction->unique_id);
+	});
+	return transactionId;
 }
 
 /**
@@ -222,12 +576,11 @@ int MCP39F511Interface::getDesignConfig1Registers() {
  * @return Unique transaction ID.
  */
 int MCP39F511Interface::getDesignConfig2Registers() {
-	if(config2TransactionId) {
-		return config2TransactionId;
-	} else {
-		config2TransactionId = getRegister(MCP_CONFIG_REGISTERS_2_START, (u_int8_t *)&mcpConfigReg2, MCP_CONFIG_REGISTERS_2_SIZE);
-		return config2TransactionId;
-	}
+	int transactionId = getRegister(MCP_CONFIG_REGISTERS_2_START, (u_int8_t *)&mcpConfigReg2, MCP_CONFIG_REGISTERS_2_SIZE);
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		emit config2RegistersReady(mcpConfigReg2, transaction->unique_id);
+	});
+	return transactionId;
 }
 
 /**
@@ -235,23 +588,90 @@ int MCP39F511Interface::getDesignConfig2Registers() {
  * @return Unique transaction ID.
  */
 int MCP39F511Interface::getCompPeriphRegisters() {
-	if(compPeriphTransactionId) {
-		return compPeriphTransactionId;
-	} else {
-		compPeriphTransactionId = getRegister(MCP_COMP_PERIPH_REGISTERS_START, (u_int8_t *)&mcpCompPeriphReg, MCP_COMP_PERIPH_REGISTERS_SIZE);
-		return compPeriphTransactionId;
-	}
+	int transactionId = getRegister(MCP_COMP_PERIPH_REGISTERS_START, (u_int8_t *)&mcpCompPeriphReg, MCP_COMP_PERIPH_REGISTERS_SIZE);
+	onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+		emit compPeriphRegistersReady(mcpCompPeriphReg, transaction->unique_id);
+	});
+	return transactionId;
+}
+
+void MCP39F511Interface::onComplete(int transactionId, const Mcp39F511Callback &callback) {
+	completionRegistry.add(transactionId, callback);
 }
 
 
 /* Set a register and return a unique ID for the transaction */
-int MCP39F511Interface::setRegister(u_int16_t address, u_int8_t *data, u_int8_t length) {
-	return mcp_comms->enqueTransaction(address, data, length, MCP_CMD_REGISTER_WRITE);
+int MCP39F511Interface::setRegister(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_priority priority) {
+	/* Measurement registers change by themselves so are always written through */
+	if(address < MCP_CACHEABLE_REGISTERS_START || !registerCache.contains(address, length)) {
+		return mcp_comms->enqueTransaction(address, data, length, MCP_CMD_REGISTER_WRITE, priority);
+	}
+	
+	u_int8_t *shadow = registerCache.shadow(address);
+	if(data != shadow) {
+		memmove(shadow, data, length);
+	}
+	return writeDirtyRegisters(address, length, priority);
 }
 
 /* Get a register and return a unique ID for the transaction */
-int MCP39F511Interface::getRegister(u_int16_t address, u_int8_t *data, u_int8_t length) {
-	return mcp_comms->enqueTransaction(address, data, length, MCP_CMD_REGISTER_READ);
+int MCP39F511Interface::getRegister(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_priority priority) {
+	/* Reads into a caller's own buffer bypass the shadow */
+	if(!registerCache.contains(address, length) || data != registerCache.shadow(address)) {
+		return mcp_comms->enqueTransaction(address, data, length, MCP_CMD_REGISTER_READ, priority);
+	}
+	
+	if(registerCache.isCached(address, length)) {
+		/* Complete behind anything already queued so the caller sees its own writes in order */
+		return mcp_comms->sendCommand(MCP_CMD_SYNC, priority);
+	}
+	return mcp_comms->enqueTransaction(address, registerCache.receiveBuffer(address), length, MCP_CMD_REGISTER_READ, priority);
+}
+
+int MCP39F511Interface::flushRegisters() {
+	const u_int16_t bankStart[] = {MCP_CALIBRATION_REGISTERS_START, MCP_CONFIG_REGISTERS_1_START, MCP_CONFIG_REGISTERS_2_START, MCP_COMP_PERIPH_REGISTERS_START};
+	const int bankSize[] = {MCP_CALIBRATION_REGISTERS_SIZE, MCP_CONFIG_REGISTERS_1_SIZE, MCP_CONFIG_REGISTERS_2_SIZE, MCP_COMP_PERIPH_REGISTERS_SIZE};
+	const int banks = sizeof(bankStart) / sizeof(bankStart[0]);
+	int transactionId = 0;
+	
+	for(int i = 0; i < banks; i++) {
+		if(registerCache.isCached(bankStart[i], bankSize[i])) {
+			/* A bank that couldn't be queued stays dirty, keep the ID of the last write that was */
+			int bankId = writeDirtyRegisters(bankStart[i], bankSize[i], MCP_PRIORITY_CONTROL);
+			if(bankId != 0) {
+				transactionId = bankId;
+			}
+		}
+	}
+	/* The last write completes after the others, a sync does when there was nothing to write */
+	if(transactionId == 0) {
+		transactionId = mcp_comms->sendCommand(MCP_CMD_SYNC);
+	}
+	return transactionId;
+}
+
+/**
+ * Queue writes for the bytes of a range of the shadow that differ from the MCP39F511
+ * @return Unique transaction ID of the last write queued, or of a sync if nothing needed writing.
+ * 0 if the queue was full before anything could be queued.
+ */
+int MCP39F511Interface::writeDirtyRegisters(u_int16_t address, int length, mcp39F511_priority priority) {
+	int transactionId = 0;
+	QList<QPair<u_int16_t, int> > ranges = registerCache.dirtyRanges(address, length);
+	
+	for(QList<QPair<u_int16_t, int> >::size_type i = 0; i < ranges.size(); i++) {
+		int rangeId = mcp_comms->enqueTransaction(ranges[i].first, registerCache.shadow(ranges[i].first), ranges[i].second, MCP_CMD_REGISTER_WRITE, priority);
+		if(rangeId == 0) {
+			/* Queue full, this and the remaining ranges stay dirty and are picked up by the next write */
+			break;
+		}
+		transactionId = rangeId;
+		registerCache.written(ranges[i].first, ranges[i].second);
+	}
+	if(ranges.isEmpty()) {
+		transactionId = mcp_comms->sendCommand(MCP_CMD_SYNC, priority);
+	}
+	return transactionId;
 }
 
 /* Save flash registers */
@@ -260,9 +680,13 @@ int MCP39F511Interface::saveRegistersToFlash() {
 }
 
 /* Read a page of EEPROM */
-int MCP39F511Interface::eepromReadPage(u_int8_t page) {
-	eepromBuffer[0] = page;
-	return mcp_comms->enqueTransaction(0, eepromBuffer, 1, MCP_CMD_PAGE_READ_EEPROM);
+int MCP39F511Interface::eepromReadPage(u_int8_t page, u_int8_t *data) {
+	if(data == NULL) {
+		data = eepromBuffer;
+	}
+	/* The page number is sent from the start of the buffer the response is received into */
+	data[0] = page;
+	return mcp_comms->enqueTransaction(0, data, 1, MCP_CMD_PAGE_READ_EEPROM, MCP_PRIORITY_BACKGROUND);
 }
 
 /* Write a page of EEPROM */
@@ -271,147 +695,162 @@ int MCP39F511Interface::eepromWritePage(u_int8_t page, u_int8_t *data) {
 	for(int i = 1; i < MCP_EEPROM_PAGE_SIZE + 1; i++) {
 		eepromBuffer[i] = data[i - 1];
 	}
-	return mcp_comms->enqueTransaction(0, eepromBuffer, MCP_EEPROM_PAGE_SIZE + 1, MCP_CMD_PAGE_WRITE_EEPROM);
+	return mcp_comms->enqueTransaction(0, eepromBuffer, MCP_EEPROM_PAGE_SIZE + 1, MCP_CMD_PAGE_WRITE_EEPROM, MCP_PRIORITY_BACKGROUND);
 }
 
 /* Erase the entire contents of EEPROM */
 int MCP39F511Interface::eepromBulkErase() {
-	return mcp_comms->sendCommand(MCP_CMD_BULK_ERASE_EEPROM);
+	return mcp_comms->sendCommand(MCP_CMD_BULK_ERASE_EEPROM, MCP_PRIORITY_BACKGROUND);
 }
 
 /* Auto calibrate gain */
 int MCP39F511Interface::autoCalibrateGain() {
+	registerCache.invalidate(MCP_CALIBRATION_REGISTERS_START, MCP_CALIBRATION_REGISTERS_SIZE);
 	return mcp_comms->sendCommand(MCP_CMD_AUTO_CALIBRATE_GAIN);
 }
 
 /* Auto calibrate gain */
 int MCP39F511Interface::autoCalibrateReactiveGain() {
+	registerCache.invalidate(MCP_CALIBRATION_REGISTERS_START, MCP_CALIBRATION_REGISTERS_SIZE);
 	return mcp_comms->sendCommand(MCP_CMD_AUTO_CALIBRATE_REACTIVE_GAIN);
 }
 
 /* Auto calibrate gain */
 int MCP39F511Interface::autoCalibrateFrequency() {
+	registerCache.invalidate(MCP_CALIBRATION_REGISTERS_START, MCP_CALIBRATION_REGISTERS_SIZE);
 	return mcp_comms->sendCommand(MCP_CMD_AUTO_CALIBRATE_FREQUENCY);
 }
 
 int MCP39F511Interface::factoryResetMcp39F511() {
-    if(factoryResetId) {
-        return factoryResetId;
-    } else {
-        mcpCalibReg.calibration_register_delimieter = 0xA5A5;
-        setRegister(MCP_CALIB_REG_DELIMETER, (u_int8_t *)&mcpCalibReg.calibration_register_delimieter, sizeof(mcpCalibReg.calibration_register_delimieter));
-        factoryResetId = saveRegistersToFlash();
-        return factoryResetId;
-    }
+    int transactionId;
+    
+    mcpCalibReg.calibration_register_delimieter = 0xA5A5;
+    setRegister(MCP_CALIB_REG_DELIMETER, (u_int8_t *)&mcpCalibReg.calibration_register_delimieter, sizeof(mcpCalibReg.calibration_register_delimieter));
+    transactionId = saveRegistersToFlash();
+    onComplete(transactionId, [this](const Mcp39F511TransactionRef &transaction) {
+        int transactionId = transaction->unique_id;
+        /* Give the MCP39F511 time to reset its flash without blocking the event loop */
+        QTimer::singleShot(MCP_FLASH_SAVE_TIME, this, [this, transactionId]() {
+            /* Reset the MCP39F511 after reset flash is complete. */
+            resetMCP39F511();
+            emit factoryResetComplete(transactionId);
+        });
+    });
+    return transactionId;
+}
+
+/**
+ * Drains the transactions completed by the comms thread
+ */
+void MCP39F511Interface::slotCompletionsAvailable() {
+	Mcp39F511TransactionRef transaction;
+	/* The comms object may have been closed while the notification was queued */
+	while(mcp_comms && mcp_comms->takeCompletion(&transaction)) {
+		transactionComplete(transaction);
+	}
 }
 
 /**
  * Called when a comms transaction is complete
  * @param 
  */
-void MCP39F511Interface::transactionComplete(Mcp39F511Transaction transaction) {
-    static DecodedMeasurements energyValuesBuffer[NOISE_FILTER_SAMPLES] = {{0, 0, 0, 0, 0, 0, 0}};
-    static int measurementCount = 0;
-
-	//qDebug("Transaction complete: %d", transaction.unique_id);
-	emit dataReady(transaction);
-
-	/* Power measurement data recieved so emit it as a signal */
-	if(transaction.unique_id == outputTransactionId) {
-		outputTransactionId = 0;
-		emit outputRegistersReady(mcpOutputReg, transaction.unique_id);
-        
-        bool usePowerActive = true;
-        bool usePowerReactive = true;
-        
-        energyValuesBuffer[measurementCount].powerActive = mcpOutputReg.active_power / (double)100;
-        energyValuesBuffer[measurementCount].powerReactive = mcpOutputReg.reactive_power / (double)100;
-        
-        /* Zero these measurement if less than threshold for NOISE_FILTER_SAMPLES measurements */
-        for(int i = 0; i < NOISE_FILTER_SAMPLES; i++) {
-            if(energyValuesBuffer[i].powerActive <= POWER_ACTIVE_THRESHOLD) {
-                usePowerActive = false;
-            }
-            if(energyValuesBuffer[i].powerReactive <= POWER_REACTIVE_THRESHOLD) {
-                usePowerReactive = false;
-            }
-        }
-        
-        DecodedMeasurements energyValues = {0, 0, 0, 0, 0, 0, 0};
-        /* When the Energy values are valid make a copy and scale them to human readable values */
-        energyValues.voltageRms = mcpOutputReg.voltage_RMS / (double)10;
-        energyValues.frequency = mcpOutputReg.line_frequency / (double)1000;
-        /* Each LSB is then equivalent to a weight of 2^(-15) - See MCP39F511 datasheet */
-        energyValues.powerFactor = mcpOutputReg.power_factor * qPow(2, -15);
-        energyValues.currentRms = mcpOutputReg.current_RMS / (double)10000;
-        /* Check active and reactive power have been non zero for several measurements */
-        if(usePowerActive) {
-            energyValues.powerActive = energyValuesBuffer[measurementCount].powerActive;
-        } else {
-            energyValues.powerActive = 0;
-        }
-        if(usePowerReactive) {
-            energyValues.powerReactive = energyValuesBuffer[measurementCount].powerReactive;
-        } else {
-            energyValues.powerReactive = 0;
-        }
-        energyValues.powerApparent = mcpOutputReg.apparent_power / (double)100;
-
-        /* Loop through the filter */
-        if(measurementCount < NOISE_FILTER_SAMPLES) {
-            measurementCount++;
-        } else {
-            measurementCount = 0;
-        }
-
-        emit measurementsReady(energyValues);
+void MCP39F511Interface::transactionComplete(const Mcp39F511TransactionRef &transaction) {
+	/* Keep the register shadow in step with the MCP39F511 before anyone looks at it */
+	if(transaction->command == MCP_CMD_REGISTER_READ && registerCache.contains(transaction->regAddress, transaction->length)
+			&& transaction->dataPtr == registerCache.receiveBuffer(transaction->regAddress)) {
+		if(transaction->status == COMMS_COMPLETE) {
+			registerCache.merge(transaction->regAddress, transaction->length);
+		}
+	} else if(transaction->command == MCP_CMD_REGISTER_WRITE && registerCache.contains(transaction->regAddress, transaction->length)
+			&& transaction->dataPtr == registerCache.shadow(transaction->regAddress)) {
+		registerCache.writeComplete(transaction->regAddress, transaction->length, transaction->status == COMMS_COMPLETE);
+	} else if(transaction->command == MCP_CMD_AUTO_CALIBRATE_GAIN || transaction->command == MCP_CMD_AUTO_CALIBRATE_REACTIVE_GAIN
+			|| transaction->command == MCP_CMD_AUTO_CALIBRATE_FREQUENCY) {
+		/* The calibration registers were invalidated when this was queued but may have been read since */
+		registerCache.invalidate(MCP_CALIBRATION_REGISTERS_START, MCP_CALIBRATION_REGISTERS_SIZE);
 	}
 	
-	if(transaction.unique_id == energyCounterTransactionId) {
-		energyCounterTransactionId = 0;
-		emit energyCounterRegistersReady(mcpEnergyCounterReg, transaction.unique_id);
-	}
+	//qDebug("Transaction complete: %d", transaction->unique_id);
+	emit dataReady(transaction);
 
-	if(transaction.unique_id == recordTransactionId) {
-		recordTransactionId = 0;
-		emit recordRegistersReady(mcpRecordReg, recordTransactionId);
-	}
-	
-	if(transaction.unique_id == calibrationTransactionId) {
-		calibrationTransactionId = 0;
-		emit calibrationRegistersReady(mcpCalibReg, transaction.unique_id);
+	if(transaction->status != COMMS_COMPLETE) {
+		printMessage(QString("Transaction %1 failed, register values not updated.").arg(transaction->unique_id));
 	}
 	
-	if(transaction.unique_id == config1TransactionId) {
-		config1TransactionId = 0;
-		emit config1RegistersReady(mcpConfigReg1, transaction.unique_id);
-	}
-	
-	if(transaction.unique_id == config2TransactionId) {
-		config2TransactionId = 0;
-		emit config2RegistersReady(mcpConfigReg2, transaction.unique_id);
-	}
-	
-	if(transaction.unique_id == compPeriphTransactionId) {
-		compPeriphTransactionId = 0;
-		emit compPeriphRegistersReady(mcpCompPeriphReg, transaction.unique_id);
-	}
-    	
-    if(transaction.unique_id == readAllRegistersId) {
-        readAllRegistersId = 0;
-        emit readAllRegistersComplete(transaction.unique_id);
-        if(initialisationInProgress == true) {
-            initialisationInProgress = false;
-            emit initialisationComplete();
-        }
-    }
-	
-    if(transaction.unique_id == factoryResetId) {
-        factoryResetId = 0;
-        /* Delay 1000 ms to ensure the MCP39F511 has reset its flash */
-        usleep(1000000);
-        /* Reset the MCP39F511 after reset flash is complete. */
-        resetMCP39F511();
-        emit factoryResetComplete(transaction.unique_id);
-    }
-}
\ No newline at end of file
+	/* Hand the completion to whoever is waiting for it */
+	completionRegistry.dispatch(transaction);
+}
+
+DecodedMeasurements MCP39F511Interface::decodeOutputRegisters(const McpOutputRegisters &registers) {
+    DecodedMeasurements energyValues = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    
+    energyValues.systemStatus = registers.system_status;
+    energyValues.voltageRms = McpVoltageScale::toDouble(registers.voltage_RMS);
+    energyValues.frequency = McpFrequencyScale::toDouble(registers.line_frequency);
+    energyValues.powerFactor = McpPowerFactorScale::toDouble(registers.power_factor);
+    energyValues.currentRms = McpCurrentScale::toDouble(registers.current_RMS);
+    energyValues.powerActive = McpPowerScale::toDouble(registers.active_power);
+    energyValues.powerReactive = McpPowerScale::toDouble(registers.reactive_power);
+    energyValues.powerApparent = McpPowerScale::toDouble(registers.apparent_power);
+    return energyValues;
+}
+
+FixedMeasurements MCP39F511Interface::decodeOutputRegistersFixed(const McpOutputRegisters &registers) {
+    FixedMeasurements energyValues;
+    
+    energyValues.voltageRms = registers.voltage_RMS;
+    energyValues.frequency = registers.line_frequency;
+    energyValues.powerFactor = McpPowerFactorScale::toFixed<FixedPowerFactorScale::divisor>(registers.power_factor);
+    energyValues.currentRms = registers.current_RMS;
+    energyValues.powerActive = registers.active_power;
+    energyValues.powerReactive = registers.reactive_power;
+    energyValues.powerApparent = registers.apparent_power;
+    return energyValues;
+}
+
+QString MCP39F511Interface::formatMeasurements(const DecodedMeasurements &values) {
+    return QString::number(values.powerActive, 'f', McpPowerScale::decimals) + ","
+            + QString::number(values.voltageRms, 'f', McpVoltageScale::decimals) + ","
+            + QString::number(values.currentRms, 'f', McpCurrentScale::decimals) + ","
+            + QString::number(values.frequency, 'f', McpFrequencyScale::decimals) + ","
+            + QString::number(values.powerFactor, 'f', McpPowerFactorScale::decimals) + ","
+            + QString::number(values.powerApparent, 'f', McpPowerScale::decimals) + ","
+            + QString::number(values.powerReactive, 'f', McpPowerScale::decimals);
+}
+
+QString MCP39F511Interface::formatMeasurements(const FixedMeasurements &values) {
+    return McpPowerScale::toString(values.powerActive) + ","
+            + McpVoltageScale::toString(values.voltageRms) + ","
+            + McpCurrentScale::toString(values.currentRms) + ","
+            + McpFrequencyScale::toString(values.frequency) + ","
+            + FixedPowerFactorScale::toString(values.powerFactor) + ","
+            + McpPowerScale::toString(values.powerApparent) + ","
+            + McpPowerScale::toString(values.powerReactive);
+}
+
+QString MCP39F511Interface::formatEnergyTotals(const EnergyTotals &energy) {
+    return QString::number(energy.importActive, 'f', McpEnergyScale::decimals) + ","
+            + QString::number(energy.exportActive, 'f', McpEnergyScale::decimals) + ","
+            + QString::number(energy.importReactive, 'f', McpEnergyScale::decimals) + ","
+            + QString::number(energy.exportReactive, 'f', McpEnergyScale::decimals);
+}
+
+MeasurementFilter *MCP39F511Interface::getNoiseFilter() {
+    return noiseFilter;
+}
+
+/**
+ * Scale the output registers to human readable values and filter out noise
+ */
+void MCP39F511Interface::decodeMeasurements(const Mcp39F511TransactionRef &transaction) {
+    /* Averaging over fewer line cycles is noisier, the noise grows with the square root */
+    int shorterBy = MCP_ACCUMULATION_INTERVAL_PRECISION - mcpConfigReg2.accumulation_interval_parameter;
+    noiseFilter->setThresholdScale(noiseThresholdScales[qBound(0, shorterBy, MCP_ACCUMULATION_INTERVAL_PRECISION)]);
+    
+    DecodedMeasurements energyValues = decodeOutputRegisters(mcpOutputReg);
+    energyValues.timeMonotonic = transaction->receivedMonotonic;
+    energyValues.timeStamp = transaction->receivedWallClock;
+    energyValues.sequence = measurementSequence++;
+    energyValues.deviceId = deviceId;
+    emit measurementsReady(noiseFilter->filter(energyValues));
+}
@@ -28,7 +28,18 @@
 #define MCP39F511INTERFACE_H
 
 #include <QObject>
+#include <QThread>
+#include <QTimer>
+#include "MCP39F511AcquisitionScheduler.h"
+#include "MCP39F511CaptureTransport.h"
 #include "MCP39F511Comms.h"
+#include "MCP39F511CompletionRegistry.h"
+#include "MCP39F511EnergyAccumulator.h"
+#include "MCP39F511FaultInjector.h"
+#include "MCP39F511RegisterCache.h"
+#include "MCP39F511ReplayTransport.h"
+#include "MCP39F511SerialTransport.h"
+#include "MCP39F511Units.h"
 
 /* Output registers locations */
 #define MCP_OUTPUT_REG_INSTRUCTION_POINTER 0x0000
@@ -53,6 +64,9 @@
 #define MCP_SYSTEM_STATUS_OVERCUR (1<<2)
 #define MCP_SYSTEM_STATUS_VSURGE (1<<1)
 #define MCP_SYSTEM_STATUS_VSAG (1<<0)
+/* Flags raised by an event, as opposed to the sign flags which describe the measurement */
+#define MCP_SYSTEM_STATUS_EVENTS (MCP_SYSTEM_STATUS_EVENT2 | MCP_SYSTEM_STATUS_EVENT1 | MCP_SYSTEM_STATUS_OVERTEMP | \
+								  MCP_SYSTEM_STATUS_OVERPOW | MCP_SYSTEM_STATUS_OVERCUR | MCP_SYSTEM_STATUS_VSURGE | MCP_SYSTEM_STATUS_VSAG)
 
 #define MCP_OUTPUT_REGISTERS_SIZE sizeof(McpOutputRegisters)
 #define MCP_OUTPUT_REGISTERS_START 0x0000
@@ -86,6 +100,12 @@ typedef struct __attribute__((packed)) {
 	u_int64_t export_reactive_energy_counter;
 } McpEnergyCounterRegisters;
 
+/* Energy control register, the counters only accumulate while it is set and are cleared when it isn't */
+#define MCP_ENERGY_CONTROL_ENABLE 0x0001
+
+/* Milliseconds between energy counter reads while acquiring, energy since the last read is lost on reset */
+#define MCP_ENERGY_READ_INTERVAL 1000
+
 
 /* Record register locations */
 #define MCP_RECORD_MIN_RECORD_1 0x003E
@@ -285,6 +305,21 @@ typedef struct __attribute__((packed)) {
 /* MCP39F511 integrated EEPROM details */
 #define MCP_EEPROM_PAGE_SIZE 16
 #define MCP_EEPROM_PAGE_COUNT 32
+#define MCP_EEPROM_SIZE (MCP_EEPROM_PAGE_SIZE * MCP_EEPROM_PAGE_COUNT)
+
+/* Time in milliseconds to allow the MCP39F511 to finish writing its flash after saving registers */
+#define MCP_FLASH_SAVE_TIME 1000
+
+/* Accumulation interval parameters, 2^N line cycles are averaged for each measurement.
+   Precision mode is also the interval calibration is carried out at. */
+#define MCP_ACCUMULATION_INTERVAL_PRECISION 7	/* 128 line cycles, 2.56 s at 50 Hz */
+#define MCP_ACCUMULATION_INTERVAL_FAST 3		/* 8 line cycles, 160 ms at 50 Hz */
+#define MCP_ACCUMULATION_INTERVAL_MIN 0			/* A single line cycle */
+
+typedef enum {
+	MEASUREMENT_MODE_PRECISION,
+	MEASUREMENT_MODE_FAST
+} measurement_mode;
 
 typedef enum {
 	BEEPER_ON,
@@ -300,8 +335,33 @@ typedef struct {
 	double powerActive;
 	double powerReactive;
 	double powerApparent;
+	/* Stamped once when the response to the read was received, see Mcp39F511Transaction */
+	qint64 timeMonotonic;		/* CLOCK_MONOTONIC, nanoseconds */
+	qint64 timeStamp;			/* Wall clock, milliseconds since the epoch */
+	/* Counts every measurement due, including lost ones, so a gap means samples were lost */
+	quint32 sequence;
+	u_int16_t systemStatus;
+	int deviceId;				/* MCP39F511 the measurement came from, see setDeviceId() */
 } DecodedMeasurements;
 
+/* Power factor in FixedMeasurements, 0.0001 per LSB */
+typedef McpScale<int16_t, 10000, 4> FixedPowerFactorScale;
+
+/**
+ * Measurements as integers for logging and binary protocols, each in the units of its
+ * register (see MCP39F511Units.h) except the power factor which is in FixedPowerFactorScale
+ */
+typedef struct {
+	McpVoltageScale::raw_type voltageRms;
+	McpFrequencyScale::raw_type frequency;
+	FixedPowerFactorScale::raw_type powerFactor;
+	McpCurrentScale::raw_type currentRms;
+	McpPowerScale::raw_type powerActive;
+	McpPowerScale::raw_type powerReactive;
+	McpPowerScale::raw_type powerApparent;
+} FixedMeasurements;
+
+class MeasurementFilter;
 
 class MCP39F511Interface : public QObject {
 	Q_OBJECT
@@ -347,16 +407,16 @@ public:
 	int getOutputRegisters();
 	
 	/**
-	 * Get energy counter registers
+	 * Get energy counter registers, the energy totals are updated from them
 	 * @return Unique transaction ID.
 	 */
-	int getEnergyCounterRegisters();
+	int getEnergyCounterRegisters(mcp39F511_priority priority = MCP_PRIORITY_CONTROL);
 	
 	/**
 	 * Get min / max record registers
 	 * @return Unique transaction ID.
 	 */
-	int getRecordRegisters();
+	int getRecordRegisters(mcp39F511_priority priority = MCP_PRIORITY_CONTROL);
 	
 	/**
 	 * Get calibration registers
@@ -383,22 +443,49 @@ public:
 	int getCompPeriphRegisters();
 	
 	/**
-	 * Set a register and return a unique ID for the transaction
+	 * Set a register and return a unique ID for the transaction.
+	 * The data is copied into the register shadow and only the bytes that differ from what the
+	 * MCP39F511 holds are written, if none do the transaction completes without touching the serial link.
+	 * Any length is allowed, long ranges are split and neighbouring writes merged by the comms layer.
 	 * @return Unique transaction ID.
 	 */
-	int setRegister(u_int16_t address, u_int8_t *data, u_int8_t length);
+	int setRegister(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_priority priority = MCP_PRIORITY_CONTROL);
+
+	/**
+	 * Get a register and return a unique ID for the transaction.
+	 * Configuration registers whose values are already known are served from the register shadow.
+	 * Any length is allowed, long ranges are split and neighbouring reads merged by the comms layer.
+	 * @return Unique transaction ID.
+	 */
+	int getRegister(u_int16_t address, u_int8_t *data, u_int8_t length, mcp39F511_priority priority = MCP_PRIORITY_CONTROL);
+
+	/**
+	 * Run a callback when a transaction completes, successfully or not.  The callback runs on this
+	 * object's thread and may queue further transactions and register callbacks for them, so
+	 * sequences of operations can be chained.  Nothing is called for a transaction ID of 0.
+	 * @param transactionId ID returned when the transaction was queued
+	 * @param callback Called with the completed transaction
+	 */
+	void onComplete(int transactionId, const Mcp39F511Callback &callback);
 
 	/**
-	 * Get a register and return a unique ID for the transaction
+	 * Write the registers changed in the shadow since they were last read from the MCP39F511.
+	 * Register banks that have never been read are left alone.
 	 * @return Unique transaction ID.
 	 */
-	int getRegister(u_int16_t address, u_int8_t *data, u_int8_t length);
+	int flushRegisters();
 
 	/* Save flash registers */
 	int saveRegistersToFlash();
 
-	/* Read a page of EEPROM */
-	int eepromReadPage(u_int8_t page);
+	/**
+	 * Read a page of EEPROM, the page is also in the completed transaction's data
+	 * @param page Page number
+	 * @param data MCP_EEPROM_PAGE_SIZE bytes the page is read into, each page read needs a buffer of
+	 * its own to have more than one queued at once.  NULL for the interface's shared buffer.
+	 * @return Unique transaction ID.
+	 */
+	int eepromReadPage(u_int8_t page, u_int8_t *data = NULL);
 	
 	/* Write a page of EEPROM */
 	int eepromWritePage(u_int8_t page, u_int8_t *data);
@@ -427,18 +514,200 @@ public:
      */
     void setupPWM(int frequency, int duty_cycle);
     
-	McpOutputRegisters mcpOutputReg;
-	McpEnergyCounterRegisters mcpEnergyCounterReg;
-	McpRecordRegisters mcpRecordReg;
-	McpCalibrationRegisters mcpCalibReg;
-	McpConfigurationRegisters1 mcpConfigReg1;
-	McpConfigurationRegisters2 mcpConfigReg2;
-	McpCompPeriphRegisters mcpCompPeriphReg;
+    /**
+     * Set the gap between bytes sent to the MCP39F511.
+     * @param milliseconds Gap between bytes, 0 sends each frame with a single write.
+     */
+    void setInterByteGap(int milliseconds);
+    
+    /**
+     * Set the serial device the MCP39F511 is on, must be called before initialise().
+     * @param device Serial device or the pseudo-terminal of an MCP39F511 simulator
+     * @param resetGpio GPIO for the reset line, GPIO_NONE if there isn't one
+     */
+    void setSerialDevice(QString device, int resetGpio);
+    
+    /**
+     * Identify this MCP39F511 when there are several, every measurement is tagged with it
+     * @param id 0 for the first MCP39F511, which the display and calibration use
+     */
+    void setDeviceId(int id);
+    int getDeviceId();
+    
+    /**
+     * Insert a fault injector between the comms and the serial port, must be called before initialise().
+     * @param enabled true to allow faults to be injected with setFault()
+     */
+    void setFaultInjection(bool enabled);
+    
+    /**
+     * Select the fault to inject on the serial link, fault injection must have been enabled
+     * @param fault Fault to inject, FAULT_NONE to stop
+     * @param probability Percentage chance of each response being hit
+     */
+    void setFault(mcp39F511_fault fault, int probability);
+    
+    /**
+     * @return Number of faults injected since setFault() was called
+     */
+    int getInjectedFaultCount();
+    
+    /**
+     * @return Link failure and recovery statistics
+     */
+    Mcp39F511RecoveryStats getRecoveryStats();
+    
+    /**
+     * Clear the link failure and recovery statistics and the lost sample count
+     */
+    void resetRecoveryStats();
+    
+    /**
+     * @return Number of measurement reads that failed or were still pending when the next was due
+     */
+    int getLostSamples();
+    
+    /**
+     * Allow register reads and writes to overlap on the serial link.
+     * @param enabled true to keep up to MCP_PIPELINE_DEPTH frames in flight.
+     */
+    void setPipelined(bool enabled);
+    
+    /**
+     * @return Completed MCP39F511 transactions per second
+     */
+    double getTransactionRate();
+    
+    /**
+     * heapAllocations stays at zero while the transaction pool is big enough for the traffic.
+     * @return Transaction pool allocation statistics
+     */
+    BufferPoolStats getPoolStats();
+    
+    /**
+     * Measurement reads are sent ahead of control writes, which are sent ahead of background EEPROM jobs.
+     * @param priority Priority class
+     * @return Depth and wait time of the queue for the priority class
+     */
+    Mcp39F511QueueStats getQueueStats(mcp39F511_priority priority);
+    
+    /**
+     * Read the measurements once per accumulation period, just after the MCP39F511 updates them.
+     * measurementsReady is only emitted for new measurements while acquisition is running.
+     */
+    void startAcquisition();
+    
+    /**
+     * Stop reading measurements, also stopped when the interface is closed
+     */
+    void stopAcquisition();
+    
+    bool isAcquisitionRunning();
+    
+    /**
+     * Energy counted since the interface was created or the totals last cleared.  The counters are
+     * read at a low priority every MCP_ENERGY_READ_INTERVAL while acquiring, resets of the
+     * MCP39F511 are carried over.
+     * @return Totals from the last read of the energy counters
+     */
+    EnergyTotals getEnergyTotals();
+    
+    /**
+     * Start the energy totals again from zero
+     */
+    void clearEnergyTotals();
+    
+    /**
+     * The totals behind getEnergyTotals(), in the units of the energy counters
+     */
+    MCP39F511EnergyAccumulator *getEnergyAccumulator();
+    
+    /**
+     * Scale output registers to human readable values, without any noise filtering
+     */
+    static DecodedMeasurements decodeOutputRegisters(const McpOutputRegisters &registers);
+    
+    /**
+     * Output registers as fixed point measurements, using integer arithmetic only
+     */
+    static FixedMeasurements decodeOutputRegistersFixed(const McpOutputRegisters &registers);
+    
+    /**
+     * Comma separated measurements, in the order logged and sent to network clients, each
+     * printed to the resolution of the register it came from
+     */
+    static QString formatMeasurements(const DecodedMeasurements &values);
+    static QString formatMeasurements(const FixedMeasurements &values);
+    
+    /**
+     * Comma separated import and export active energy then import and export reactive energy,
+     * in kWh and kvarh to the resolution of the counters
+     */
+    static QString formatEnergyTotals(const EnergyTotals &energy);
+    
+    /**
+     * Filter applied to every measurement before measurementsReady is emitted.  By default active
+     * and reactive power read zero until they have been above the noise threshold for two
+     * measurements in a row.  Other quantities can be given filters of their own.
+     */
+    MeasurementFilter *getNoiseFilter();
+    
+    /**
+     * Set the accumulation interval for the fastest sample rate that doesn't exceed the one
+     * requested.  Shorter intervals average over fewer line cycles so are noisier.
+     * The interval is not saved to flash.
+     * @param samplesPerSecond Measurements per second wanted
+     * @return Unique transaction ID.
+     */
+    int setAcquisitionRate(double samplesPerSecond);
+    
+    /**
+     * @return MEASUREMENT_MODE_FAST if the accumulation interval is the fast one or shorter
+     */
+    measurement_mode getMeasurementMode();
+    
+    /**
+     * @return Acquisition timing statistics
+     */
+    Mcp39F511AcquisitionStats getAcquisitionStats();
+    
+    /**
+     * Record the serial traffic to and from the MCP39F511 in RAM, must be called before initialise().
+     * The capture is written to the file by saveCapture() and when the interface is closed.
+     * @param fileName File the capture is saved to
+     */
+    void setCaptureFile(QString fileName);
+    
+    /**
+     * Replay a capture file through the comms instead of talking to the MCP39F511, must be
+     * called before initialise().  replayFinished is emitted when the end of the capture is reached.
+     * @param fileName Capture file written by saveCapture()
+     */
+    void setReplayFile(QString fileName);
+    
+    /**
+     * @return Progress of the capture being replayed
+     */
+    Mcp39F511ReplayStats getReplayStats();
+    
+private:
+	/* Must be declared before the register structs, they are views onto its shadow */
+	MCP39F511RegisterCache registerCache;
+	
+public:
+	McpOutputRegisters &mcpOutputReg;
+	McpEnergyCounterRegisters &mcpEnergyCounterReg;
+	McpRecordRegisters &mcpRecordReg;
+	McpCalibrationRegisters &mcpCalibReg;
+	McpConfigurationRegisters1 &mcpConfigReg1;
+	McpConfigurationRegisters2 &mcpConfigReg2;
+	McpCompPeriphRegisters &mcpCompPeriphReg;
 	
 signals:
     void measurementsReady(DecodedMeasurements);
 	void outputRegistersReady(McpOutputRegisters, int transactionId);
 	void energyCounterRegistersReady(McpEnergyCounterRegisters, int transactionId);
+	void energyTotalsReady(EnergyTotals);
 	void recordRegistersReady(McpRecordRegisters, int transactionId);
 	void calibrationRegistersReady(McpCalibrationRegisters, int transactionId);
 	void config1RegistersReady(McpConfigurationRegisters1, int transactionId);
@@ -446,25 +715,70 @@ signals:
 	void compPeriphRegistersReady(McpCompPeriphRegisters, int transactionId);
     void factoryResetComplete(int transactionId);
     void readAllRegistersComplete(int transactionId);
-	void dataReady(Mcp39F511Transaction);
+	void dataReady(const Mcp39F511TransactionRef &);
     void initialisationComplete();
+    void replayFinished();
+	
+public slots:
+    /**
+     * Switch between precision mode, which averages each measurement over 2.56 s, and fast mode
+     * for sub-second response.  The noise thresholds follow the accumulation interval and the
+     * calibration still applies.
+     * @param mode measurement_mode to switch to
+     * @param persist true to save the mode to the MCP39F511 flash so it is kept over a power
+     * cycle, acquisition is held off until the flash has been written.  Only the command line
+     * persists, so network clients can't wear out the flash.
+     * @return Unique transaction ID, 0 if already in that mode
+     */
+    int setMeasurementMode(int mode, bool persist = false);
+    
+    /**
+     * Write the serial traffic captured so far to the capture file, capturing carries on.
+     * Called on exit and whenever a post-mortem is wanted from a unit still running.
+     * @return true if the capture was saved
+     */
+    bool saveCapture();
 	
 private slots:
-	void transactionComplete(Mcp39F511Transaction);
+	void slotCompletionsAvailable();
+	void slotAcquisitionReadDue();
+	void slotEnergyReadDue();
 
 private:
+	void transactionComplete(const Mcp39F511TransactionRef &transaction);
+	void decodeMeasurements(const Mcp39F511TransactionRef &transaction);
+	int writeDirtyRegisters(u_int16_t address, int length, mcp39F511_priority priority);
+	void printMessage(QString message);
+
 	MCP39F511Comms *mcp_comms;
-    bool initialisationInProgress;
+	QThread *commsThread;
+    int interByteGap;
+    bool pipelined;
+    QString serialDevice;
+    int resetGpio;
+    int deviceId;
+    bool faultInjectionEnabled;
+    MCP39F511FaultInjector *faultInjector;
+    QString captureFile;
+    MCP39F511CaptureTransport *captureTransport;
+    QString replayFile;
+    MCP39F511ReplayTransport *replayTransport;
+    int lostSamples;
+    MCP39F511AcquisitionScheduler *acquisitionScheduler;
+    MeasurementFilter *noiseFilter;
+    QTimer *energyTimer;
+    /* Acquisition waits for the flash to be written after the measurement mode is saved */
+    bool flashSaving;
+    bool acquisitionAfterFlashSave;
+    MCP39F511EnergyAccumulator energyAccumulator;
+    qint64 energyTimeStamp;
+    /* Wall clock of the last reset, milliseconds since the epoch */
+    qint64 counterResetWallClock;
 	
-    int readAllRegistersId;
-	int outputTransactionId;
-	int energyCounterTransactionId;
-	int recordTransactionId;
-	int calibrationTransactionId;
-	int config1TransactionId;
-	int config2TransactionId;
-	int compPeriphTransactionId;
-    int factoryResetId;
+	MCP39F511CompletionRegistry completionRegistry;
+	/* Measurement read still waiting to complete, the next poll is skipped until it has */
+	int measurementTransactionId;
+	quint32 measurementSequence;
 	
 	u_int8_t eepromBuffer[MCP_EEPROM_PAGE_SIZE + 1];
 };
@@ -0,0 +1,220 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511MinMaxRecorder.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 02:30
+ */
+
+#include <QDebug>
+#include <QStringList>
+
+#include "MCP39F511MinMaxRecorder.h"
+#include "MCP39F511Units.h"
+
+MCP39F511MinMaxRecorder::MCP39F511MinMaxRecorder(MCP39F511Interface *powerMeter, QObject *parent) : QObject(parent) {
+	this->powerMeter = powerMeter;
+	channels[0] = MEASUREMENT_CURRENT_RMS;
+	channels[1] = MEASUREMENT_POWER_ACTIVE;
+	restart = true;
+	readPending = false;
+	readInFlight = false;
+	for(int i = 0; i < MCP_MINMAX_RECORDS; i++) {
+		extremes.channel[i] = channels[i];
+		extremes.minimum[i] = 0;
+		extremes.maximum[i] = 0;
+		extremes.valid[i] = false;
+		resetMinimum[i] = MCP_MINMAX_RESET_MINIMUM;
+		resetMaximum[i] = MCP_MINMAX_RESET_MAXIMUM;
+	}
+	extremes.timeStamp = 0;
+	extremes.deviceId = powerMeter->getDeviceId();
+	
+	readTimer = new QTimer(this);
+	connect(readTimer, SIGNAL(timeout()), this, SLOT(slotReadDue()));
+	connect(powerMeter, SIGNAL(outputRegistersReady(McpOutputRegisters, int)), this, SLOT(slotOutputRegistersReady()));
+}
+
+MCP39F511MinMaxRecorder::~MCP39F511MinMaxRecorder() {
+}
+
+void MCP39F511MinMaxRecorder::printMessage(QString message) {
+	qDebug() << "Min/max recorder: " << message;
+}
+
+bool MCP39F511MinMaxRecorder::setTrackedQuantity(int record, measurement_channel channel) {
+	if(record < 0 || record >= MCP_MINMAX_RECORDS || outputRegister(channel) == 0) {
+		return false;
+	}
+	if(channels[record] != channel) {
+		channels[record] = channel;
+		restart = true;
+	}
+	return true;
+}
+
+measurement_channel MCP39F511MinMaxRecorder::getTrackedQuantity(int record) {
+	return channels[record];
+}
+
+void MCP39F511MinMaxRecorder::start() {
+	restart = true;
+	readPending = true;
+	readTimer->start(MCP_MINMAX_READ_INTERVAL);
+}
+
+void MCP39F511MinMaxRecorder::stop() {
+	readTimer->stop();
+	readPending = false;
+}
+
+MeasurementExtremes MCP39F511MinMaxRecorder::getExtremes() {
+	return extremes;
+}
+
+void MCP39F511MinMaxRecorder::slotReadDue() {
+	/* Read anyway if there has been no measurement read to follow since the last time */
+	if(readPending) {
+		readAndReset();
+	}
+	readPending = true;
+}
+
+void MCP39F511MinMaxRecorder::slotOutputRegistersReady() {
+	if(readPending) {
+		readAndReset();
+	}
+}
+
+/**
+ * The read and the reset are queued back to back so only the accumulation intervals that end
+ * between the two are lost
+ */
+void MCP39F511MinMaxRecorder::readAndReset() {
+	readPending = false;
+	if(readInFlight) {
+		return;
+	}
+	
+	/* Nothing is written once the MCP39F511 is known to be pointing at the tracked quantities,
+	   this catches it after a reset has cleared the pointers */
+	powerMeter->mcpCompPeriphReg.min_max_pointer1 = outputRegister(channels[0]);
+	powerMeter->mcpCompPeriphReg.min_max_pointer2 = outputRegister(channels[1]);
+	powerMeter->setRegister(MCP_COMP_PERIPH_MIN_MAX_PTR_1, (u_int8_t *)&powerMeter->mcpCompPeriphReg.min_max_pointer1, sizeof(powerMeter->mcpCompPeriphReg.min_max_pointer1) + sizeof(powerMeter->mcpCompPeriphReg.min_max_pointer2), MCP_PRIORITY_BACKGROUND);
+	
+	/* The records hold a mix of old and new quantities until they have been reset once */
+	if(!restart) {
+		measurement_channel readChannels[MCP_MINMAX_RECORDS] = {channels[0], channels[1]};
+		readInFlight = true;
+		int transactionId = powerMeter->getRecordRegisters(MCP_PRIORITY_BACKGROUND);
+		powerMeter->onComplete(transactionId, [this, readChannels](const Mcp39F511TransactionRef &transaction) {
+			readInFlight = false;
+			if(transaction->status != COMMS_COMPLETE) {
+				return;
+			}
+			u_int32_t minimum[MCP_MINMAX_RECORDS] = {powerMeter->mcpRecordReg.minimum_record_1, powerMeter->mcpRecordReg.minimum_record_2};
+			u_int32_t maximum[MCP_MINMAX_RECORDS] = {powerMeter->mcpRecordReg.maximum_record_1, powerMeter->mcpRecordReg.maximum_record_2};
+			for(int i = 0; i < MCP_MINMAX_RECORDS; i++) {
+				extremes.channel[i] = readChannels[i];
+				extremes.valid[i] = minimum[i] <= maximum[i];
+				extremes.minimum[i] = extremes.valid[i] ? decode(readChannels[i], minimum[i]) : 0;
+				extremes.maximum[i] = extremes.valid[i] ? decode(readChannels[i], maximum[i]) : 0;
+			}
+			extremes.timeStamp = transaction->receivedWallClock;
+			extremes.deviceId = powerMeter->getDeviceId();
+			emit extremesReady(extremes);
+		});
+	}
+	restart = false;
+	
+	/* Reset by writing the records, the next accumulation interval replaces both */
+	powerMeter->setRegister(MCP_RECORD_MIN_RECORD_1, (u_int8_t *)resetMinimum, sizeof(resetMinimum), MCP_PRIORITY_BACKGROUND);
+	powerMeter->setRegister(MCP_RECORD_MAX_RECORD_1, (u_int8_t *)resetMaximum, sizeof(resetMaximum), MCP_PRIORITY_BACKGROUND);
+}
+
+/**
+ * @return Output register the MCP39F511 compares, 0 if the quantity can't be tracked
+ */
+u_int16_t MCP39F511MinMaxRecorder::outputRegister(measurement_channel channel) {
+	switch(channel) {
+		case MEASUREMENT_VOLTAGE_RMS: return MCP_OUTPUT_REG_VOLTAGE_RMS;
+		case MEASUREMENT_FREQUENCY: return MCP_OUTPUT_REG_LINE_FREQUENCY;
+		case MEASUREMENT_CURRENT_RMS: return MCP_OUTPUT_REG_CURRENT_RMS;
+		case MEASUREMENT_POWER_ACTIVE: return MCP_OUTPUT_REG_ACTIVE_POWER;
+		case MEASUREMENT_POWER_REACTIVE: return MCP_OUTPUT_REG_REACTIVE_POWER;
+		case MEASUREMENT_POWER_APPARENT: return MCP_OUTPUT_REG_APPARENT_POWER;
+		/* Compared unsigned by the MCP39F511 so negative values sort above positive */
+		default: return 0;
+	}
+}
+
+double MCP39F511MinMaxRecorder::decode(measurement_channel channel, u_int32_t value) {
+	switch(channel) {
+		case MEASUREMENT_VOLTAGE_RMS: return McpVoltageScale::toDouble((u_int16_t)value);
+		case MEASUREMENT_FREQUENCY: return McpFrequencyScale::toDouble((u_int16_t)value);
+		case MEASUREMENT_CURRENT_RMS: return McpCurrentScale::toDouble(value);
+		default: return McpPowerScale::toDouble(value);
+	}
+}
+
+static int channelDecimals(measurement_channel channel) {
+	switch(channel) {
+		case MEASUREMENT_VOLTAGE_RMS: return McpVoltageScale::decimals;
+		case MEASUREMENT_FREQUENCY: return McpFrequencyScale::decimals;
+		case MEASUREMENT_CURRENT_RMS: return McpCurrentScale::decimals;
+		default: return McpPowerScale::decimals;
+	}
+}
+
+static const char *channelNames[MEASUREMENT_CHANNELS] = {"voltage", "frequency", "powerfactor", "current", "power", "reactive", "apparent"};
+
+QString MCP39F511MinMaxRecorder::channelName(measurement_channel channel) {
+	if(channel < 0 || channel >= MEASUREMENT_CHANNELS) {
+		return QString();
+	}
+	return channelNames[channel];
+}
+
+measurement_channel MCP39F511MinMaxRecorder::channelFromName(QString name) {
+	for(int i = 0; i < MEASUREMENT_CHANNELS; i++) {
+		if(name == channelNames[i]) {
+			return (measurement_channel)i;
+		}
+	}
+	return MEASUREMENT_CHANNELS;
+}
+
+QString MCP39F511MinMaxRecorder::formatExtremes(const MeasurementExtremes &extremes) {
+	QStringList fields;
+	for(int i = 0; i < MCP_MINMAX_RECORDS; i++) {
+		fields.append(channelName(extremes.channel[i]));
+		if(extremes.valid[i]) {
+			int decimals = channelDecimals(extremes.channel[i]);
+			fields.append(QString::number(extremes.minimum[i], 'f', decimals));
+			fields.append(QString::number(extremes.maximum[i], 'f', decimals));
+		} else {
+			fields.append(QString());
+			fields.append(QString());
+		}
+	}
+	return fields.join(",");
+}
@@ -0,0 +1,131 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511MinMaxRecorder.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 02:30
+ */
+
+#ifndef MCP39F511MINMAXRECORDER_H
+#define MCP39F511MINMAXRECORDER_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include "MCP39F511Interface.h"
+#include "MeasurementFilter.h"
+
+/* The MCP39F511 keeps two sets of minimum and maximum records */
+#define MCP_MINMAX_RECORDS 2
+/* Milliseconds between reads of the records, each read covers the time since the one before */
+#define MCP_MINMAX_READ_INTERVAL 1000
+/* Records are reset by writing these, the next accumulation interval replaces both */
+#define MCP_MINMAX_RESET_MINIMUM 0xFFFFFFFF
+#define MCP_MINMAX_RESET_MAXIMUM 0x00000000
+
+typedef struct {
+	measurement_channel channel[MCP_MINMAX_RECORDS];
+	double minimum[MCP_MINMAX_RECORDS];
+	double maximum[MCP_MINMAX_RECORDS];
+	/* false if the MCP39F511 hadn't updated the record since it was last reset */
+	bool valid[MCP_MINMAX_RECORDS];
+	qint64 timeStamp;			/* Wall clock when the records were read, milliseconds since the epoch */
+	int deviceId;
+} MeasurementExtremes;
+
+/**
+ * Peaks and troughs tracked by the MCP39F511 itself, every accumulation interval, so short events
+ * between measurement reads aren't missed.  The min/max pointers select the output registers
+ * tracked.  The records are read every MCP_MINMAX_READ_INTERVAL and reset straight after, so each
+ * read holds the extremes since the one before.  The read and reset are queued together just after
+ * a measurement read, when the MCP39F511 has only just updated the records.
+ */
+class MCP39F511MinMaxRecorder : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511MinMaxRecorder(MCP39F511Interface *powerMeter, QObject *parent);
+	virtual ~MCP39F511MinMaxRecorder();
+	
+	/**
+	 * Select the quantity a record tracks, takes effect when the recorder is next started or read
+	 * @param record 0 or 1
+	 * @param channel Any quantity except the power factor, which is signed
+	 * @return false if the quantity can't be tracked
+	 */
+	bool setTrackedQuantity(int record, measurement_channel channel);
+	measurement_channel getTrackedQuantity(int record);
+	
+	/**
+	 * Point the MCP39F511 at the tracked quantities, reset the records and start reading them
+	 */
+	void start();
+	void stop();
+	
+	/**
+	 * @return Extremes from the last read
+	 */
+	MeasurementExtremes getExtremes();
+	
+	/**
+	 * Name of a quantity, as logged and accepted by channelFromName()
+	 */
+	static QString channelName(measurement_channel channel);
+	
+	/**
+	 * @return The quantity with the name, MEASUREMENT_CHANNELS if there isn't one
+	 */
+	static measurement_channel channelFromName(QString name);
+	
+	/**
+	 * Comma separated quantity, minimum and maximum for each record, each to the resolution of
+	 * its register.  The minimum and maximum are left empty for a record that wasn't valid.
+	 */
+	static QString formatExtremes(const MeasurementExtremes &extremes);
+	
+signals:
+	void extremesReady(MeasurementExtremes);
+	
+private slots:
+	void slotReadDue();
+	void slotOutputRegistersReady();
+	
+private:
+	void readAndReset();
+	void printMessage(QString message);
+	static u_int16_t outputRegister(measurement_channel channel);
+	static double decode(measurement_channel channel, u_int32_t value);
+	
+	MCP39F511Interface *powerMeter;
+	QTimer *readTimer;
+	measurement_channel channels[MCP_MINMAX_RECORDS];
+	bool restart;
+	bool readPending;
+	bool readInFlight;
+	/* Written over minimum_record_1/2 and maximum_record_1/2 to reset them */
+	u_int32_t resetMinimum[MCP_MINMAX_RECORDS];
+	u_int32_t resetMaximum[MCP_MINMAX_RECORDS];
+	MeasurementExtremes extremes;
+};
+
+#endif /* MCP39F511MINMAXRECORDER_H */
@@ -0,0 +1,137 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511RegisterCache.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 18:05
+ */
+
+#include <string.h>
+
+#include "MCP39F511RegisterCache.h"
+
+MCP39F511RegisterCache::MCP39F511RegisterCache() {
+	memset(shadowRegisters, 0, sizeof(shadowRegisters));
+	memset(chipRegisters, 0, sizeof(chipRegisters));
+	memset(receivedRegisters, 0, sizeof(receivedRegisters));
+	memset(pendingWrites, 0, sizeof(pendingWrites));
+	invalidate();
+}
+
+u_int8_t *MCP39F511RegisterCache::shadow(u_int16_t address) {
+	return &shadowRegisters[address];
+}
+
+u_int8_t *MCP39F511RegisterCache::receiveBuffer(u_int16_t address) {
+	return &receivedRegisters[address];
+}
+
+bool MCP39F511RegisterCache::contains(u_int16_t address, int length) {
+	return address + length <= MCP_REGISTER_MAP_SIZE;
+}
+
+bool MCP39F511RegisterCache::isCached(u_int16_t address, int length) {
+	if(address < MCP_CACHEABLE_REGISTERS_START || !contains(address, length)) {
+		return false;
+	}
+	for(int i = address; i < address + length; i++) {
+		if(!valid[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MCP39F511RegisterCache::isDirty(u_int16_t address) {
+	return !valid[address] || shadowRegisters[address] != chipRegisters[address];
+}
+
+QList<QPair<u_int16_t, int> > MCP39F511RegisterCache::dirtyRanges(u_int16_t address, int length) {
+	QList<QPair<u_int16_t, int> > ranges;
+	int end = address + length;
+	int i = address;
+	
+	while(i < end) {
+		/* Find the start of the next dirty run */
+		while(i < end && !isDirty(i)) {
+			i++;
+		}
+		if(i >= end) {
+			break;
+		}
+		int start = i;
+		int lastDirty = i;
+		
+		/* Extend the run while the clean gaps are small enough to be worth writing */
+		while(i < end && i - lastDirty <= MCP_CACHE_WRITE_GAP) {
+			if(isDirty(i)) {
+				lastDirty = i;
+			}
+			i++;
+		}
+		ranges.append(qMakePair((u_int16_t)start, lastDirty - start + 1));
+		i = lastDirty + 1;
+	}
+	return ranges;
+}
+
+void MCP39F511RegisterCache::written(u_int16_t address, int length) {
+	memcpy(&chipRegisters[address], &shadowRegisters[address], length);
+	for(int i = address; i < address + length; i++) {
+		valid[i] = true;
+		pendingWrites[i]++;
+	}
+}
+
+void MCP39F511RegisterCache::writeComplete(u_int16_t address, int length, bool success) {
+	for(int i = address; i < address + length && i < MCP_REGISTER_MAP_SIZE; i++) {
+		if(pendingWrites[i] > 0) {
+			pendingWrites[i]--;
+		}
+		if(!success) {
+			valid[i] = false;
+		}
+	}
+}
+
+void MCP39F511RegisterCache::merge(u_int16_t address, int length) {
+	for(int i = address; i < address + length; i++) {
+		/* The read was queued before a write to this byte so holds the old value */
+		if(pendingWrites[i] > 0) {
+			continue;
+		}
+		if(!isDirty(i) || !valid[i]) {
+			shadowRegisters[i] = receivedRegisters[i];
+		}
+		chipRegisters[i] = receivedRegisters[i];
+		valid[i] = true;
+	}
+}
+
+void MCP39F511RegisterCache::invalidate(u_int16_t address, int length) {
+	for(int i = address; i < address + length && i < MCP_REGISTER_MAP_SIZE; i++) {
+		valid[i] = false;
+	}
+}
+
+void MCP39F511RegisterCache::invalidate() {
+	invalidate(0, MCP_REGISTER_MAP_SIZE);
+}
@@ -0,0 +1,120 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511RegisterCache.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 18:05
+ */
+
+#ifndef MCP39F511REGISTERCACHE_H
+#define MCP39F511REGISTERCACHE_H
+
+#include <sys/types.h>
+
+#include <QList>
+#include <QPair>
+
+/* Size of the MCP39F511 register map, from the output registers to the end of the peripheral registers */
+#define MCP_REGISTER_MAP_SIZE 0xE2
+
+/* Registers from here on only change when written or on reset, so reads can be served from the cache */
+#define MCP_CACHEABLE_REGISTERS_START 0x005E
+
+/* Dirty ranges separated by no more than this many clean bytes are written as one */
+#define MCP_CACHE_WRITE_GAP 4
+
+/**
+ * Shadow copy of the MCP39F511 register map.
+ * The shadow is what the application wants the registers to be, the chip image is what the MCP39F511
+ * is known to hold.  A byte is dirty when it differs from the chip image or the chip's value is not known.
+ */
+class MCP39F511RegisterCache {
+public:
+	MCP39F511RegisterCache();
+	
+	/**
+	 * @return Pointer to the shadow copy of a register, the mirror structs live here
+	 */
+	u_int8_t *shadow(u_int16_t address);
+	
+	/**
+	 * @return Pointer to where a read of a register should be received before being merged with merge()
+	 */
+	u_int8_t *receiveBuffer(u_int16_t address);
+	
+	/**
+	 * @return true if the range is inside the register map
+	 */
+	bool contains(u_int16_t address, int length);
+	
+	/**
+	 * @return true if the range is static configuration and the chip's values are known
+	 */
+	bool isCached(u_int16_t address, int length);
+	
+	/**
+	 * @return true if a byte of the shadow needs writing to the MCP39F511
+	 */
+	bool isDirty(u_int16_t address);
+	
+	/**
+	 * Find the parts of a range that need writing, close ranges are combined
+	 * @return List of address and length pairs
+	 */
+	QList<QPair<u_int16_t, int> > dirtyRanges(u_int16_t address, int length);
+	
+	/**
+	 * A range of the shadow has been queued to be written to the MCP39F511.
+	 * Reads completing before the write has been acknowledged leave the range alone.
+	 */
+	void written(u_int16_t address, int length);
+	
+	/**
+	 * A write queued with written() has finished
+	 * @param success false if the MCP39F511 may not hold the written values
+	 */
+	void writeComplete(u_int16_t address, int length, bool success);
+	
+	/**
+	 * A read into the receive buffer has completed.  The chip image is updated and the shadow
+	 * takes the new values except where it holds changes not yet written.
+	 */
+	void merge(u_int16_t address, int length);
+	
+	/**
+	 * Forget what the MCP39F511 holds for a range, e.g. after a failed write
+	 */
+	void invalidate(u_int16_t address, int length);
+	
+	/**
+	 * Forget everything the MCP39F511 holds, e.g. after it has been reset
+	 */
+	void invalidate();
+	
+private:
+	u_int8_t shadowRegisters[MCP_REGISTER_MAP_SIZE];
+	u_int8_t chipRegisters[MCP_REGISTER_MAP_SIZE];
+	u_int8_t receivedRegisters[MCP_REGISTER_MAP_SIZE];
+	bool valid[MCP_REGISTER_MAP_SIZE];
+	int pendingWrites[MCP_REGISTER_MAP_SIZE];
+};
+
+#endif /* MCP39F511REGISTERCACHE_H */
@@ -0,0 +1,102 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511ReplayBenchmark.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 17:30
+ */
+
+#include <QDebug>
+
+#include "MCP39F511ReplayBenchmark.h"
+
+MCP39F511ReplayBenchmark::MCP39F511ReplayBenchmark(MCP39F511Interface *powerMeter, QObject *parent) : QObject(parent) {
+	this->powerMeter = powerMeter;
+	running = false;
+	requested = 0;
+	decoded = 0;
+}
+
+MCP39F511ReplayBenchmark::~MCP39F511ReplayBenchmark() {
+}
+
+void MCP39F511ReplayBenchmark::start() {
+	requested = 0;
+	decoded = 0;
+	running = true;
+	powerMeter->resetRecoveryStats();
+	connect(powerMeter, SIGNAL(measurementsReady(DecodedMeasurements)), this, SLOT(slotMeasurementsReady()));
+	connect(powerMeter, SIGNAL(replayFinished()), this, SLOT(slotReplayFinished()));
+	replayTimer.start();
+	
+	/* A short capture may already have run out during initialisation */
+	if(powerMeter->getReplayStats().finished) {
+		slotReplayFinished();
+	} else {
+		poll();
+	}
+}
+
+/**
+ * The next read is queued as soon as the previous one completes so the replay runs flat out
+ */
+void MCP39F511ReplayBenchmark::poll() {
+	int transactionId = powerMeter->getOutputRegisters();
+	requested++;
+	powerMeter->onComplete(transactionId, [this](const Mcp39F511TransactionRef &) {
+		if(running) {
+			poll();
+		}
+	});
+}
+
+void MCP39F511ReplayBenchmark::slotMeasurementsReady() {
+	decoded++;
+}
+
+void MCP39F511ReplayBenchmark::slotReplayFinished() {
+	if(!running) {
+		return;
+	}
+	running = false;
+	disconnect(powerMeter, SIGNAL(measurementsReady(DecodedMeasurements)), this, SLOT(slotMeasurementsReady()));
+	disconnect(powerMeter, SIGNAL(replayFinished()), this, SLOT(slotReplayFinished()));
+	printReport();
+	emit finished();
+}
+
+void MCP39F511ReplayBenchmark::printReport() {
+	qint64 elapsed = replayTimer.nsecsElapsed() / 1000;
+	Mcp39F511ReplayStats replay = powerMeter->getReplayStats();
+	Mcp39F511RecoveryStats recovery = powerMeter->getRecoveryStats();
+	
+	qDebug("Replay benchmark, %d responses replayed, %d bytes sent differed from the capture", replay.responses, replay.mismatchedBytes);
+	qDebug("Measurements: %d requested, %d decoded, %d lost, %d transaction failures",
+		   requested, decoded, powerMeter->getLostSamples(), recovery.failures);
+	qDebug("Replayed in %lld ms, capture spans %d ms", elapsed / 1000, replay.capturedTime);
+	if(decoded > 0) {
+		qDebug("%lld us per decoded measurement", elapsed / decoded);
+	}
+	if(elapsed > 0) {
+		qDebug("%.1f times faster than real time", replay.capturedTime * 1000.0 / elapsed);
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511ReplayBenchmark.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 17:30
+ */
+
+#ifndef MCP39F511REPLAYBENCHMARK_H
+#define MCP39F511REPLAYBENCHMARK_H
+
+#include <QElapsedTimer>
+#include <QObject>
+
+#include "MCP39F511Interface.h"
+
+/**
+ * Reads measurements back to back from a capture being replayed until the end of the capture,
+ * then reports how long the comms and decoding took against the time the capture spans.
+ * The same capture always produces the same sequence of responses, so runs are repeatable.
+ */
+class MCP39F511ReplayBenchmark : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511ReplayBenchmark(MCP39F511Interface *powerMeter, QObject *parent);
+	virtual ~MCP39F511ReplayBenchmark();
+	
+	/**
+	 * Start the benchmark, the power meter must have been initialised with a replay file
+	 */
+	void start();
+	
+signals:
+	/**
+	 * Emitted once the capture has been replayed and the report printed
+	 */
+	void finished();
+	
+private slots:
+	void slotMeasurementsReady();
+	void slotReplayFinished();
+	
+private:
+	void poll();
+	void printReport();
+	
+	MCP39F511Interface *powerMeter;
+	QElapsedTimer replayTimer;
+	bool running;
+	int requested;
+	int decoded;
+};
+
+#endif /* MCP39F511REPLAYBENCHMARK_H */
@@ -0,0 +1,193 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511ReplayTransport.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 17:30
+ */
+
+#include <string.h>
+
+#include <QDebug>
+#include <QFile>
+
+#include "MCP39F511ReplayTransport.h"
+
+MCP39F511ReplayTransport::MCP39F511ReplayTransport(QString fileName, QObject *parent) : MCP39F511Transport(parent) {
+	this->fileName = fileName;
+	opened = false;
+	current = 0;
+	position = 0;
+	capturedTime = 0;
+	responses = 0;
+	mismatchedBytes = 0;
+	replayFinished = 0;
+}
+
+MCP39F511ReplayTransport::~MCP39F511ReplayTransport() {
+}
+
+void MCP39F511ReplayTransport::printMessage(QString message) {
+	qDebug() << "MCP39F511 replay: " << message;
+}
+
+bool MCP39F511ReplayTransport::open() {
+	if(!opened) {
+		opened = load();
+	}
+	return opened;
+}
+
+void MCP39F511ReplayTransport::close() {
+	opened = false;
+}
+
+bool MCP39F511ReplayTransport::isOpen() {
+	return opened;
+}
+
+void MCP39F511ReplayTransport::flush() {
+	response.clear();
+}
+
+void MCP39F511ReplayTransport::setReset(bool asserted) {
+	/* Nothing to reset, the capture carries on from where it is */
+	Q_UNUSED(asserted);
+}
+
+/**
+ * Reads the capture file into records, ready to be replayed from the first byte sent
+ */
+bool MCP39F511ReplayTransport::load() {
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly)) {
+		printMessage(QString("Failed to open capture %1!").arg(fileName));
+		return false;
+	}
+	captureData = file.readAll();
+	
+	Mcp39F511CaptureHeader header;
+	if(captureData.size() < (int)sizeof(header)) {
+		printMessage(QString("%1 is not a capture file!").arg(fileName));
+		return false;
+	}
+	memcpy(&header, captureData.constData(), sizeof(header));
+	if(memcmp(header.magic, MCP_CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != MCP_CAPTURE_VERSION) {
+		printMessage(QString("%1 is not a version %2 capture file!").arg(fileName).arg(MCP_CAPTURE_VERSION));
+		return false;
+	}
+	
+	qint64 elapsed = 0;
+	int offset = sizeof(header);
+	records.clear();
+	while(offset + (int)sizeof(Mcp39F511CaptureRecord) <= captureData.size()) {
+		Mcp39F511CaptureRecord captured;
+		memcpy(&captured, captureData.constData() + offset, sizeof(captured));
+		offset += sizeof(captured);
+		if(offset + captured.length > captureData.size()) {
+			printMessage("Capture truncated, replaying the complete records.");
+			break;
+		}
+		/* The first delta is from before the capture starts */
+		if(!records.isEmpty()) {
+			elapsed += captured.delta;
+		}
+		
+		/* Responses received before the first byte sent belong to a transaction that isn't in the capture */
+		if((captured.direction == CAPTURE_TX || (captured.direction == CAPTURE_RX && !records.isEmpty())) && captured.length > 0) {
+			ReplayRecord record;
+			record.direction = (mcp39F511_capture_direction)captured.direction;
+			record.offset = offset;
+			record.length = captured.length;
+			records.append(record);
+		}
+		offset += captured.length;
+	}
+	capturedTime = elapsed / 1000;
+	current = 0;
+	position = 0;
+	response.clear();
+	
+	printMessage(QString("Replaying %1 records spanning %2 ms from %3.").arg(records.size()).arg(capturedTime).arg(fileName));
+	return true;
+}
+
+/**
+ * Everything sent is checked against the capture and takes the replay past it, then the
+ * bytes received next in the capture are made available as the response
+ */
+int MCP39F511ReplayTransport::write(const u_int8_t *data, int length) {
+	for(int i = 0; i < length; i++) {
+		releaseResponses();
+		if(current >= records.size()) {
+			break;
+		}
+		const ReplayRecord &record = records.at(current);
+		if((u_int8_t)captureData.at(record.offset + position) != data[i]) {
+			mismatchedBytes.ref();
+		}
+		if(++position == record.length) {
+			current++;
+			position = 0;
+		}
+	}
+	releaseResponses();
+	
+	if(!response.isEmpty()) {
+		QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
+	}
+	if(current >= records.size() && replayFinished.testAndSetOrdered(0, 1)) {
+		printMessage("End of capture reached.");
+		emit finished();
+	}
+	return length;
+}
+
+void MCP39F511ReplayTransport::releaseResponses() {
+	bool released = false;
+	while(current < records.size() && records.at(current).direction == CAPTURE_RX) {
+		const ReplayRecord &record = records.at(current);
+		response.append(captureData.constData() + record.offset, record.length);
+		current++;
+		position = 0;
+		released = true;
+	}
+	if(released) {
+		responses.ref();
+	}
+}
+
+int MCP39F511ReplayTransport::read(u_int8_t *data, int length) {
+	int count = qMin(length, response.size());
+	memcpy(data, response.constData(), count);
+	response.remove(0, count);
+	return count;
+}
+
+Mcp39F511ReplayStats MCP39F511ReplayTransport::getStats() {
+	Mcp39F511ReplayStats stats;
+	stats.capturedTime = capturedTime;
+	stats.responses = responses.loadAcquire();
+	stats.mismatchedBytes = mismatchedBytes.loadAcquire();
+	stats.finished = replayFinished.loadAcquire() != 0;
+	return stats;
+}
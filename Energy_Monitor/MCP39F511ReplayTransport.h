@@ -0,0 +1,108 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511ReplayTransport.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 17:30
+ */
+
+#ifndef MCP39F511REPLAYTRANSPORT_H
+#define MCP39F511REPLAYTRANSPORT_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "MCP39F511CaptureTransport.h"
+
+/**
+ * Replay statistics, safe to read from any thread
+ */
+typedef struct {
+	int capturedTime;		/* Milliseconds spanned by the capture */
+	int responses;			/* Responses from the capture handed to the comms */
+	int mismatchedBytes;	/* Bytes sent that differ from the ones in the capture */
+	bool finished;			/* All of the capture has been replayed */
+} Mcp39F511ReplayStats;
+
+/**
+ * Transport that plays a file written by MCP39F511CaptureTransport back to MCP39F511Comms
+ * instead of talking to an MCP39F511.  Bytes sent are checked against the ones sent in the
+ * capture, and the bytes received after them in the capture are handed back as the response
+ * straight away, so a replay runs as fast as the comms and decoding can go.
+ */
+class MCP39F511ReplayTransport : public MCP39F511Transport {
+	Q_OBJECT
+	
+public:
+	/**
+	 * @param fileName Capture file to replay, read when the transport is opened
+	 */
+	MCP39F511ReplayTransport(QString fileName, QObject *parent);
+	virtual ~MCP39F511ReplayTransport();
+	
+	bool open();
+	void close();
+	bool isOpen();
+	int read(u_int8_t *data, int length);
+	int write(const u_int8_t *data, int length);
+	void flush();
+	void setReset(bool asserted);
+	
+	/**
+	 * Safe to call from any thread.
+	 * @return Replay progress
+	 */
+	Mcp39F511ReplayStats getStats();
+	
+signals:
+	/**
+	 * Emitted once every record in the capture has been replayed
+	 */
+	void finished();
+	
+private:
+	typedef struct {
+		mcp39F511_capture_direction direction;
+		int offset;				/* Position of the data in captureData */
+		int length;
+	} ReplayRecord;
+	
+	bool load();
+	void releaseResponses();
+	void printMessage(QString message);
+	
+	QString fileName;
+	bool opened;
+	QByteArray captureData;
+	QVector<ReplayRecord> records;
+	QVector<ReplayRecord>::size_type current;
+	int position;
+	QByteArray response;
+	int capturedTime;
+	QAtomicInt responses;
+	QAtomicInt mismatchedBytes;
+	QAtomicInt replayFinished;
+};
+
+#endif /* MCP39F511REPLAYTRANSPORT_H */
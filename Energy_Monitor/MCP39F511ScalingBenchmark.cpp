@@ -0,0 +1,103 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511ScalingBenchmark.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 21:55
+ */
+
+#include <QDebug>
+#include <QTimer>
+
+#include "MCP39F511ScalingBenchmark.h"
+
+MCP39F511ScalingBenchmark::MCP39F511ScalingBenchmark(QList<MCP39F511Interface *> powerMeters, QObject *parent) : QObject(parent) {
+	this->powerMeters = powerMeters;
+	running = false;
+}
+
+MCP39F511ScalingBenchmark::~MCP39F511ScalingBenchmark() {
+}
+
+void MCP39F511ScalingBenchmark::start() {
+	qDebug() << "Scaling benchmark: reading" << powerMeters.size() << "MCP39F511 back to back for" << SCALING_BENCHMARK_DURATION << "ms";
+	results.resize(powerMeters.size());
+	for(QVector<DeviceResult>::size_type i = 0; i < results.size(); i++) {
+		results[i].reads = 0;
+		results[i].failures = 0;
+		results[i].totalLatency = 0;
+		results[i].maxLatency = 0;
+	}
+	running = true;
+	clock.start();
+	/* Each device keeps one read in flight so none can get ahead by queueing */
+	for(QList<MCP39F511Interface *>::size_type i = 0; i < powerMeters.size(); i++) {
+		readNext(i);
+	}
+	QTimer::singleShot(SCALING_BENCHMARK_DURATION, this, SLOT(slotComplete()));
+}
+
+void MCP39F511ScalingBenchmark::readNext(int device) {
+	if(!running) {
+		return;
+	}
+	DeviceResult *result = &results[device];
+	result->issued = clock.nsecsElapsed();
+	int transactionId = powerMeters.at(device)->getRegister(MCP_OUTPUT_REGISTERS_START, (u_int8_t *)&result->buffer, MCP_OUTPUT_REGISTERS_SIZE, MCP_PRIORITY_MEASUREMENT);
+	powerMeters.at(device)->onComplete(transactionId, [this, device](const Mcp39F511TransactionRef &transaction) {
+		if(!running) {
+			return;
+		}
+		DeviceResult *result = &results[device];
+		qint64 latency = clock.nsecsElapsed() - result->issued;
+		if(transaction->status == COMMS_COMPLETE) {
+			result->reads++;
+			result->totalLatency += latency;
+			result->maxLatency = qMax(result->maxLatency, latency);
+		} else {
+			result->failures++;
+		}
+		readNext(device);
+	});
+}
+
+void MCP39F511ScalingBenchmark::slotComplete() {
+	running = false;
+	printReport();
+	emit finished();
+}
+
+void MCP39F511ScalingBenchmark::printReport() {
+	double seconds = clock.elapsed() / (double)1000;
+	int totalReads = 0;
+	
+	qDebug("Scaling benchmark, %d devices", powerMeters.size());
+	qDebug("%-8s %8s %8s %10s %12s %12s", "Device", "Reads", "Failed", "Reads/s", "Mean lat us", "Max lat us");
+	for(QVector<DeviceResult>::size_type i = 0; i < results.size(); i++) {
+		const DeviceResult &result = results.at(i);
+		qDebug("%-8d %8d %8d %10.1f %12lld %12lld",
+			   powerMeters.at(i)->getDeviceId(), result.reads, result.failures, result.reads / seconds,
+			   result.reads ? result.totalLatency / result.reads / 1000 : 0, result.maxLatency / 1000);
+		totalReads += result.reads;
+	}
+	qDebug("Total %.1f reads/s, %.1f per device", totalReads / seconds, totalReads / seconds / powerMeters.size());
+}
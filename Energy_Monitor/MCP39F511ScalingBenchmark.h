@@ -0,0 +1,86 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511ScalingBenchmark.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 21:55
+ */
+
+#ifndef MCP39F511SCALINGBENCHMARK_H
+#define MCP39F511SCALINGBENCHMARK_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QVector>
+
+#include "MCP39F511Interface.h"
+
+/* Time in milliseconds the devices are read for */
+#define SCALING_BENCHMARK_DURATION 10000
+
+/**
+ * Reads the output registers of every MCP39F511 back to back, all at once, then reports
+ * the read rate and latency of each.  Shows whether one device holds up the others, run
+ * against 1, 4 and 8 MCP39F511 simulators to see how acquisition scales.
+ */
+class MCP39F511ScalingBenchmark : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511ScalingBenchmark(QList<MCP39F511Interface *> powerMeters, QObject *parent);
+	virtual ~MCP39F511ScalingBenchmark();
+	
+	/**
+	 * Start the benchmark, every device must have completed initialisation
+	 */
+	void start();
+	
+signals:
+	/**
+	 * Emitted once the report has been printed
+	 */
+	void finished();
+	
+private slots:
+	void slotComplete();
+	
+private:
+	typedef struct {
+		McpOutputRegisters buffer;
+		qint64 issued;			/* Nanoseconds, when the read in progress was queued */
+		int reads;
+		int failures;
+		qint64 totalLatency;	/* Nanoseconds */
+		qint64 maxLatency;
+	} DeviceResult;
+	
+	void readNext(int device);
+	void printReport();
+	
+	QList<MCP39F511Interface *> powerMeters;
+	QVector<DeviceResult> results;
+	QElapsedTimer clock;
+	bool running;
+};
+
+#endif /* MCP39F511SCALINGBENCHMARK_H */
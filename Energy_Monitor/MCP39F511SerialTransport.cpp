@@ -0,0 +1,108 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511SerialTransport.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 14:20
+ */
+
+#include <unistd.h>
+
+#include <QDebug>
+
+extern "C" {
+	#include <wiringSerial.h>
+	#include <wiringPi.h>
+};
+
+#include "MCP39F511SerialTransport.h"
+
+MCP39F511SerialTransport::MCP39F511SerialTransport(QString device, int baudRate, int resetGpio, QObject *parent) : MCP39F511Transport(parent) {
+	this->device = device;
+	this->baudRate = baudRate;
+	this->resetGpio = resetGpio;
+	serial_handle = -1;
+	serialNotifier = NULL;
+}
+
+MCP39F511SerialTransport::~MCP39F511SerialTransport() {
+	close();
+}
+
+void MCP39F511SerialTransport::printMessage(QString message) {
+	qDebug() << "MCP39F511 serial transport: " << message;
+}
+
+bool MCP39F511SerialTransport::open() {
+	serial_handle = serialOpen(device.toLocal8Bit().data(), baudRate);
+	if(serial_handle < 0) {
+		printMessage(QString("Failed to open serial port %1!").arg(device));
+		return false;
+	}
+	
+	/* Signal as soon as bytes arrive rather than polling the serial port */
+	serialNotifier = new QSocketNotifier(serial_handle, QSocketNotifier::Read, this);
+	connect(serialNotifier, SIGNAL(activated(int)), this, SIGNAL(readyRead()));
+	serialNotifier->setEnabled(true);
+	return true;
+}
+
+void MCP39F511SerialTransport::close() {
+	if(serialNotifier) {
+		serialNotifier->setEnabled(false);
+		serialNotifier->deleteLater();
+		serialNotifier = NULL;
+	}
+	if(serial_handle >= 0) {
+		serialClose(serial_handle);
+		serial_handle = -1;
+	}
+}
+
+bool MCP39F511SerialTransport::isOpen() {
+	return serial_handle >= 0;
+}
+
+int MCP39F511SerialTransport::read(u_int8_t *data, int length) {
+	return ::read(serial_handle, data, length);
+}
+
+int MCP39F511SerialTransport::write(const u_int8_t *data, int length) {
+	return ::write(serial_handle, data, length);
+}
+
+void MCP39F511SerialTransport::flush() {
+	serialFlush(serial_handle);
+}
+
+void MCP39F511SerialTransport::setReset(bool asserted) {
+	if(resetGpio == GPIO_NONE) {
+		return;
+	}
+	if(asserted) {
+		/* Set reset pin as an output and set to low (reset state) */
+		pinMode(resetGpio, OUTPUT);
+		pullUpDnControl(resetGpio, PUD_OFF);
+		digitalWrite(resetGpio, LOW);
+	} else {
+		digitalWrite(resetGpio, HIGH);
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511SerialTransport.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 14:20
+ */
+
+#ifndef MCP39F511SERIALTRANSPORT_H
+#define MCP39F511SERIALTRANSPORT_H
+
+#include <QSocketNotifier>
+#include <QString>
+
+#include "MCP39F511Transport.h"
+
+/* Serial port the MCP39F511 is connected to on the Orange Pi */
+#define SERIAL_PORT "/dev/ttyS3"
+#define SERIAL_BAUD_RATE 115200
+
+/**
+ * Defines the GPIO pin used to reset the MCP39F511
+ */
+#define GPIO_MCP39F511_RESET 1
+
+/* Use for resetGpio when there is no reset line, e.g. a simulator on a pseudo-terminal */
+#define GPIO_NONE -1
+
+/**
+ * MCP39F511 on a serial port, with its reset line on a GPIO.
+ * Works with any tty including the pseudo-terminal created by the MCP39F511 simulator.
+ */
+class MCP39F511SerialTransport : public MCP39F511Transport {
+	Q_OBJECT
+	
+public:
+	/**
+	 * @param device Serial device, e.g. /dev/ttyS3
+	 * @param baudRate Baud rate to open the port at
+	 * @param resetGpio wiringPi pin number for the reset line, GPIO_NONE if there isn't one
+	 */
+	MCP39F511SerialTransport(QString device, int baudRate, int resetGpio, QObject *parent);
+	virtual ~MCP39F511SerialTransport();
+	
+	bool open();
+	void close();
+	bool isOpen();
+	int read(u_int8_t *data, int length);
+	int write(const u_int8_t *data, int length);
+	void flush();
+	void setReset(bool asserted);
+	
+private:
+	void printMessage(QString message);
+	
+	QString device;
+	int baudRate;
+	int resetGpio;
+	int serial_handle;
+	QSocketNotifier *serialNotifier;
+};
+
+#endif /* MCP39F511SERIALTRANSPORT_H */
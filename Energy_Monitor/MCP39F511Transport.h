@@ -0,0 +1,95 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511Transport.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 14:20
+ */
+
+#ifndef MCP39F511TRANSPORT_H
+#define MCP39F511TRANSPORT_H
+
+#include <QObject>
+
+/**
+ * Byte stream to and from an MCP39F511.
+ * MCP39F511Comms only talks to the chip through this interface so the serial port
+ * can be swapped for a simulator, a capture replay or anything else that speaks the UART protocol.
+ * All methods are called on the comms thread.
+ */
+class MCP39F511Transport : public QObject {
+	Q_OBJECT
+	
+public:
+	MCP39F511Transport(QObject *parent) : QObject(parent) {}
+	virtual ~MCP39F511Transport() {}
+	
+	/**
+	 * Open the connection to the MCP39F511
+	 * @return Returns TRUE if OK, otherwise FALSE
+	 */
+	virtual bool open() = 0;
+	
+	/**
+	 * Close the connection to the MCP39F511
+	 */
+	virtual void close() = 0;
+	
+	/**
+	 * @return TRUE if the transport is open
+	 */
+	virtual bool isOpen() = 0;
+	
+	/**
+	 * Read whatever bytes are waiting without blocking
+	 * @param data Buffer to read into
+	 * @param length Size of the buffer
+	 * @return Number of bytes read, 0 or less if there were none
+	 */
+	virtual int read(u_int8_t *data, int length) = 0;
+	
+	/**
+	 * Write bytes to the MCP39F511 without blocking
+	 * @param data Bytes to write
+	 * @param length Number of bytes to write
+	 * @return Number of bytes accepted, less than 0 on error
+	 */
+	virtual int write(const u_int8_t *data, int length) = 0;
+	
+	/**
+	 * Discard any bytes waiting to be read
+	 */
+	virtual void flush() = 0;
+	
+	/**
+	 * Drive the MCP39F511 reset line
+	 * @param asserted TRUE to hold the chip in reset, FALSE to release it
+	 */
+	virtual void setReset(bool asserted) = 0;
+	
+signals:
+	/**
+	 * Emitted when bytes are waiting to be read
+	 */
+	void readyRead();
+};
+
+#endif /* MCP39F511TRANSPORT_H */
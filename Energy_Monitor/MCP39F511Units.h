@@ -0,0 +1,96 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MCP39F511Units.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 21:10
+ */
+
+#ifndef MCP39F511UNITS_H
+#define MCP39F511UNITS_H
+
+#include <sys/types.h>
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * Scale of a MCP39F511 register holding a measurement as an integer count of 1/Divisor units,
+ * e.g. voltage_RMS counts tenths of a volt.  Everything is worked out at compile time, so
+ * decoding is one multiply and encoding a multiply and round, with no library calls.
+ * Decimals is the number of decimal places the register resolves, used when printing.
+ */
+template <typename Raw, qint64 Divisor, int Decimals>
+class McpScale {
+public:
+	typedef Raw raw_type;
+	static constexpr qint64 divisor = Divisor;
+	static constexpr int decimals = Decimals;
+	
+	static constexpr double toDouble(Raw raw) {
+		return raw * (1.0 / Divisor);
+	}
+	
+	/**
+	 * Nearest register value to a measurement, the inverse of toDouble()
+	 */
+	static constexpr Raw fromDouble(double value) {
+		return (Raw)(value * Divisor + (value < 0 ? -0.5 : 0.5));
+	}
+	
+	/**
+	 * Register value in units of 1/OutDivisor, rounded to the nearest, using integers only
+	 */
+	template <qint64 OutDivisor>
+	static constexpr qint64 toFixed(Raw raw) {
+		return ((qint64)raw * OutDivisor * 2 + (raw < 0 ? -Divisor : Divisor)) / (2 * Divisor);
+	}
+	
+	/**
+	 * Print a register value in the measurement's units to the resolution of the register
+	 */
+	static QString toString(Raw raw) {
+		return QString::number(toDouble(raw), 'f', Decimals);
+	}
+};
+
+/* Output register scales - See MCP39F511 datasheet */
+typedef McpScale<u_int16_t, 10, 1> McpVoltageScale;			/* 0.1 V */
+typedef McpScale<u_int16_t, 1000, 3> McpFrequencyScale;		/* 1 mHz */
+typedef McpScale<int16_t, 32768, 4> McpPowerFactorScale;	/* Signed, 2^-15 per LSB */
+typedef McpScale<u_int32_t, 10000, 4> McpCurrentScale;		/* 0.1 mA */
+typedef McpScale<u_int32_t, 100, 2> McpPowerScale;			/* 10 mW, active, reactive and apparent */
+
+/* Energy counter scale, 1 mWh (1 mvarh) per LSB counted in kWh (kvarh) */
+typedef McpScale<u_int64_t, 1000000, 6> McpEnergyScale;
+
+/* Round trips are exact across each register's range */
+static_assert(McpVoltageScale::fromDouble(McpVoltageScale::toDouble(0xFFFF)) == 0xFFFF, "Voltage scale does not round trip");
+static_assert(McpFrequencyScale::fromDouble(McpFrequencyScale::toDouble(50001)) == 50001, "Frequency scale does not round trip");
+static_assert(McpPowerFactorScale::fromDouble(McpPowerFactorScale::toDouble(-32768)) == -32768, "Power factor scale does not round trip");
+static_assert(McpPowerFactorScale::fromDouble(McpPowerFactorScale::toDouble(32767)) == 32767, "Power factor scale does not round trip");
+static_assert(McpCurrentScale::fromDouble(McpCurrentScale::toDouble(0xFFFFFFFF)) == 0xFFFFFFFF, "Current scale does not round trip");
+static_assert(McpPowerScale::fromDouble(McpPowerScale::toDouble(0xFFFFFFFF)) == 0xFFFFFFFF, "Power scale does not round trip");
+static_assert(McpPowerFactorScale::toFixed<10000>(-32768) == -10000, "Power factor fixed point is wrong");
+static_assert(McpPowerFactorScale::toFixed<10000>(16384) == 5000, "Power factor fixed point is wrong");
+
+#endif /* MCP39F511UNITS_H */
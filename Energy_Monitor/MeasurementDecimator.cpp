@@ -0,0 +1,91 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MeasurementDecimator.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 19:05
+ */
+
+#include "MeasurementDecimator.h"
+
+MeasurementDecimator::MeasurementDecimator(int interval, decimation_mode mode, QObject *parent) : QObject(parent) {
+	this->interval = interval;
+	this->mode = mode;
+	nextDue = 0;
+	sum = {};
+	count = 0;
+	systemStatus = 0;
+	clock.start();
+}
+
+MeasurementDecimator::~MeasurementDecimator() {
+}
+
+void MeasurementDecimator::setInterval(int interval) {
+	this->interval = interval;
+	/* Pass the next measurement straight on at the new rate */
+	nextDue = 0;
+}
+
+int MeasurementDecimator::getInterval() {
+	return interval;
+}
+
+void MeasurementDecimator::slotMeasurementsReady(DecodedMeasurements values) {
+	/* Event flags raised by any of the measurements are kept, the sign flags come from the latest */
+	systemStatus |= values.systemStatus & MCP_SYSTEM_STATUS_EVENTS;
+	if(mode == DECIMATE_AVERAGE) {
+		sum.voltageRms += values.voltageRms;
+		sum.frequency += values.frequency;
+		sum.powerFactor += values.powerFactor;
+		sum.currentRms += values.currentRms;
+		sum.powerActive += values.powerActive;
+		sum.powerReactive += values.powerReactive;
+		sum.powerApparent += values.powerApparent;
+		count++;
+	}
+	
+	qint64 now = clock.elapsed();
+	if(now < nextDue) {
+		return;
+	}
+	/* Keep to the interval on average rather than drifting by the time between measurements */
+	nextDue += interval;
+	if(nextDue <= now) {
+		nextDue = now + interval;
+	}
+	
+	if(mode == DECIMATE_AVERAGE) {
+		values.voltageRms = sum.voltageRms / count;
+		values.frequency = sum.frequency / count;
+		values.powerFactor = sum.powerFactor / count;
+		values.currentRms = sum.currentRms / count;
+		values.powerActive = sum.powerActive / count;
+		values.powerReactive = sum.powerReactive / count;
+		values.powerApparent = sum.powerApparent / count;
+		sum = {};
+		count = 0;
+	}
+	values.systemStatus = (values.systemStatus & ~MCP_SYSTEM_STATUS_EVENTS) | systemStatus;
+	systemStatus = 0;
+	emit measurementsReady(values);
+}
@@ -0,0 +1,79 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MeasurementDecimator.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 19:05
+ */
+
+#ifndef MEASUREMENTDECIMATOR_H
+#define MEASUREMENTDECIMATOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+
+#include "MCP39F511Interface.h"
+
+typedef enum {
+	DECIMATE_LATEST,	/* Pass on the most recent measurement */
+	DECIMATE_AVERAGE	/* Pass on the mean of the measurements since the last one passed on */
+} decimation_mode;
+
+/**
+ * Sits between the power meter and a consumer of measurements that wants them at a lower rate
+ * than they are acquired, e.g. the LCD at 1 Hz while the data log takes every sample.
+ * Nothing is passed on when no measurements arrive, so a stalled consumer never holds up
+ * acquisition and a stalled acquisition is never padded out with repeated values.
+ * Each measurement passed on keeps the time and sequence number of the latest one, with the
+ * system status flags of all of them.
+ */
+class MeasurementDecimator : public QObject {
+	Q_OBJECT
+	
+public:
+	/**
+	 * @param interval Minimum time in milliseconds between measurements passed on, 0 for every measurement
+	 * @param mode How the measurements in each interval are combined
+	 */
+	MeasurementDecimator(int interval, decimation_mode mode, QObject *parent);
+	virtual ~MeasurementDecimator();
+	
+	void setInterval(int interval);
+	int getInterval();
+	
+signals:
+	void measurementsReady(DecodedMeasurements);
+	
+public slots:
+	void slotMeasurementsReady(DecodedMeasurements values);
+	
+private:
+	int interval;
+	decimation_mode mode;
+	QElapsedTimer clock;
+	qint64 nextDue;
+	DecodedMeasurements sum;
+	int count;
+	u_int16_t systemStatus;
+};
+
+#endif /* MEASUREMENTDECIMATOR_H */
@@ -0,0 +1,131 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MeasurementFilter.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 20:30
+ */
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "MeasurementFilter.h"
+
+/* Window used by the benchmark, the worst case for the median */
+#define FILTER_BENCHMARK_WINDOW FILTER_MAX_WINDOW
+
+MeasurementFilter::MeasurementFilter(QObject *parent) : QObject(parent) {
+}
+
+MeasurementFilter::~MeasurementFilter() {
+}
+
+double &MeasurementFilter::channelValue(DecodedMeasurements &values, measurement_channel channel) {
+	switch(channel) {
+		case MEASUREMENT_VOLTAGE_RMS: return values.voltageRms;
+		case MEASUREMENT_FREQUENCY: return values.frequency;
+		case MEASUREMENT_POWER_FACTOR: return values.powerFactor;
+		case MEASUREMENT_CURRENT_RMS: return values.currentRms;
+		case MEASUREMENT_POWER_ACTIVE: return values.powerActive;
+		case MEASUREMENT_POWER_REACTIVE: return values.powerReactive;
+		default: return values.powerApparent;
+	}
+}
+
+void MeasurementFilter::setFilter(measurement_channel channel, const FilterConfig &config) {
+	channels[channel].configure(config);
+}
+
+FilterConfig MeasurementFilter::getFilter(measurement_channel channel) {
+	return channels[channel].getConfig();
+}
+
+void MeasurementFilter::setThresholdScale(double scale) {
+	for(int i = 0; i < MEASUREMENT_CHANNELS; i++) {
+		channels[i].setScale(scale);
+	}
+}
+
+void MeasurementFilter::reset() {
+	for(int i = 0; i < MEASUREMENT_CHANNELS; i++) {
+		channels[i].reset();
+	}
+}
+
+DecodedMeasurements MeasurementFilter::filter(const DecodedMeasurements &values) {
+	DecodedMeasurements filtered = values;
+	for(int i = 0; i < MEASUREMENT_CHANNELS; i++) {
+		double &value = channelValue(filtered, (measurement_channel)i);
+		value = channels[i].update(value);
+	}
+	return filtered;
+}
+
+void MeasurementFilter::slotMeasurementsReady(DecodedMeasurements values) {
+	emit measurementsReady(filter(values));
+}
+
+void MeasurementFilter::benchmark(int samples) {
+	const char *names[] = {"None", "Moving average", "Exponential", "Median", "Deadband"};
+	FilterConfig configs[] = {
+		{FILTER_NONE, 1, 1, 0, 0},
+		{FILTER_MOVING_AVERAGE, FILTER_BENCHMARK_WINDOW, 1, 0, 0},
+		{FILTER_EXPONENTIAL, 1, 0.1, 0, 0},
+		{FILTER_MEDIAN, FILTER_BENCHMARK_WINDOW, 1, 0, 0},
+		{FILTER_DEADBAND, 2, 1, 0.05, 0.01}
+	};
+	DecodedMeasurements values = {};
+	values.voltageRms = 230;
+	values.frequency = 50;
+	values.powerFactor = 0.95;
+	values.currentRms = 2.5;
+	values.powerActive = 546;
+	values.powerReactive = 180;
+	values.powerApparent = 575;
+	
+	qDebug() << "Measurement filter benchmark:" << samples << "samples, window" << FILTER_BENCHMARK_WINDOW;
+	for(unsigned int type = 0; type < sizeof(configs) / sizeof(configs[0]); type++) {
+		MeasurementFilter filter(NULL);
+		for(int i = 0; i < MEASUREMENT_CHANNELS; i++) {
+			filter.setFilter((measurement_channel)i, configs[type]);
+		}
+		/* Noisy input so the median has to move samples around */
+		unsigned int noise = 12345;
+		double check = 0;
+		QElapsedTimer timer;
+		timer.start();
+		for(int n = 0; n < samples; n++) {
+			noise = noise * 1103515245 + 12345;
+			double delta = ((noise >> 16) & 0xFF) / (double)2560;
+			DecodedMeasurements input = values;
+			input.voltageRms += delta;
+			input.currentRms += delta;
+			input.powerActive += delta;
+			check += filter.filter(input).powerActive;
+		}
+		qint64 elapsed = timer.nsecsElapsed();
+		qDebug() << QString("  %1 %2 ns per sample (%3)")
+				.arg(names[type], -15)
+				.arg(elapsed / (double)samples, 0, 'f', 1)
+				.arg(check / samples, 0, 'f', 2);
+	}
+}
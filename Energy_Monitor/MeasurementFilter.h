@@ -0,0 +1,342 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+
+/* 
+ * File:   MeasurementFilter.h
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 20:30
+ */
+
+#ifndef MEASUREMENTFILTER_H
+#define MEASUREMENTFILTER_H
+
+#include <QObject>
+
+#include "MCP39F511Interface.h"
+
+/* Largest window any filter stage can be configured with */
+#define FILTER_MAX_WINDOW 16
+
+typedef enum {
+	FILTER_NONE,
+	FILTER_MOVING_AVERAGE,	/* Mean of the last window samples */
+	FILTER_EXPONENTIAL,		/* Exponential moving average */
+	FILTER_MEDIAN,			/* Median of the last window samples, rejects single sample spikes */
+	FILTER_DEADBAND			/* Reads zero until the value has been above threshold for window samples */
+} filter_type;
+
+typedef enum {
+	MEASUREMENT_VOLTAGE_RMS,
+	MEASUREMENT_FREQUENCY,
+	MEASUREMENT_POWER_FACTOR,
+	MEASUREMENT_CURRENT_RMS,
+	MEASUREMENT_POWER_ACTIVE,
+	MEASUREMENT_POWER_REACTIVE,
+	MEASUREMENT_POWER_APPARENT,
+	MEASUREMENT_CHANNELS
+} measurement_channel;
+
+typedef struct {
+	filter_type type;
+	int window;			/* Samples, up to FILTER_MAX_WINDOW */
+	double alpha;		/* Weight given to each new sample by FILTER_EXPONENTIAL */
+	double threshold;	/* FILTER_DEADBAND reads zero at or below this */
+	double hysteresis;	/* Once passing, FILTER_DEADBAND only reads zero again at or below threshold - hysteresis */
+} FilterConfig;
+
+/**
+ * Mean of the last Window samples, kept as a running sum so each update costs the same
+ * however large the window.
+ */
+template <typename T, int Capacity>
+class MovingAverageStage {
+public:
+	MovingAverageStage() : window(1) {
+		reset();
+	}
+	
+	void setWindow(int window) {
+		this->window = qBound(1, window, Capacity);
+		reset();
+	}
+	
+	void reset() {
+		sum = 0;
+		count = 0;
+		position = 0;
+	}
+	
+	T update(T value) {
+		if(count == window) {
+			sum -= samples[position];
+		} else {
+			count++;
+		}
+		samples[position] = value;
+		sum += value;
+		position = (position + 1) % window;
+		return sum / count;
+	}
+	
+private:
+	T samples[Capacity];
+	T sum;
+	int window;
+	int count;
+	int position;
+};
+
+template <typename T>
+class ExponentialStage {
+public:
+	ExponentialStage() : alpha(1) {
+		reset();
+	}
+	
+	void setAlpha(T alpha) {
+		this->alpha = qBound((T)0, alpha, (T)1);
+		reset();
+	}
+	
+	void reset() {
+		primed = false;
+	}
+	
+	T update(T value) {
+		/* Start from the first sample rather than ramping up from zero */
+		if(!primed) {
+			average = value;
+			primed = true;
+		} else {
+			average += alpha * (value - average);
+		}
+		return average;
+	}
+	
+private:
+	T alpha;
+	T average;
+	bool primed;
+};
+
+/**
+ * Median of the last Window samples.  The samples are kept sorted as they arrive so each update
+ * moves at most Capacity entries and costs no more as the stream goes on.
+ */
+template <typename T, int Capacity>
+class MedianStage {
+public:
+	MedianStage() : window(1) {
+		reset();
+	}
+	
+	void setWindow(int window) {
+		this->window = qBound(1, window, Capacity);
+		reset();
+	}
+	
+	void reset() {
+		count = 0;
+		position = 0;
+	}
+	
+	T update(T value) {
+		int i;
+		if(count == window) {
+			/* Take the oldest sample out of the sorted list */
+			T oldest = samples[position];
+			for(i = 0; i < count - 1 && sorted[i] != oldest; i++);
+			for(; i < count - 1; i++) {
+				sorted[i] = sorted[i + 1];
+			}
+			count--;
+		}
+		samples[position] = value;
+		position = (position + 1) % window;
+		
+		for(i = count; i > 0 && sorted[i - 1] > value; i--) {
+			sorted[i] = sorted[i - 1];
+		}
+		sorted[i] = value;
+		count++;
+		
+		if(count & 1) {
+			return sorted[count / 2];
+		}
+		return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+	}
+	
+private:
+	T samples[Capacity];
+	T sorted[Capacity];
+	int window;
+	int count;
+	int position;
+};
+
+/**
+ * Zeroes a quantity that is only noise, e.g. the power read with nothing plugged in.
+ * The value reads zero until it has been above the threshold for Window samples in a row,
+ * then follows the input until it falls to threshold - hysteresis.
+ */
+template <typename T>
+class DeadbandStage {
+public:
+	DeadbandStage() : window(1), threshold(0), hysteresis(0), scale(1) {
+		reset();
+	}
+	
+	void setThreshold(T threshold, T hysteresis, int window) {
+		this->threshold = threshold;
+		this->hysteresis = hysteresis;
+		this->window = qMax(1, window);
+		reset();
+	}
+	
+	/**
+	 * Scale the thresholds, e.g. for noisier measurements over shorter accumulation intervals
+	 */
+	void setScale(T scale) {
+		this->scale = scale;
+	}
+	
+	void reset() {
+		above = 0;
+	}
+	
+	T update(T value) {
+		T limit = threshold * scale;
+		if(above >= window) {
+			limit -= hysteresis * scale;
+		}
+		if(value <= limit) {
+			above = 0;
+			return 0;
+		}
+		if(above < window) {
+			above++;
+		}
+		return above >= window ? value : 0;
+	}
+	
+private:
+	int window;
+	T threshold;
+	T hysteresis;
+	T scale;
+	int above;
+};
+
+/**
+ * One quantity's filter, any of the stage types selected at run time
+ */
+template <typename T, int Capacity>
+class ChannelFilter {
+public:
+	ChannelFilter() {
+		config = {FILTER_NONE, 1, 1, 0, 0};
+	}
+	
+	void configure(const FilterConfig &config) {
+		this->config = config;
+		movingAverage.setWindow(config.window);
+		exponential.setAlpha(config.alpha);
+		median.setWindow(config.window);
+		deadband.setThreshold(config.threshold, config.hysteresis, config.window);
+	}
+	
+	const FilterConfig &getConfig() const {
+		return config;
+	}
+	
+	void setScale(T scale) {
+		deadband.setScale(scale);
+	}
+	
+	void reset() {
+		movingAverage.reset();
+		exponential.reset();
+		median.reset();
+		deadband.reset();
+	}
+	
+	T update(T value) {
+		switch(config.type) {
+			case FILTER_MOVING_AVERAGE: return movingAverage.update(value);
+			case FILTER_EXPONENTIAL: return exponential.update(value);
+			case FILTER_MEDIAN: return median.update(value);
+			case FILTER_DEADBAND: return deadband.update(value);
+			default: return value;
+		}
+	}
+	
+private:
+	FilterConfig config;
+	MovingAverageStage<T, Capacity> movingAverage;
+	ExponentialStage<T> exponential;
+	MedianStage<T, Capacity> median;
+	DeadbandStage<T> deadband;
+};
+
+/**
+ * Filters each measured quantity with its own filter stage.  Each consumer of measurements can
+ * have its own instance, e.g. spike rejection for the display while the log keeps what was measured.
+ */
+class MeasurementFilter : public QObject {
+	Q_OBJECT
+	
+public:
+	MeasurementFilter(QObject *parent);
+	virtual ~MeasurementFilter();
+	
+	void setFilter(measurement_channel channel, const FilterConfig &config);
+	FilterConfig getFilter(measurement_channel channel);
+	
+	/**
+	 * Scale the deadband thresholds of all channels
+	 */
+	void setThresholdScale(double scale);
+	void reset();
+	
+	/**
+	 * Filter one set of measurements
+	 */
+	DecodedMeasurements filter(const DecodedMeasurements &values);
+	
+	/**
+	 * Time each filter type over synthetic measurements and print the cost per sample
+	 * @param samples Number of samples to filter with each type
+	 */
+	static void benchmark(int samples);
+	
+signals:
+	void measurementsReady(DecodedMeasurements);
+	
+public slots:
+	void slotMeasurementsReady(DecodedMeasurements values);
+	
+private:
+	static double &channelValue(DecodedMeasurements &values, measurement_channel channel);
+	
+	ChannelFilter<double, FILTER_MAX_WINDOW> channels[MEASUREMENT_CHANNELS];
+};
+
+#endif /* MEASUREMENTFILTER_H */
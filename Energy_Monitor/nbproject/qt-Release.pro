@@ -8,8 +8,8 @@ CONFIG -= debug_and_release app_bundle lib_bundle
 CONFIG += release 
 PKGCONFIG +=
 QT = core gui widgets
-SOURCES += DataLog.cpp EnergyMonitor.cpp InputControl.cpp MCP39F511Calibration.cpp MCP39F511Comms.cpp MCP39F511Interface.cpp PA1000PowerAnalyser.cpp main.cpp
-HEADERS += DataLog.h EnergyMonitorAppGlobal.h EnergyMonitor.h InputControl.h MCP39F511Calibration.h MCP39F511Comms.h MCP39F511Interface.h PA1000PowerAnalyser.h
+SOURCES += DataLog.cpp EnergyMonitor.cpp InputControl.cpp MCP39F511AcquisitionScheduler.cpp MCP39F511BurstCapture.cpp MCP39F511Calibration.cpp MCP39F511CaptureTransport.cpp MCP39F511Comms.cpp MCP39F511CompletionRegistry.cpp MCP39F511EepromJob.cpp MCP39F511EnergyAccumulator.cpp MCP39F511EnergyCheckpoint.cpp MCP39F511FaultBenchmark.cpp MCP39F511FaultInjector.cpp MCP39F511Interface.cpp MCP39F511MinMaxRecorder.cpp MCP39F511RegisterCache.cpp MCP39F511ReplayBenchmark.cpp MCP39F511ReplayTransport.cpp MCP39F511ScalingBenchmark.cpp MCP39F511SerialTransport.cpp MeasurementDecimator.cpp MeasurementFilter.cpp PA1000PowerAnalyser.cpp main.cpp
+HEADERS += BufferPool.h DataLog.h EnergyMonitorAppGlobal.h EnergyMonitor.h InputControl.h LockFreeQueue.h MCP39F511AcquisitionScheduler.h MCP39F511BurstCapture.h MCP39F511Calibration.h MCP39F511CaptureTransport.h MCP39F511Comms.h MCP39F511CompletionRegistry.h MCP39F511EepromJob.h MCP39F511EnergyAccumulator.h MCP39F511EnergyCheckpoint.h MCP39F511FaultBenchmark.h MCP39F511FaultInjector.h MCP39F511Interface.h MCP39F511MinMaxRecorder.h MCP39F511RegisterCache.h MCP39F511ReplayBenchmark.h MCP39F511ReplayTransport.h MCP39F511ScalingBenchmark.h MCP39F511SerialTransport.h MCP39F511Transport.h MCP39F511Units.h MeasurementDecimator.h MeasurementFilter.h PA1000PowerAnalyser.h
 FORMS +=
 RESOURCES +=
 TRANSLATIONS +=
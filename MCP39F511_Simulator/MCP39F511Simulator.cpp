@@ -0,0 +1,355 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511Simulator.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 15:10
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "MCP39F511Simulator.h"
+
+/* Power on defaults */
+#define DEFAULT_SYSTEM_VERSION 0x0511
+#define DEFAULT_CALIBRATION_DELIMITER 0x1234
+#define DEFAULT_ACCUMULATION_INTERVAL 2
+#define DEFAULT_LINE_FREQUENCY_REF 50000
+
+MCP39F511Simulator::MCP39F511Simulator(Waveform *waveform) {
+	this->waveform = waveform;
+	
+	/* Factory state of flash and EEPROM */
+	memset(registers, 0, sizeof(registers));
+	set16(REG_CALIBRATION_DELIMITER, DEFAULT_CALIBRATION_DELIMITER);
+	registers[REG_RANGE] = 0x12;
+	registers[REG_RANGE + 1] = 0x09;
+	registers[REG_RANGE + 2] = 0x10;
+	set16(REG_LINE_FREQUENCY_REF, DEFAULT_LINE_FREQUENCY_REF);
+	set16(REG_ACCUMULATION_INTERVAL, DEFAULT_ACCUMULATION_INTERVAL);
+	memcpy(flash, registers, sizeof(flash));
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	
+	frameCount = 0;
+	errorCount = 0;
+	reset();
+}
+
+void MCP39F511Simulator::reset() {
+	memset(registers, 0, sizeof(registers));
+	memcpy(&registers[FLASH_REGISTERS_START], &flash[FLASH_REGISTERS_START], REGISTER_MAP_SIZE - FLASH_REGISTERS_START);
+	set16(REG_SYSTEM_VERSION, DEFAULT_SYSTEM_VERSION);
+	addressPointer = 0;
+	frame.clear();
+	lastUpdate = 0;
+	memset(energy, 0, sizeof(energy));
+	lastPointer1 = get16(REG_MIN_MAX_POINTER_1);
+	lastPointer2 = get16(REG_MIN_MAX_POINTER_2);
+}
+
+void MCP39F511Simulator::receive(const u_int8_t *data, int length, std::vector<u_int8_t> &response) {
+	for(int i = 0; i < length; i++) {
+		/* Hunt for the start of a frame */
+		if(frame.empty() && data[i] != FRAME_HEADER) {
+			continue;
+		}
+		frame.push_back(data[i]);
+		if(frame.size() < 2) {
+			continue;
+		}
+		
+		u_int8_t frameLength = frame[1];
+		if(frameLength < 4 || frameLength > FRAME_MAX_LENGTH) {
+			response.push_back(RESP_NAK);
+			errorCount++;
+			frame.clear();
+			continue;
+		}
+		if(frame.size() < frameLength) {
+			continue;
+		}
+		
+		/* Whole frame received */
+		u_int8_t checksum = 0;
+		for(int j = 0; j < frameLength - 1; j++) {
+			checksum += frame[j];
+		}
+		frameCount++;
+		if(checksum != frame[frameLength - 1]) {
+			response.push_back(RESP_CSFAIL);
+			errorCount++;
+		} else {
+			execute(&frame[2], frameLength - 3, response);
+		}
+		frame.clear();
+	}
+}
+
+/**
+ * Executes the commands in a frame in order.  Only a single ACK is returned for the frame,
+ * followed by the data from any reads.  An invalid command NAKs the frame, any commands
+ * before it have already been executed.
+ */
+void MCP39F511Simulator::execute(const u_int8_t *payload, int length, std::vector<u_int8_t> &response) {
+	std::vector<u_int8_t> data;
+	bool valid = true;
+	int i = 0;
+	
+	while(i < length) {
+		u_int8_t command = payload[i++];
+		int remaining = length - i;
+		
+		switch(command) {
+			case CMD_SET_ADDRESS_POINTER:
+				if(remaining < 2) {
+					valid = false;
+					break;
+				}
+				addressPointer = (payload[i] << 8) | payload[i + 1];
+				i += 2;
+				break;
+				
+			case CMD_REGISTER_READ: {
+				if(remaining < 1) {
+					valid = false;
+					break;
+				}
+				int count = payload[i++];
+				if(count > REGISTER_READ_MAX_LENGTH || addressPointer + count > REGISTER_MAP_SIZE) {
+					valid = false;
+					break;
+				}
+				data.insert(data.end(), &registers[addressPointer], &registers[addressPointer + count]);
+				break;
+			}
+			
+			case CMD_REGISTER_WRITE: {
+				if(remaining < 1) {
+					valid = false;
+					break;
+				}
+				int count = payload[i++];
+				if(count > remaining - 1 || addressPointer + count > REGISTER_MAP_SIZE) {
+					valid = false;
+					break;
+				}
+				memcpy(&registers[addressPointer], &payload[i], count);
+				i += count;
+				break;
+			}
+			
+			case CMD_SAVE_REGISTERS_TO_FLASH:
+				memcpy(&flash[FLASH_REGISTERS_START], &registers[FLASH_REGISTERS_START], REGISTER_MAP_SIZE - FLASH_REGISTERS_START);
+				break;
+				
+			case CMD_PAGE_READ_EEPROM:
+				if(remaining < 1 || payload[i] >= EEPROM_PAGE_COUNT) {
+					valid = false;
+					break;
+				}
+				data.insert(data.end(), eeprom[payload[i]], eeprom[payload[i]] + EEPROM_PAGE_SIZE);
+				i++;
+				break;
+				
+			case CMD_PAGE_WRITE_EEPROM:
+				if(remaining < EEPROM_PAGE_SIZE + 1 || payload[i] >= EEPROM_PAGE_COUNT) {
+					valid = false;
+					break;
+				}
+				memcpy(eeprom[payload[i]], &payload[i + 1], EEPROM_PAGE_SIZE);
+				i += EEPROM_PAGE_SIZE + 1;
+				break;
+				
+			case CMD_BULK_ERASE_EEPROM:
+				memset(eeprom, 0xFF, sizeof(eeprom));
+				break;
+				
+			/* The simulated front end is ideal so calibration has nothing to correct */
+			case CMD_AUTO_CALIBRATE_GAIN:
+			case CMD_AUTO_CALIBRATE_REACTIVE_GAIN:
+			case CMD_AUTO_CALIBRATE_FREQUENCY:
+				break;
+				
+			default:
+				valid = false;
+				break;
+		}
+		
+		if(!valid) {
+			errorCount++;
+			response.push_back(RESP_NAK);
+			return;
+		}
+	}
+	
+	response.push_back(RESP_ACK);
+	if(!data.empty()) {
+		u_int8_t checksum = RESP_ACK;
+		u_int8_t frameLength = data.size() + 3;
+		response.push_back(frameLength);
+		checksum += frameLength;
+		for(size_t j = 0; j < data.size(); j++) {
+			response.push_back(data[j]);
+			checksum += data[j];
+		}
+		response.push_back(checksum);
+	}
+}
+
+/**
+ * Accumulation interval is 2^N line cycles
+ */
+double MCP39F511Simulator::accumulationPeriod() {
+	double frequency = get16(REG_LINE_FREQUENCY) / (double)1000;
+	if(frequency <= 0) {
+		frequency = get16(REG_LINE_FREQUENCY_REF) / (double)1000;
+	}
+	if(frequency <= 0) {
+		frequency = 50;
+	}
+	return (1 << (get16(REG_ACCUMULATION_INTERVAL) & 0x0F)) / frequency;
+}
+
+bool MCP39F511Simulator::update(double seconds) {
+	double period = accumulationPeriod();
+	if(seconds - lastUpdate < period) {
+		return false;
+	}
+	double elapsed = seconds - lastUpdate;
+	lastUpdate = seconds;
+	
+	WaveformPoint point = waveform->at(seconds);
+	double apparent = point.voltageRms * point.currentRms;
+	double active = apparent * point.powerFactor;
+	double reactive = apparent * std::sqrt(std::max(0.0, 1 - point.powerFactor * point.powerFactor));
+	
+	/* Same scaling as MCP39F511Interface decodes */
+	set16(REG_VOLTAGE_RMS, (u_int16_t)(point.voltageRms * 10));
+	set16(REG_LINE_FREQUENCY, (u_int16_t)(point.frequency * 1000));
+	set16(REG_POWER_FACTOR, (u_int16_t)(int16_t)std::max(-32768.0, std::min(32767.0, point.powerFactor * 32768)));
+	set32(REG_CURRENT_RMS, (u_int32_t)(point.currentRms * 10000));
+	set32(REG_ACTIVE_POWER, (u_int32_t)(std::fabs(active) * 100));
+	set32(REG_REACTIVE_POWER, (u_int32_t)(reactive * 100));
+	set32(REG_APPARENT_POWER, (u_int32_t)(apparent * 100));
+	
+	/* Event flags */
+	u_int16_t status = 0;
+	if(active >= 0) {
+		status |= SYSTEM_STATUS_SIGN_PA;
+	}
+	status |= SYSTEM_STATUS_SIGN_PR;
+	if(get16(REG_VOLTAGE_SAG_LIMIT) && get16(REG_VOLTAGE_RMS) < get16(REG_VOLTAGE_SAG_LIMIT)) {
+		status |= SYSTEM_STATUS_VSAG;
+	}
+	if(get16(REG_VOLTAGE_SURGE_LIMIT) && get16(REG_VOLTAGE_RMS) > get16(REG_VOLTAGE_SURGE_LIMIT)) {
+		status |= SYSTEM_STATUS_VSURGE;
+	}
+	if(get32(REG_OVERCURRENT_LIMIT) && get32(REG_CURRENT_RMS) > get32(REG_OVERCURRENT_LIMIT)) {
+		status |= SYSTEM_STATUS_OVERCUR;
+	}
+	if(get32(REG_OVERPOWER_LIMIT) && get32(REG_ACTIVE_POWER) > get32(REG_OVERPOWER_LIMIT)) {
+		status |= SYSTEM_STATUS_OVERPOW;
+	}
+	set16(REG_SYSTEM_STATUS, status);
+	
+	/* Energy accumulation when enabled */
+	if(get16(REG_ENERGY_CONTROL)) {
+		double hours = elapsed / 3600;
+		energy[active >= 0 ? 0 : 1] += std::fabs(active) * hours / ENERGY_COUNTER_LSB;
+		energy[2] += reactive * hours / ENERGY_COUNTER_LSB;
+		u_int16_t counters[4] = {REG_IMPORT_ACTIVE_ENERGY, REG_EXPORT_ACTIVE_ENERGY, REG_IMPORT_REACTIVE_ENERGY, REG_EXPORT_REACTIVE_ENERGY};
+		for(int i = 0; i < 4; i++) {
+			u_int64_t whole = (u_int64_t)energy[i];
+			if(whole) {
+				add64(counters[i], whole);
+				energy[i] -= whole;
+			}
+		}
+	} else {
+		/* Clearing the energy control register resets the counters */
+		memset(&registers[REG_IMPORT_ACTIVE_ENERGY], 0, REG_MIN_RECORD_1 - REG_IMPORT_ACTIVE_ENERGY);
+		memset(energy, 0, sizeof(energy));
+	}
+	
+	updateRecord(REG_MIN_MAX_POINTER_1, REG_MIN_RECORD_1, REG_MAX_RECORD_1, &lastPointer1);
+	updateRecord(REG_MIN_MAX_POINTER_2, REG_MIN_RECORD_2, REG_MAX_RECORD_2, &lastPointer2);
+	return true;
+}
+
+/**
+ * Track the minimum and maximum of the output register selected by a min/max pointer.
+ * Changing the pointer restarts the record.
+ */
+void MCP39F511Simulator::updateRecord(u_int16_t pointerAddress, u_int16_t minAddress, u_int16_t maxAddress, u_int16_t *lastPointer) {
+	u_int16_t pointer = get16(pointerAddress);
+	u_int32_t value = readOutput(pointer);
+	
+	if(pointer != *lastPointer) {
+		*lastPointer = pointer;
+		set32(minAddress, value);
+		set32(maxAddress, value);
+		return;
+	}
+	if(value < get32(minAddress)) {
+		set32(minAddress, value);
+	}
+	if(value > get32(maxAddress)) {
+		set32(maxAddress, value);
+	}
+}
+
+/**
+ * Output registers below the current are 16 bit, the rest 32 bit
+ */
+u_int32_t MCP39F511Simulator::readOutput(u_int16_t address) {
+	if(address < REG_CURRENT_RMS) {
+		return get16(address & ~1);
+	} else if(address <= REG_APPARENT_POWER) {
+		return get32(address & ~1);
+	}
+	return 0;
+}
+
+u_int16_t MCP39F511Simulator::get16(u_int16_t address) {
+	return registers[address] | (registers[address + 1] << 8);
+}
+
+u_int32_t MCP39F511Simulator::get32(u_int16_t address) {
+	return get16(address) | ((u_int32_t)get16(address + 2) << 16);
+}
+
+void MCP39F511Simulator::set16(u_int16_t address, u_int16_t value) {
+	registers[address] = value & 0xFF;
+	registers[address + 1] = value >> 8;
+}
+
+void MCP39F511Simulator::set32(u_int16_t address, u_int32_t value) {
+	set16(address, value & 0xFFFF);
+	set16(address + 2, value >> 16);
+}
+
+void MCP39F511Simulator::add64(u_int16_t address, u_int64_t value) {
+	u_int64_t current = (u_int64_t)get32(address) | ((u_int64_t)get32(address + 4) << 32);
+	current += value;
+	set32(address, current & 0xFFFFFFFF);
+	set32(address + 4, current >> 32);
+}
@@ -0,0 +1,169 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   MCP39F511Simulator.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 15:10
+ */
+
+#ifndef MCP39F511SIMULATOR_H
+#define MCP39F511SIMULATOR_H
+
+#include <sys/types.h>
+#include <vector>
+
+#include "Waveform.h"
+
+/* MCP39F511 UART protocol */
+#define FRAME_HEADER 0xA5
+#define RESP_ACK 0x06
+#define RESP_NAK 0x15
+#define RESP_CSFAIL 0x51
+#define FRAME_MAX_LENGTH 0x23
+#define REGISTER_READ_MAX_LENGTH 0x20
+
+#define CMD_REGISTER_READ 0x4E
+#define CMD_REGISTER_WRITE 0x4D
+#define CMD_SET_ADDRESS_POINTER 0x41
+#define CMD_SAVE_REGISTERS_TO_FLASH 0x53
+#define CMD_PAGE_READ_EEPROM 0x42
+#define CMD_PAGE_WRITE_EEPROM 0x50
+#define CMD_BULK_ERASE_EEPROM 0x4F
+#define CMD_AUTO_CALIBRATE_GAIN 0x5A
+#define CMD_AUTO_CALIBRATE_REACTIVE_GAIN 0x7A
+#define CMD_AUTO_CALIBRATE_FREQUENCY 0x76
+
+/* Register map, see MCP39F511Interface.h for the full layout */
+#define REGISTER_MAP_SIZE 0xE2
+#define REG_SYSTEM_STATUS 0x0002
+#define REG_SYSTEM_VERSION 0x0004
+#define REG_VOLTAGE_RMS 0x0006
+#define REG_LINE_FREQUENCY 0x0008
+#define REG_POWER_FACTOR 0x000C
+#define REG_CURRENT_RMS 0x000E
+#define REG_ACTIVE_POWER 0x0012
+#define REG_REACTIVE_POWER 0x0016
+#define REG_APPARENT_POWER 0x001A
+#define REG_IMPORT_ACTIVE_ENERGY 0x001E
+#define REG_EXPORT_ACTIVE_ENERGY 0x0026
+#define REG_IMPORT_REACTIVE_ENERGY 0x002E
+#define REG_EXPORT_REACTIVE_ENERGY 0x0036
+#define REG_MIN_RECORD_1 0x003E
+#define REG_MIN_RECORD_2 0x0042
+#define REG_MAX_RECORD_1 0x004E
+#define REG_MAX_RECORD_2 0x0052
+#define REG_CALIBRATION_DELIMITER 0x005E
+#define REG_SYSTEM_CONFIG 0x007A
+#define REG_RANGE 0x0082
+#define REG_LINE_FREQUENCY_REF 0x0094
+#define REG_ACCUMULATION_INTERVAL 0x009E
+#define REG_VOLTAGE_SAG_LIMIT 0x00A0
+#define REG_VOLTAGE_SURGE_LIMIT 0x00A2
+#define REG_OVERCURRENT_LIMIT 0x00A4
+#define REG_OVERPOWER_LIMIT 0x00A8
+#define REG_MIN_MAX_POINTER_1 0x00D4
+#define REG_MIN_MAX_POINTER_2 0x00D6
+#define REG_ENERGY_CONTROL 0x00DC
+
+/* System status register bits */
+#define SYSTEM_STATUS_SIGN_PR (1<<5)
+#define SYSTEM_STATUS_SIGN_PA (1<<4)
+#define SYSTEM_STATUS_OVERPOW (1<<3)
+#define SYSTEM_STATUS_OVERCUR (1<<2)
+#define SYSTEM_STATUS_VSURGE (1<<1)
+#define SYSTEM_STATUS_VSAG (1<<0)
+
+/* Registers from here on are saved to flash */
+#define FLASH_REGISTERS_START REG_CALIBRATION_DELIMITER
+
+#define EEPROM_PAGE_SIZE 16
+#define EEPROM_PAGE_COUNT 32
+
+/* Energy counter resolution in Wh */
+#define ENERGY_COUNTER_LSB 0.001
+
+/**
+ * Software model of an MCP39F511 power monitor.
+ * Bytes received on the UART are fed in and the responses collected, the output, energy and
+ * min/max registers are recalculated from a Waveform every accumulation interval.
+ */
+class MCP39F511Simulator {
+public:
+	MCP39F511Simulator(Waveform *waveform);
+	
+	/**
+	 * Power on reset, registers are loaded from flash and the EEPROM is kept
+	 */
+	void reset();
+	
+	/**
+	 * Feed bytes received from the host into the simulator
+	 * @param data Received bytes
+	 * @param length Number of bytes
+	 * @param response Any responses are appended here
+	 */
+	void receive(const u_int8_t *data, int length, std::vector<u_int8_t> &response);
+	
+	/**
+	 * Recalculate the measurements if an accumulation interval has passed
+	 * @param seconds Time since the simulator started
+	 * @return true if the output registers were updated
+	 */
+	bool update(double seconds);
+	
+	/**
+	 * @return Number of frames received and how many were rejected
+	 */
+	unsigned long getFrameCount() { return frameCount; }
+	unsigned long getErrorCount() { return errorCount; }
+	
+private:
+	void execute(const u_int8_t *payload, int length, std::vector<u_int8_t> &response);
+	void updateRecord(u_int16_t pointerAddress, u_int16_t minAddress, u_int16_t maxAddress, u_int16_t *lastPointer);
+	u_int32_t readOutput(u_int16_t address);
+	double accumulationPeriod();
+	
+	u_int16_t get16(u_int16_t address);
+	u_int32_t get32(u_int16_t address);
+	void set16(u_int16_t address, u_int16_t value);
+	void set32(u_int16_t address, u_int32_t value);
+	void add64(u_int16_t address, u_int64_t value);
+	
+	Waveform *waveform;
+	u_int8_t registers[REGISTER_MAP_SIZE];
+	u_int8_t flash[REGISTER_MAP_SIZE];
+	u_int8_t eeprom[EEPROM_PAGE_COUNT][EEPROM_PAGE_SIZE];
+	u_int16_t addressPointer;
+	
+	/* Frame receiver */
+	std::vector<u_int8_t> frame;
+	
+	/* Measurement state */
+	double lastUpdate;
+	double energy[4];
+	u_int16_t lastPointer1;
+	u_int16_t lastPointer2;
+	
+	unsigned long frameCount;
+	unsigned long errorCount;
+};
+
+#endif /* MCP39F511SIMULATOR_H */
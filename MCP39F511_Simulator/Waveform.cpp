@@ -0,0 +1,96 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   Waveform.cpp
+ * Author: Stephan de Georgio
+ * 
+ * Created on 16 October 2026, 15:10
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "Waveform.h"
+
+Waveform::Waveform() {
+	constant.voltageRms = 230;
+	constant.currentRms = 1;
+	constant.powerFactor = 1;
+	constant.frequency = 50;
+	noise = 0;
+}
+
+bool Waveform::load(const std::string &fileName) {
+	std::ifstream file(fileName.c_str());
+	std::string line;
+	
+	if(!file) {
+		return false;
+	}
+	
+	steps.clear();
+	while(std::getline(file, line)) {
+		std::istringstream fields(line);
+		Step step;
+		
+		if(line.empty() || line[0] == '#') {
+			continue;
+		}
+		step.point.frequency = constant.frequency;
+		if(!(fields >> step.time >> step.point.voltageRms >> step.point.currentRms >> step.point.powerFactor)) {
+			continue;
+		}
+		fields >> step.point.frequency;
+		steps.push_back(step);
+	}
+	return !steps.empty();
+}
+
+void Waveform::setConstant(WaveformPoint point) {
+	constant = point;
+}
+
+void Waveform::setNoise(double percent) {
+	noise = percent / 100;
+}
+
+WaveformPoint Waveform::at(double seconds) {
+	WaveformPoint point = constant;
+	
+	if(!steps.empty()) {
+		/* Loop the script, a step lasts until the start of the next */
+		double length = steps.back().time;
+		if(length > 0) {
+			seconds = std::fmod(seconds, length);
+		}
+		point = steps.front().point;
+		for(size_t i = 0; i < steps.size() && steps[i].time <= seconds; i++) {
+			point = steps[i].point;
+		}
+	}
+	
+	if(noise > 0) {
+		point.voltageRms *= 1 + noise * (2 * (rand() / (double)RAND_MAX) - 1);
+		point.currentRms *= 1 + noise * (2 * (rand() / (double)RAND_MAX) - 1);
+	}
+	return point;
+}
@@ -0,0 +1,89 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   Waveform.h
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 15:10
+ */
+
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Mains conditions presented to the simulated MCP39F511 at a point in time
+ */
+typedef struct {
+	double voltageRms;
+	double currentRms;
+	double powerFactor;
+	double frequency;
+} WaveformPoint;
+
+/**
+ * Scriptable voltage / current / power factor waveform.
+ * Without a script the waveform is constant.  A script is a text file with one step per line:
+ *     <seconds> <volts> <amps> <power factor> [<frequency>]
+ * Each step holds until the time of the next, the script loops once the last step has been reached.
+ * Blank lines and lines starting with # are ignored.
+ */
+class Waveform {
+public:
+	Waveform();
+	
+	/**
+	 * Load a waveform script
+	 * @param fileName Script to load
+	 * @return false if the file could not be read or has no steps
+	 */
+	bool load(const std::string &fileName);
+	
+	/**
+	 * Set the value used when there is no script
+	 */
+	void setConstant(WaveformPoint point);
+	
+	/**
+	 * Set random noise added to the voltage and current
+	 * @param percent Peak noise as a percentage of the value
+	 */
+	void setNoise(double percent);
+	
+	/**
+	 * @param seconds Time since the simulator started
+	 * @return Mains conditions at that time
+	 */
+	WaveformPoint at(double seconds);
+	
+private:
+	typedef struct {
+		double time;
+		WaveformPoint point;
+	} Step;
+	
+	std::vector<Step> steps;
+	WaveformPoint constant;
+	double noise;
+};
+
+#endif /* WAVEFORM_H */
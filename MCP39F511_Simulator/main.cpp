@@ -0,0 +1,199 @@
+/*
+ * EM100 - Energy Monitor for Volts / Amps / Power displayed on LCD, with USB and Ethernet interfaces.
+ * Copyright (C) 2016-2017 Stephan de Georgio
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/* 
+ * File:   main.cpp
+ * Author: Stephan de Georgio
+ *
+ * Created on 16 October 2026, 15:10
+ *
+ * MCP39F511 simulator.  Creates a pseudo-terminal that behaves like the MCP39F511 on the
+ * Energy Monitor's serial port so the application can be run and benchmarked on any Linux box:
+ *     MCP39F511_Simulator -l /tmp/ttyMCP &
+ *     Energy_Monitor -s /tmp/ttyMCP
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "MCP39F511Simulator.h"
+#include "Waveform.h"
+
+/* How often the main loop wakes to update the measurements, in milliseconds */
+#define UPDATE_INTERVAL 5
+
+static volatile bool running = true;
+
+static void stop(int) {
+	running = false;
+}
+
+static double now() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+	printf("Usage: %s [options]\n"
+		   "  -l <path>     Create a symlink to the pseudo-terminal at <path>\n"
+		   "  -v <volts>    RMS voltage (default 230)\n"
+		   "  -i <amps>     RMS current (default 1)\n"
+		   "  -p <pf>       Power factor (default 1)\n"
+		   "  -f <hz>       Line frequency (default 50)\n"
+		   "  -n <percent>  Random noise on voltage and current\n"
+		   "  -w <file>     Waveform script, lines of: <seconds> <volts> <amps> <pf> [<hz>]\n"
+		   "  -d <us>       Delay before each response in microseconds\n"
+		   "  -q            Quiet, don't print statistics\n", name);
+}
+
+/**
+ * Open a pseudo-terminal in raw mode
+ * @param master Set to the master side, which the simulator reads and writes
+ * @return Path of the slave side for the application to open, empty on failure
+ */
+static std::string openPty(int *master) {
+	struct termios options;
+	
+	*master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(*master < 0 || grantpt(*master) < 0 || unlockpt(*master) < 0) {
+		return "";
+	}
+	std::string slave = ptsname(*master);
+	
+	/* Raw 8N1 so no bytes are translated */
+	tcgetattr(*master, &options);
+	cfmakeraw(&options);
+	tcsetattr(*master, TCSANOW, &options);
+	return slave;
+}
+
+int main(int argc, char **argv) {
+	WaveformPoint point;
+	Waveform waveform;
+	std::string linkPath;
+	std::string script;
+	int responseDelay = 0;
+	bool quiet = false;
+	double noise = 0;
+	int option;
+	
+	point.voltageRms = 230;
+	point.currentRms = 1;
+	point.powerFactor = 1;
+	point.frequency = 50;
+	
+	while((option = getopt(argc, argv, "l:v:i:p:f:n:w:d:qh")) != -1) {
+		switch(option) {
+			case 'l': linkPath = optarg; break;
+			case 'v': point.voltageRms = atof(optarg); break;
+			case 'i': point.currentRms = atof(optarg); break;
+			case 'p': point.powerFactor = atof(optarg); break;
+			case 'f': point.frequency = atof(optarg); break;
+			case 'n': noise = atof(optarg); break;
+			case 'w': script = optarg; break;
+			case 'd': responseDelay = atoi(optarg); break;
+			case 'q': quiet = true; break;
+			default:
+				usage(argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
+	
+	waveform.setConstant(point);
+	waveform.setNoise(noise);
+	if(!script.empty() && !waveform.load(script)) {
+		fprintf(stderr, "Unable to load waveform script %s\n", script.c_str());
+		return 1;
+	}
+	
+	int master;
+	std::string slave = openPty(&master);
+	if(slave.empty()) {
+		perror("Unable to create pseudo-terminal");
+		return 1;
+	}
+	/* Hold the slave open so the master doesn't see a hang up between application runs */
+	int slaveHold = open(slave.c_str(), O_RDWR | O_NOCTTY);
+	
+	if(!linkPath.empty()) {
+		unlink(linkPath.c_str());
+		if(symlink(slave.c_str(), linkPath.c_str()) < 0) {
+			perror("Unable to create symlink");
+			return 1;
+		}
+	}
+	printf("MCP39F511 simulator on %s\n", linkPath.empty() ? slave.c_str() : linkPath.c_str());
+	fflush(stdout);
+	
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	
+	MCP39F511Simulator simulator(&waveform);
+	double start = now();
+	double lastReport = start;
+	u_int8_t buffer[256];
+	std::vector<u_int8_t> response;
+	
+	while(running) {
+		struct pollfd fds;
+		fds.fd = master;
+		fds.events = POLLIN;
+		
+		if(poll(&fds, 1, UPDATE_INTERVAL) > 0 && (fds.revents & POLLIN)) {
+			int count = read(master, buffer, sizeof(buffer));
+			if(count > 0) {
+				response.clear();
+				simulator.receive(buffer, count, response);
+				if(!response.empty()) {
+					if(responseDelay) {
+						usleep(responseDelay);
+					}
+					if(write(master, &response[0], response.size()) < 0) {
+						perror("Write to pseudo-terminal failed");
+					}
+				}
+			}
+		}
+		simulator.update(now() - start);
+		
+		if(!quiet && now() - lastReport >= 10) {
+			lastReport = now();
+			printf("Frames: %lu, errors: %lu\n", simulator.getFrameCount(), simulator.getErrorCount());
+			fflush(stdout);
+		}
+	}
+	
+	if(!linkPath.empty()) {
+		unlink(linkPath.c_str());
+	}
+	close(slaveHold);
+	close(master);
+	return 0;
+}